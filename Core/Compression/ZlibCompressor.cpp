@@ -93,6 +93,92 @@ namespace Orthanc
   }
 
 
+  void ZlibCompressor::Compress(IStreamOutput& target,
+                                const void* uncompressed,
+                                size_t uncompressedSize,
+                                IStreamOutput* source)
+  {
+    // Size of the chunks that are given to zlib, and that are
+    // produced by zlib
+    static const size_t INPUT_CHUNK = 256 * 1024;
+    static const size_t OUTPUT_CHUNK = 64 * 1024;
+
+    if (uncompressedSize == 0)
+    {
+      return;
+    }
+
+    // Same header as the buffered version
+    target.Append(&uncompressedSize, sizeof(size_t));
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    switch (deflateInit(&stream, compressionLevel_))
+    {
+    case Z_OK:
+      break;
+
+    case Z_MEM_ERROR:
+      throw OrthancException(ErrorCode_NotEnoughMemory);
+
+    default:
+      throw OrthancException(ErrorCode_InternalError);
+    }
+
+    try
+    {
+      std::vector<uint8_t> output(OUTPUT_CHUNK);
+
+      const uint8_t* current = static_cast<const uint8_t*>(uncompressed);
+      size_t remaining = uncompressedSize;
+      int flush;
+
+      do
+      {
+        size_t chunk = (remaining < INPUT_CHUNK ? remaining : INPUT_CHUNK);
+
+        if (source != NULL)
+        {
+          source->Append(current, chunk);
+        }
+
+        stream.next_in = const_cast<Bytef*>(current);
+        stream.avail_in = static_cast<uInt>(chunk);
+        current += chunk;
+        remaining -= chunk;
+        flush = (remaining == 0 ? Z_FINISH : Z_NO_FLUSH);
+
+        do
+        {
+          stream.next_out = &output[0];
+          stream.avail_out = static_cast<uInt>(output.size());
+
+          if (deflate(&stream, flush) == Z_STREAM_ERROR)
+          {
+            throw OrthancException(ErrorCode_InternalError);
+          }
+
+          size_t produced = output.size() - stream.avail_out;
+          if (produced > 0)
+          {
+            target.Append(&output[0], produced);
+          }
+        }
+        while (stream.avail_out == 0);
+      }
+      while (flush != Z_FINISH);
+    }
+    catch (...)
+    {
+      deflateEnd(&stream);
+      throw;
+    }
+
+    deflateEnd(&stream);
+  }
+
+
   void ZlibCompressor::Uncompress(std::string& uncompressed,
                                   const void* compressed,
                                   size_t compressedSize)
@@ -42,6 +42,17 @@ namespace Orthanc
     uint8_t compressionLevel_;
 
   public:
+    class IStreamOutput
+    {
+    public:
+      virtual ~IStreamOutput()
+      {
+      }
+
+      virtual void Append(const void* data,
+                          size_t size) = 0;
+    };
+
     using BufferCompressor::Compress;
     using BufferCompressor::Uncompress;
 
@@ -64,5 +75,18 @@ namespace Orthanc
     virtual void Uncompress(std::string& uncompressed,
                             const void* compressed,
                             size_t compressedSize);
+
+    /**
+     * Streaming version of "Compress()", that produces the same
+     * format, without allocating the whole compressed buffer. The
+     * compressed data is sent by chunks to "target". If "source" is
+     * not NULL, it is sent the successive chunks of the uncompressed
+     * buffer right before they are compressed, which allows to
+     * process them while they are in the CPU cache.
+     **/
+    void Compress(IStreamOutput& target,
+                  const void* uncompressed,
+                  size_t uncompressedSize,
+                  IStreamOutput* source);
   };
 }
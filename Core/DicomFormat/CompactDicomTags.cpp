@@ -0,0 +1,467 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "CompactDicomTags.h"
+
+#include "../OrthancException.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+namespace Orthanc
+{
+  /**
+   * Layout of the serialization (all the integers are little-endian):
+   *
+   *   - 4 bytes: The magic string "OTAG".
+   *   - 4 bytes: The version of the format (currently 1). A reader
+   *     rejects the versions it does not know.
+   *   - 4 bytes: The number N of top-level tags.
+   *   - N entries of 20 bytes, sorted by tag: group (2 bytes), element
+   *     (2 bytes), type of the value (1 byte), flags (1 byte), padding
+   *     (2 bytes), offset of the name (4 bytes), offset of the private
+   *     creator (4 bytes), offset of the value (4 bytes).
+   *   - The blob, to which the offsets refer. The strings are prefixed
+   *     by their length on 4 bytes. A sequence is made of its number
+   *     of items (4 bytes), followed by each item as a nested
+   *     serialization prefixed by its size (4 bytes).
+   **/
+
+  static const char MAGIC[4] = { 'O', 'T', 'A', 'G' };
+  static const uint32_t VERSION = 1;
+  static const size_t HEADER_SIZE = 12;
+  static const size_t ENTRY_SIZE = 20;
+  static const uint8_t FLAG_PRIVATE_CREATOR = 1;
+
+
+  static uint16_t ReadUint16(const uint8_t* p)
+  {
+    return (static_cast<uint16_t>(p[0]) |
+            static_cast<uint16_t>(p[1]) << 8);
+  }
+
+  static uint32_t ReadUint32(const uint8_t* p)
+  {
+    return (static_cast<uint32_t>(p[0]) |
+            static_cast<uint32_t>(p[1]) << 8 |
+            static_cast<uint32_t>(p[2]) << 16 |
+            static_cast<uint32_t>(p[3]) << 24);
+  }
+
+  static void WriteUint16(std::string& target, uint16_t value)
+  {
+    target.push_back(static_cast<char>(value & 0xff));
+    target.push_back(static_cast<char>((value >> 8) & 0xff));
+  }
+
+  static void WriteUint32(std::string& target, uint32_t value)
+  {
+    target.push_back(static_cast<char>(value & 0xff));
+    target.push_back(static_cast<char>((value >> 8) & 0xff));
+    target.push_back(static_cast<char>((value >> 16) & 0xff));
+    target.push_back(static_cast<char>((value >> 24) & 0xff));
+  }
+
+  static uint32_t AppendString(std::string& blob, const std::string& s)
+  {
+    uint32_t offset = static_cast<uint32_t>(blob.size());
+    WriteUint32(blob, static_cast<uint32_t>(s.size()));
+    blob += s;
+    return offset;
+  }
+
+
+  static DicomTag ParseTag(const std::string& s)
+  {
+    unsigned int group, element;
+    char c;
+    if (s.size() != 9 ||
+        sscanf(s.c_str(), "%04x,%04x%c", &group, &element, &c) != 2)
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    return DicomTag(static_cast<uint16_t>(group), static_cast<uint16_t>(element));
+  }
+
+
+  namespace
+  {
+    struct TagComparator
+    {
+      bool operator() (const std::pair<DicomTag, std::string>& a,
+                       const std::pair<DicomTag, std::string>& b) const
+      {
+        return a.first < b.first;
+      }
+    };
+  }
+
+
+  void CompactDicomTags::Setup(const void* data,
+                               size_t size)
+  {
+    if (!IsCompact(data, size))
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    data_ = reinterpret_cast<const uint8_t*>(data);
+    size_ = size;
+
+    if (ReadUint32(data_ + 4) != VERSION)
+    {
+      // Written by a more recent version of Orthanc
+      throw OrthancException(ErrorCode_NotImplemented);
+    }
+
+    count_ = ReadUint32(data_ + 8);
+
+    if (static_cast<uint64_t>(count_) * ENTRY_SIZE > size_ - HEADER_SIZE)
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+  }
+
+
+  CompactDicomTags::CompactDicomTags(const void* data,
+                                     size_t size)
+  {
+    Setup(data, size);
+  }
+
+
+  CompactDicomTags::CompactDicomTags(const std::string& content)
+  {
+    Setup(content.c_str(), content.size());
+  }
+
+
+  bool CompactDicomTags::IsCompact(const void* data,
+                                   size_t size)
+  {
+    return (size >= HEADER_SIZE &&
+            memcmp(data, MAGIC, sizeof(MAGIC)) == 0);
+  }
+
+
+  bool CompactDicomTags::IsCompact(const std::string& content)
+  {
+    return IsCompact(content.c_str(), content.size());
+  }
+
+
+  void CompactDicomTags::Serialize(std::string& target,
+                                   const Json::Value& tags)
+  {
+    if (tags.type() != Json::objectValue)
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    std::vector< std::pair<DicomTag, std::string> > sorted;
+
+    Json::Value::Members members = tags.getMemberNames();
+    sorted.reserve(members.size());
+    for (size_t i = 0; i < members.size(); i++)
+    {
+      sorted.push_back(std::make_pair(ParseTag(members[i]), members[i]));
+    }
+
+    std::sort(sorted.begin(), sorted.end(), TagComparator());
+
+    std::string entries;
+    std::string blob;
+    entries.reserve(sorted.size() * ENTRY_SIZE);
+
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+      const Json::Value& tag = tags[sorted[i].second];
+      if (tag.type() != Json::objectValue ||
+          !tag.isMember("Type") ||
+          !tag.isMember("Name"))
+      {
+        throw OrthancException(ErrorCode_BadFileFormat);
+      }
+
+      const std::string type = tag["Type"].asString();
+      const Json::Value& value = tag["Value"];
+
+      ValueType valueType;
+      uint32_t valueOffset = 0;
+
+      if (type == "Null")
+      {
+        valueType = ValueType_Null;
+      }
+      else if (type == "TooLong")
+      {
+        valueType = ValueType_TooLong;
+      }
+      else if (type == "String")
+      {
+        valueType = ValueType_String;
+        valueOffset = AppendString(blob, value.asString());
+      }
+      else if (type == "Sequence")
+      {
+        if (value.type() != Json::arrayValue)
+        {
+          throw OrthancException(ErrorCode_BadFileFormat);
+        }
+
+        valueType = ValueType_Sequence;
+        valueOffset = static_cast<uint32_t>(blob.size());
+        WriteUint32(blob, value.size());
+
+        for (Json::Value::ArrayIndex j = 0; j < value.size(); j++)
+        {
+          std::string item;
+          Serialize(item, value[j]);
+          AppendString(blob, item);
+        }
+      }
+      else
+      {
+        throw OrthancException(ErrorCode_BadFileFormat);
+      }
+
+      uint8_t flags = 0;
+      uint32_t creatorOffset = 0;
+      if (tag.isMember("PrivateCreator"))
+      {
+        flags |= FLAG_PRIVATE_CREATOR;
+        creatorOffset = AppendString(blob, tag["PrivateCreator"].asString());
+      }
+
+      WriteUint16(entries, sorted[i].first.GetGroup());
+      WriteUint16(entries, sorted[i].first.GetElement());
+      entries.push_back(static_cast<char>(valueType));
+      entries.push_back(static_cast<char>(flags));
+      WriteUint16(entries, 0);  // Padding
+      WriteUint32(entries, AppendString(blob, tag["Name"].asString()));
+      WriteUint32(entries, creatorOffset);
+      WriteUint32(entries, valueOffset);
+    }
+
+    target.clear();
+    target.reserve(HEADER_SIZE + entries.size() + blob.size());
+    target.append(MAGIC, sizeof(MAGIC));
+    WriteUint32(target, VERSION);
+    WriteUint32(target, static_cast<uint32_t>(sorted.size()));
+    target += entries;
+    target += blob;
+  }
+
+
+  const uint8_t* CompactDicomTags::GetEntry(size_t index) const
+  {
+    if (index >= count_)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    return data_ + HEADER_SIZE + index * ENTRY_SIZE;
+  }
+
+
+  const uint8_t* CompactDicomTags::GetBlob(uint64_t offset,
+                                           uint32_t size) const
+  {
+    size_t start = HEADER_SIZE + count_ * ENTRY_SIZE;
+
+    if (start + offset + size > size_)
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    return data_ + start + offset;
+  }
+
+
+  void CompactDicomTags::GetString(std::string& target,
+                                   uint64_t offset) const
+  {
+    uint32_t length = ReadUint32(GetBlob(offset, 4));
+    const uint8_t* s = GetBlob(offset + 4, length);
+    target.assign(reinterpret_cast<const char*>(s), length);
+  }
+
+
+  bool CompactDicomTags::LookupEntry(size_t& index,
+                                     const DicomTag& tag) const
+  {
+    // Binary search in the sorted array of entries
+    size_t low = 0;
+    size_t high = count_;
+
+    while (low < high)
+    {
+      size_t middle = low + (high - low) / 2;
+      DicomTag current = GetTag(middle);
+
+      if (current == tag)
+      {
+        index = middle;
+        return true;
+      }
+      else if (current < tag)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    return false;
+  }
+
+
+  DicomTag CompactDicomTags::GetTag(size_t index) const
+  {
+    const uint8_t* entry = GetEntry(index);
+    return DicomTag(ReadUint16(entry), ReadUint16(entry + 2));
+  }
+
+
+  CompactDicomTags::ValueType CompactDicomTags::GetValueType(size_t index) const
+  {
+    const uint8_t* entry = GetEntry(index);
+    if (entry[4] > ValueType_Sequence)
+    {
+      throw OrthancException(ErrorCode_BadFileFormat);
+    }
+
+    return static_cast<ValueType>(entry[4]);
+  }
+
+
+  bool CompactDicomTags::HasTag(const DicomTag& tag) const
+  {
+    size_t index;
+    return LookupEntry(index, tag);
+  }
+
+
+  bool CompactDicomTags::LookupValue(std::string& value,
+                                     const DicomTag& tag) const
+  {
+    size_t index;
+    if (!LookupEntry(index, tag))
+    {
+      return false;
+    }
+
+    if (GetValueType(index) == ValueType_String)
+    {
+      GetString(value, ReadUint32(GetEntry(index) + 16));
+    }
+    else
+    {
+      value.clear();
+    }
+
+    return true;
+  }
+
+
+  void CompactDicomTags::ToJson(Json::Value& target) const
+  {
+    target = Json::objectValue;
+
+    for (size_t i = 0; i < count_; i++)
+    {
+      const uint8_t* entry = GetEntry(i);
+
+      Json::Value& tag = target[GetTag(i).Format()];
+      tag = Json::objectValue;
+
+      std::string s;
+      GetString(s, ReadUint32(entry + 8));
+      tag["Name"] = s;
+
+      if (entry[5] & FLAG_PRIVATE_CREATOR)
+      {
+        GetString(s, ReadUint32(entry + 12));
+        tag["PrivateCreator"] = s;
+      }
+
+      uint32_t valueOffset = ReadUint32(entry + 16);
+
+      switch (GetValueType(i))
+      {
+        case ValueType_Null:
+          tag["Type"] = "Null";
+          tag["Value"] = Json::nullValue;
+          break;
+
+        case ValueType_TooLong:
+          tag["Type"] = "TooLong";
+          tag["Value"] = Json::nullValue;
+          break;
+
+        case ValueType_String:
+          GetString(s, valueOffset);
+          tag["Type"] = "String";
+          tag["Value"] = s;
+          break;
+
+        case ValueType_Sequence:
+        {
+          Json::Value items = Json::arrayValue;
+
+          uint32_t countItems = ReadUint32(GetBlob(valueOffset, 4));
+          uint64_t offset = static_cast<uint64_t>(valueOffset) + 4;
+
+          for (uint32_t j = 0; j < countItems; j++)
+          {
+            uint32_t size = ReadUint32(GetBlob(offset, 4));
+            CompactDicomTags item(GetBlob(offset + 4, size), size);
+            item.ToJson(items.append(Json::objectValue));
+            offset += 4 + size;
+          }
+
+          tag["Type"] = "Sequence";
+          tag["Value"] = items;
+          break;
+        }
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
+    }
+  }
+}
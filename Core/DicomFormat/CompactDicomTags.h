@@ -0,0 +1,118 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "DicomTag.h"
+
+#include <string>
+#include <json/value.h>
+
+namespace Orthanc
+{
+  /**
+   * Read-only view over a compact binary serialization of the DICOM
+   * tags of an instance. This serialization replaces the styled JSON
+   * of the "dicom-as-json" attachments. The top-level tags are stored
+   * in a sorted array of fixed-size entries that refer to a blob of
+   * strings, so that a single tag can be looked up by binary search
+   * without parsing the whole document. The view does not copy the
+   * buffer, that can thus be memory-mapped: The caller must keep it
+   * alive as long as the view is used.
+   **/
+  class CompactDicomTags
+  {
+  public:
+    enum ValueType
+    {
+      ValueType_Null = 0,
+      ValueType_String = 1,
+      ValueType_TooLong = 2,
+      ValueType_Sequence = 3
+    };
+
+  private:
+    const uint8_t* data_;
+    size_t size_;
+    uint32_t count_;
+
+    const uint8_t* GetEntry(size_t index) const;
+
+    bool LookupEntry(size_t& index,
+                     const DicomTag& tag) const;
+
+    void Setup(const void* data,
+               size_t size);
+
+    const uint8_t* GetBlob(uint64_t offset,
+                           uint32_t size) const;
+
+    void GetString(std::string& target,
+                   uint64_t offset) const;
+
+  public:
+    CompactDicomTags(const void* data,
+                     size_t size);
+
+    CompactDicomTags(const std::string& content);
+
+    // Tells whether a buffer contains a compact serialization (as
+    // opposed to the JSON of the former "dicom-as-json" attachments)
+    static bool IsCompact(const void* data,
+                          size_t size);
+
+    static bool IsCompact(const std::string& content);
+
+    // "tags" must follow the format of "FromDcmtkBridge::ToJson()"
+    static void Serialize(std::string& target,
+                          const Json::Value& tags);
+
+    size_t GetSize() const
+    {
+      return count_;
+    }
+
+    DicomTag GetTag(size_t index) const;
+
+    ValueType GetValueType(size_t index) const;
+
+    bool HasTag(const DicomTag& tag) const;
+
+    // Returns "false" if the tag is absent. The value is empty if the
+    // tag is not a string.
+    bool LookupValue(std::string& value,
+                     const DicomTag& tag) const;
+
+    // Same format as "FromDcmtkBridge::ToJson()"
+    void ToJson(Json::Value& target) const;
+  };
+}
@@ -220,6 +220,16 @@ namespace Orthanc
   };
 
 
+  // Content encodings that can be negotiated with the HTTP clients
+  // through the "Accept-Encoding" header
+  enum HttpCompression
+  {
+    HttpCompression_None,
+    HttpCompression_Deflate,
+    HttpCompression_Gzip
+  };
+
+
   enum ImageFormat
   {
     ImageFormat_Png = 1
@@ -34,44 +34,133 @@
 
 #include "../OrthancException.h"
 #include "FileStorageAccessor.h"
-#include "../HttpServer/BufferHttpSender.h"
+#include "../HttpServer/ZlibFileHttpSender.h"
 
 namespace Orthanc
 {
+  namespace
+  {
+    // Computes the MD5 hash of a stream (if requested), and writes
+    // this stream to a new file of the storage area (if requested)
+    class StreamHasher : public ZlibCompressor::IStreamOutput
+    {
+    private:
+      std::auto_ptr<Toolbox::MD5Context> md5_;
+      FileStorage::FileWriter* writer_;
+      uint64_t size_;
+
+    public:
+      StreamHasher(bool computeMD5,
+                   FileStorage::FileWriter* writer) :
+        writer_(writer),
+        size_(0)
+      {
+        if (computeMD5)
+        {
+          md5_.reset(new Toolbox::MD5Context);
+        }
+      }
+
+      virtual void Append(const void* data,
+                          size_t size)
+      {
+        if (md5_.get() != NULL)
+        {
+          md5_->Append(data, size);
+        }
+
+        if (writer_ != NULL)
+        {
+          writer_->Write(data, size);
+        }
+
+        size_ += size;
+      }
+
+      void GetMD5(std::string& md5)
+      {
+        if (md5_.get() != NULL)
+        {
+          md5_->Finish(md5);
+        }
+        else
+        {
+          md5.clear();
+        }
+      }
+
+      uint64_t GetSize() const
+      {
+        return size_;
+      }
+    };
+  }
+
+
   FileInfo CompressedFileStorageAccessor::WriteInternal(const void* data,
                                                         size_t size,
                                                         FileContentType type)
   {
-    std::string md5;
-
-    if (storeMD5_)
-    {
-      Toolbox::ComputeMD5(md5, data, size);
-    }
-
     switch (compressionType_)
     {
     case CompressionType_None:
     {
-      std::string uuid = storage_.Create(data, size);
+      std::string md5;
+      std::string uuid;
+
+      if (storeMD5_)
+      {
+        uuid = storage_.CreateWithMD5(md5, data, size);
+      }
+      else
+      {
+        uuid = storage_.Create(data, size);
+      }
+
       return FileInfo(uuid, type, size, md5);
     }
 
     case CompressionType_Zlib:
     {
-      std::string compressed;
-      zlib_.Compress(compressed, data, size);
+      std::string md5, compressedMD5;
 
-      std::string compressedMD5;
-      
-      if (storeMD5_)
+      if (storage_.IsContentAddressed())
       {
-        Toolbox::ComputeMD5(compressedMD5, compressed);
+        // The UUID of the file depends on its content: The compressed
+        // buffer must be available as a whole
+        if (storeMD5_)
+        {
+          Toolbox::ComputeMD5(md5, data, size);
+        }
+
+        std::string compressed;
+        zlib_.Compress(compressed, data, size);
+
+        if (storeMD5_)
+        {
+          Toolbox::ComputeMD5(compressedMD5, compressed);
+        }
+
+        std::string uuid = storage_.Create(compressed);
+        return FileInfo(uuid, type, size, md5,
+                        CompressionType_Zlib, compressed.size(), compressedMD5);
       }
 
-      std::string uuid = storage_.Create(compressed);
+      // Single pass over the data: Each chunk of the input is hashed
+      // right before being compressed, and each compressed chunk is
+      // hashed right before being written to the disk
+      FileStorage::FileWriter writer(storage_);
+      StreamHasher input(storeMD5_, NULL);
+      StreamHasher output(storeMD5_, &writer);
+
+      zlib_.Compress(output, data, size, storeMD5_ ? &input : NULL);
+
+      input.GetMD5(md5);
+      output.GetMD5(compressedMD5);
+
+      std::string uuid = writer.Commit();
       return FileInfo(uuid, type, size, md5,
-                      CompressionType_Zlib, compressed.size(), compressedMD5);
+                      CompressionType_Zlib, output.GetSize(), compressedMD5);
     }
 
     default:
@@ -119,13 +208,8 @@ namespace Orthanc
 
     case CompressionType_Zlib:
     {
-      std::string compressed;
-      storage_.ReadFile(compressed, uuid);
-
-      std::auto_ptr<BufferHttpSender> sender(new BufferHttpSender);
-      zlib_.Uncompress(sender->GetBuffer(), compressed);
-
-      return sender.release();
+      // The file is uncompressed while it is sent
+      return new ZlibFileHttpSender(storage_, uuid);
     }        
 
     default:
@@ -41,6 +41,21 @@
 
 #include <boost/filesystem/fstream.hpp>
 #include <glog/logging.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if !defined(O_BINARY)
+#define O_BINARY 0
+#endif
 
 static std::string ToString(const boost::filesystem::path& p)
 {
@@ -54,7 +69,10 @@ static std::string ToString(const boost::filesystem::path& p)
 
 namespace Orthanc
 {
-  boost::filesystem::path FileStorage::GetPath(const std::string& uuid) const
+  static const size_t DIRECTORIES_COUNT = 65536;  // "00/00" to "ff/ff"
+
+  static boost::filesystem::path MakePath(const boost::filesystem::path& volume,
+                                          const std::string& uuid)
   {
     namespace fs = boost::filesystem;
 
@@ -63,7 +81,7 @@ namespace Orthanc
       throw OrthancException(ErrorCode_ParameterOutOfRange);
     }
 
-    fs::path path = root_;
+    fs::path path = volume;
 
     path /= std::string(&uuid[0], &uuid[2]);
     path /= std::string(&uuid[2], &uuid[4]);
@@ -76,49 +94,282 @@ namespace Orthanc
     return path;
   }
 
-  FileStorage::FileStorage(std::string root)
+
+  static uint64_t HashPlacement(const boost::filesystem::path& volume,
+                                const std::string& uuid)
+  {
+    // 64-bit FNV-1a hash, which is stable across platforms and
+    // versions (as opposed to "boost::hash")
+    const std::string s = volume.string() + "|" + uuid;
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < s.size(); i++)
+    {
+      hash ^= static_cast<uint8_t>(s[i]);
+      hash *= 1099511628211ULL;
+    }
+
+    return hash;
+  }
+
+
+  size_t FileStorage::GetPlacementVolumeIndex(const std::string& uuid) const
+  {
+    assert(!volumes_.empty());
+
+    if (volumes_.size() == 1)
+    {
+      return 0;
+    }
+
+    // Rendezvous hashing: The file goes to the volume with the
+    // highest score
+    size_t best = 0;
+    uint64_t bestScore = HashPlacement(volumes_[0], uuid);
+
+    for (size_t i = 1; i < volumes_.size(); i++)
+    {
+      uint64_t score = HashPlacement(volumes_[i], uuid);
+      if (score > bestScore)
+      {
+        best = i;
+        bestScore = score;
+      }
+    }
+
+    return best;
+  }
+
+
+  boost::filesystem::path FileStorage::GetPlacementPath(const std::string& uuid) const
+  {
+    return MakePath(GetPlacementVolume(uuid), uuid);
+  }
+
+
+  boost::filesystem::path FileStorage::GetPath(const std::string& uuid) const
+  {
+    boost::filesystem::path path = GetPlacementPath(uuid);
+
+    if ((volumes_.size() > 1 || HasColdTier()) &&
+        !boost::filesystem::exists(path))
+    {
+      if (HasColdTier())
+      {
+        boost::filesystem::path cold = MakePath(coldTier_, uuid);
+        if (boost::filesystem::exists(cold))
+        {
+          return cold;
+        }
+      }
+
+      // The file might not have been relocated yet since the
+      // addition of a volume: Probe the other volumes
+      for (size_t i = 0; i < volumes_.size(); i++)
+      {
+        boost::filesystem::path other = MakePath(volumes_[i], uuid);
+        if (other != path &&
+            boost::filesystem::exists(other))
+        {
+          return other;
+        }
+      }
+    }
+
+    return path;
+  }
+
+
+  bool FileStorage::IsColdPath(const std::string& uuid,
+                               const boost::filesystem::path& path) const
+  {
+    return HasColdTier() && path == MakePath(coldTier_, uuid);
+  }
+
+
+  boost::filesystem::path FileStorage::GetPathForReading(const std::string& uuid) const
+  {
+    boost::filesystem::path path = GetPath(uuid);
+
+    if (!HasColdTier())
+    {
+      return path;
+    }
+
+    bool isCold = IsColdPath(uuid, path);
+
+    {
+      boost::mutex::scoped_lock lock(statisticsMutex_);
+      if (isCold)
+        coldReads_++;
+      else
+        hotReads_++;
+    }
+
+    {
+      boost::mutex::scoped_lock lock(pendingMutex_);
+      if (!isCold)
+      {
+        // The modification time drives the migration of the least
+        // recently used files to the cold tier
+        pendingTouches_.insert(uuid);
+      }
+      else if (promoteColdFiles_)
+      {
+        pendingPromotions_.insert(uuid);
+      }
+    }
+
+    return path;
+  }
+
+
+  bool FileStorage::LookupMovedFile(boost::filesystem::path& path,
+                                    const std::string& uuid) const
+  {
+    if (volumes_.size() == 1 &&
+        !HasColdTier())
+    {
+      return false;  // The files are never moved
+    }
+
+    boost::filesystem::path current = GetPath(uuid);
+    if (current == path ||
+        !boost::filesystem::exists(current))
+    {
+      return false;
+    }
+
+    path = current;
+    return true;
+  }
+
+
+  FileStorage::FileStorage(std::string root) :
+    promoteColdFiles_(false),
+    contentAddressed_(false),
+    durable_(false),
+    hotReads_(0),
+    coldReads_(0),
+    migrations_(0),
+    promotions_(0)
   {
     //root_ = boost::filesystem::absolute(root).string();
     root_ = root;
+    volumes_.push_back(root_);
+    knownDirectories_.push_back(std::vector<bool>(DIRECTORIES_COUNT, false));
 
     Toolbox::CreateDirectory(root);
   }
 
-  std::string FileStorage::CreateFileWithoutCompression(const void* content, size_t size)
+
+  void FileStorage::AddVolume(const std::string& path)
   {
-    std::string uuid;
-    boost::filesystem::path path;
-    
-    for (;;)
-    {
-      uuid = Toolbox::GenerateUuid();
-      path = GetPath(uuid);
+    boost::filesystem::path volume(path);
 
-      if (!boost::filesystem::exists(path))
+    for (size_t i = 0; i < volumes_.size(); i++)
+    {
+      if (volumes_[i] == volume)
       {
-        // OK, this is indeed a new file
-        break;
+        // This volume is already registered
+        return;
       }
+    }
 
-      // Extremely improbable case: This Uuid has already been created
-      // in the past. Try again.
+    Toolbox::CreateDirectory(path);
+    volumes_.push_back(volume);
+    knownDirectories_.push_back(std::vector<bool>(DIRECTORIES_COUNT, false));
+  }
+
+
+  void FileStorage::SetColdTier(const std::string& path)
+  {
+    Toolbox::CreateDirectory(path);
+    coldTier_ = path;
+  }
+
+
+  std::string FileStorage::GetVolumePath(size_t index) const
+  {
+    if (index >= volumes_.size())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
     }
 
-    if (boost::filesystem::exists(path.parent_path()))
+    return volumes_[index].string();
+  }
+
+
+  static std::string ComputeContentUuid(const void* content, size_t size)
+  {
+    std::string sha1;
+    Toolbox::ComputeSHA1(sha1, content, size);
+
+    // Keep the first 128 bits of the SHA-1 hash, and format them as
+    // a name-based UUID (version 5, RFC 4122) so that they never
+    // clash with the random UUIDs (version 4)
+    std::string hex;
+    for (size_t i = 0; i < sha1.size() && hex.size() < 32; i++)
     {
-      if (!boost::filesystem::is_directory(path.parent_path()))
+      if (sha1[i] != '-')
       {
-        throw OrthancException("The subdirectory to be created is already occupied by a regular file");        
+        hex.push_back(sha1[i]);
       }
     }
-    else
+
+    assert(hex.size() == 32);
+    hex[12] = '5';
+
+    int variant = (hex[16] >= 'a' ? hex[16] - 'a' + 10 : hex[16] - '0');
+    hex[16] = "89ab"[variant & 3];
+
+    return (hex.substr(0, 8) + "-" + hex.substr(8, 4) + "-" + hex.substr(12, 4) + "-" +
+            hex.substr(16, 4) + "-" + hex.substr(20, 12));
+  }
+
+
+  static bool HasSameContent(const boost::filesystem::path& path,
+                             const void* content,
+                             size_t size)
+  {
+    if (boost::filesystem::file_size(path) != size)
+    {
+      return false;
+    }
+
+    boost::filesystem::ifstream f;
+    f.open(path, std::ifstream::in | std::ios::binary);
+    if (!f.good())
     {
-      if (!boost::filesystem::create_directories(path.parent_path()))
+      throw OrthancException("Unable to read a file of the file storage");
+    }
+
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    std::vector<char> buffer(CHUNK_SIZE);
+
+    const char* p = static_cast<const char*>(content);
+    while (size > 0)
+    {
+      size_t chunk = (size < CHUNK_SIZE ? size : CHUNK_SIZE);
+      f.read(&buffer[0], chunk);
+      if (!f.good() ||
+          memcmp(&buffer[0], p, chunk) != 0)
       {
-        throw OrthancException("Unable to create a subdirectory in the file storage");        
+        return false;
       }
+
+      p += chunk;
+      size -= chunk;
     }
 
+    return true;
+  }
+
+
+  static void WriteContent(const boost::filesystem::path& path,
+                           const void* content, 
+                           size_t size)
+  {
     boost::filesystem::ofstream f;
     f.open(path, std::ofstream::out | std::ios::binary);
     if (!f.good())
@@ -137,8 +388,296 @@ namespace Orthanc
     }
 
     f.close();
+  }
+
+
+  void FileStorage::EnsureDirectory(size_t volume,
+                                    const std::string& uuid,
+                                    bool force)
+  {
+    assert(volume < volumes_.size() &&
+           knownDirectories_.size() == volumes_.size());
+
+    size_t index = static_cast<size_t>(strtoul(uuid.substr(0, 4).c_str(), NULL, 16)) % DIRECTORIES_COUNT;
+
+    if (!force)
+    {
+      boost::mutex::scoped_lock lock(directoriesMutex_);
+      if (knownDirectories_[volume][index])
+      {
+        return;
+      }
+    }
+
+    boost::filesystem::path directory = MakePath(volumes_[volume], uuid).parent_path();
+
+    if (boost::filesystem::exists(directory))
+    {
+      if (!boost::filesystem::is_directory(directory))
+      {
+        throw OrthancException("The subdirectory to be created is already occupied by a regular file");        
+      }
+    }
+    else
+    {
+      boost::filesystem::path parent = directory.parent_path();
+      bool isNewParent = !boost::filesystem::exists(parent);
+
+      boost::filesystem::create_directories(directory);
+
+      if (durable_)
+      {
+        // The new "xx" directory must reach the disk: The flushes of
+        // the files only cover their "xx/yy" and "xx" directories
+        if (isNewParent)
+        {
+          GroupSynchronizer::SynchronizeDirectory(parent.parent_path().string());
+        }
+
+        GroupSynchronizer::SynchronizeDirectory(parent.string());
+      }
+    }
+
+    boost::mutex::scoped_lock lock(directoriesMutex_);
+    knownDirectories_[volume][index] = true;
+  }
+
+
+  int FileStorage::OpenNewFile(std::string& path,
+                               const std::string& uuid)
+  {
+    size_t volume = GetPlacementVolumeIndex(uuid);
+    path = MakePath(volumes_[volume], uuid).string();
+
+    // The exclusive creation both checks that the UUID is not in use
+    // and creates the file, in one single system call
+    for (unsigned int attempt = 0; ; attempt++)
+    {
+      EnsureDirectory(volume, uuid, attempt > 0);
+
+      int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
+      if (fd >= 0)
+      {
+        return fd;
+      }
+      else if (errno == EEXIST)
+      {
+        return -1;
+      }
+      else if (errno != ENOENT || attempt > 0)
+      {
+        throw OrthancException("Unable to create a new file in the file storage");
+      }
+
+      // The subdirectory has been removed by "Remove()" since it was
+      // cached: Create it again
+    }
+  }
+
+
+  static void WriteToNewFile(int fd,
+                             const std::string& path,
+                             const void* content,
+                             size_t size)
+  {
+    static const size_t MAX_WRITE = 1024 * 1024 * 1024;
+
+    const uint8_t* p = static_cast<const uint8_t*>(content);
+    while (size > 0)
+    {
+      int written = write(fd, p, static_cast<unsigned int>(std::min(size, MAX_WRITE)));
+      if (written < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      else if (written <= 0)
+      {
+        close(fd);
+        unlink(path.c_str());
+        throw OrthancException("Unable to write to the new file in the file storage");
+      }
+
+      p += written;
+      size -= static_cast<size_t>(written);
+    }
+  }
+
+
+  bool FileStorage::CreateNewFile(const std::string& uuid,
+                                  const void* content, 
+                                  size_t size)
+  {
+    std::string path;
+    int fd = OpenNewFile(path, uuid);
+
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    WriteToNewFile(fd, path, content, size);
+
+    if (close(fd) != 0)
+    {
+      unlink(path.c_str());
+      throw OrthancException("Unable to write to the new file in the file storage");
+    }
+
+    return true;
+  }
+
+
+  FileStorage::FileWriter::FileWriter(FileStorage& storage) :
+    storage_(storage),
+    fd_(-1)
+  {
+    if (storage_.IsContentAddressed())
+    {
+      // The UUID of the file is only known once its content is complete
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    while (fd_ < 0)
+    {
+      // The loop handles the extremely improbable case of an UUID
+      // that has already been created in the past
+      uuid_ = Toolbox::GenerateUuid();
+      fd_ = storage_.OpenNewFile(path_, uuid_);
+    }
+  }
+
+
+  FileStorage::FileWriter::~FileWriter()
+  {
+    if (fd_ >= 0)
+    {
+      // The file was not committed
+      close(fd_);
+      unlink(path_.c_str());
+    }
+  }
+
+
+  void FileStorage::FileWriter::Write(const void* data,
+                                      size_t size)
+  {
+    if (fd_ < 0)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    try
+    {
+      WriteToNewFile(fd_, path_, data, size);
+    }
+    catch (OrthancException&)
+    {
+      // "WriteToNewFile()" has closed and removed the file
+      fd_ = -1;
+      throw;
+    }
+  }
+
+
+  std::string FileStorage::FileWriter::Commit()
+  {
+    if (fd_ < 0)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    int fd = fd_;
+    fd_ = -1;
+
+    if (close(fd) != 0)
+    {
+      unlink(path_.c_str());
+      throw OrthancException("Unable to write to the new file in the file storage");
+    }
+
+    return uuid_;
+  }
+
+
+  std::string FileStorage::CreateFileWithoutCompression(const void* content, size_t size)
+  {
+    if (contentAddressed_)
+    {
+      std::string uuid;
+      if (CreateSharedFile(uuid, content, size))
+      {
+        return uuid;
+      }
+
+      // Two different contents have the same hash (which can be
+      // forged with SHA-1): Never share the file in such a case
+      LOG(WARNING) << "Hash collision in the content-addressed storage, "
+                   << "the file is not deduplicated: " << uuid;
+    }
+
+    for (;;)
+    {
+      std::string uuid = Toolbox::GenerateUuid();
+      if (CreateNewFile(uuid, content, size))
+      {
+        // OK, this is indeed a new file
+        return uuid;
+      }
+
+      // Extremely improbable case: This Uuid has already been created
+      // in the past. Try again.
+    }
+  }
+
+
+  bool FileStorage::CreateSharedFile(std::string& uuid,
+                                     const void* content,
+                                     size_t size)
+  {
+    uuid = ComputeContentUuid(content, size);
+    boost::filesystem::path path = GetPath(uuid);
+
+    if (boost::filesystem::exists(path))
+    {
+      // The hash is already stored: Only share the existing file if
+      // it has the very same content
+      return HasSameContent(path, content, size);
+    }
+
+    // The same content might be concurrently written by another
+    // thread: Write to a temporary file, then atomically rename it
+    boost::filesystem::path tmp = path.string() + "." + Toolbox::GenerateUuid();
+
+    for (unsigned int attempt = 0; ; attempt++)
+    {
+      EnsureDirectory(GetPlacementVolumeIndex(uuid), uuid, attempt > 0);
 
-    return uuid;
+      try
+      {
+        WriteContent(tmp, content, size);
+        boost::filesystem::rename(tmp, path);
+        return true;
+      }
+      catch (...)
+      {
+        try
+        {
+          boost::filesystem::remove(tmp);
+        }
+        catch (...)
+        {
+          // Ignore the error
+        }
+
+        if (attempt > 0)
+        {
+          throw;
+        }
+
+        // The subdirectory might have been removed since it was
+        // cached: Try again after creating it
+      }
+    }
   } 
 
 
@@ -174,32 +713,104 @@ namespace Orthanc
       return Create(&content[0], content.size());
   }
 
+  std::string FileStorage::CreateWithMD5(std::string& md5,
+                                         const void* content,
+                                         size_t size)
+  {
+    if (contentAddressed_ ||
+        HasBufferCompressor())
+    {
+      // The whole content is needed before writing the file
+      Toolbox::ComputeMD5(md5, content, size);
+      return Create(content, size);
+    }
+
+    // Hash each chunk right before writing it, while it is in the CPU
+    // cache
+    static const size_t CHUNK_SIZE = 256 * 1024;
+
+    Toolbox::MD5Context context;
+    FileWriter writer(*this);
+
+    const uint8_t* current = static_cast<const uint8_t*>(content);
+    while (size > 0)
+    {
+      size_t chunk = (size < CHUNK_SIZE ? size : CHUNK_SIZE);
+      context.Append(current, chunk);
+      writer.Write(current, chunk);
+      current += chunk;
+      size -= chunk;
+    }
+
+    context.Finish(md5);
+    return writer.Commit();
+  }
+
+
   void FileStorage::ReadFile(std::string& content,
                              const std::string& uuid) const
   {
     content.clear();
 
-    if (HasBufferCompressor())
+    boost::filesystem::path path = GetPathForReading(uuid);
+
+    std::string raw;
+    for (unsigned int i = 1; ; i++)
     {
-      std::string compressed;
-      Toolbox::ReadFile(compressed, ToString(GetPath(uuid)));
+      try
+      {
+        Toolbox::ReadFile(raw, path.string());
+        break;
+      }
+      catch (OrthancException&)
+      {
+        if (i >= MAX_MOVED_FILE_LOOKUPS ||
+            !LookupMovedFile(path, uuid))
+        {
+          throw;
+        }
+      }
+    }
 
-      if (compressed.size() != 0)
+    if (HasBufferCompressor())
+    {
+      if (raw.size() != 0)
       {
-        compressor_->Uncompress(content, compressed);
+        compressor_->Uncompress(content, raw);
       }
     }
     else
     {
-      Toolbox::ReadFile(content, GetPath(uuid).string());
+      content.swap(raw);
     }
   }
 
 
+  bool FileStorage::Exists(const std::string& uuid) const
+  {
+    return boost::filesystem::exists(GetPath(uuid));
+  }
+
+
   uintmax_t FileStorage::GetCompressedSize(const std::string& uuid) const
   {
     boost::filesystem::path path = GetPath(uuid);
-    return boost::filesystem::file_size(path);
+
+    for (unsigned int i = 1; ; i++)
+    {
+      try
+      {
+        return boost::filesystem::file_size(path);
+      }
+      catch (boost::filesystem::filesystem_error&)
+      {
+        if (i >= MAX_MOVED_FILE_LOOKUPS ||
+            !LookupMovedFile(path, uuid))
+        {
+          throw;
+        }
+      }
+    }
   }
 
 
@@ -210,9 +821,22 @@ namespace Orthanc
 
     result.clear();
 
-    if (fs::exists(root_) && fs::is_directory(root_))
+    std::vector<fs::path> volumes = volumes_;
+    if (HasColdTier())
     {
-      for (fs::recursive_directory_iterator current(root_), end; current != end ; ++current)
+      volumes.push_back(coldTier_);
+    }
+
+    for (size_t i = 0; i < volumes.size(); i++)
+    {
+      const fs::path& volume = volumes[i];
+
+      if (!fs::exists(volume) || !fs::is_directory(volume))
+      {
+        continue;
+      }
+
+      for (fs::recursive_directory_iterator current(volume), end; current != end ; ++current)
       {
         if (fs::is_regular_file(current->status()))
         {
@@ -229,7 +853,7 @@ namespace Orthanc
                   p2.length() == 2 &&
                   p1 == uuid.substr(0, 2) &&
                   p2 == uuid.substr(2, 2) &&
-                  p0 == root_)
+                  p0 == volume)
               {
                 result.insert(uuid);
               }
@@ -259,13 +883,10 @@ namespace Orthanc
   }
 
 
-  void FileStorage::Remove(const std::string& uuid)
+  static void RemoveFromVolume(const boost::filesystem::path& p)
   {
-    LOG(INFO) << "Deleting file " << uuid;
     namespace fs = boost::filesystem;
 
-    fs::path p = GetPath(uuid);
-
     try
     {
       fs::remove(p);
@@ -296,13 +917,289 @@ namespace Orthanc
   }
 
 
+  void FileStorage::Remove(const std::string& uuid)
+  {
+    LOG(INFO) << "Deleting file " << uuid;
+    RemoveFromVolume(GetPath(uuid));
+  }
+
+
+  bool FileStorage::MoveFile(const boost::filesystem::path& source,
+                             const boost::filesystem::path& target) const
+  {
+    namespace fs = boost::filesystem;
+
+    // Serialize the moves, so that the disappearance of the source
+    // can only be due to a concurrent call to "Remove()"
+    boost::mutex::scoped_lock lock(moveMutex_);
+
+    if (!fs::exists(source) ||
+        fs::exists(target))
+    {
+      return false;
+    }
+
+    if (!fs::exists(target.parent_path()))
+    {
+      fs::create_directories(target.parent_path());
+    }
+
+    // The volumes generally lie on distinct filesystems, which
+    // prevents a simple rename. The file is copied under a temporary
+    // name, then atomically renamed, so that at any time, one of the
+    // two copies can be found by "GetPath()".
+    fs::path tmp = target.string() + "." + Toolbox::GenerateUuid();
+
+    try
+    {
+      fs::copy_file(source, tmp);
+      fs::rename(tmp, target);
+    }
+    catch (...)
+    {
+      try
+      {
+        fs::remove(tmp);
+      }
+      catch (...)
+      {
+        // Ignore the error
+      }
+
+      throw;
+    }
+
+    if (durable_)
+    {
+      std::list<std::string> files;
+      files.push_back(target.string());
+      synchronizer_.Synchronize(files);
+    }
+
+    if (!fs::exists(source))
+    {
+      // The file was removed during the copy: Do not resurrect it
+      RemoveFromVolume(target);
+      return false;
+    }
+
+    RemoveFromVolume(source);
+    return true;
+  }
+
+
+  bool FileStorage::Relocate(const std::string& uuid)
+  {
+    boost::filesystem::path target = GetPlacementPath(uuid);
+    boost::filesystem::path source = GetPath(uuid);
+
+    if (source == target ||
+        IsColdPath(uuid, source))
+    {
+      // The files of the cold tier are not striped
+      return false;
+    }
+
+    LOG(INFO) << "Relocating file " << uuid << " to volume " << GetPlacementVolume(uuid);
+    return MoveFile(source, target);
+  }
+
+
+  void FileStorage::Synchronize(const std::list<std::string>& uuids)
+  {
+    if (!durable_)
+    {
+      return;
+    }
+
+    std::list<std::string> paths;
+    for (std::list<std::string>::const_iterator
+           it = uuids.begin(); it != uuids.end(); ++it)
+    {
+      paths.push_back(GetPath(*it).string());
+    }
+
+    synchronizer_.Synchronize(paths);
+  }
+
+
+  bool FileStorage::IsInColdTier(const std::string& uuid) const
+  {
+    return HasColdTier() && IsColdPath(uuid, GetPath(uuid));
+  }
+
+
+  static void Touch(const boost::filesystem::path& path)
+  {
+    try
+    {
+      boost::filesystem::last_write_time(path, time(NULL));
+    }
+    catch (...)
+    {
+      // Ignore the error (e.g. the file does not exist anymore)
+    }
+  }
+
+
+  bool FileStorage::MigrateToColdTier(const std::string& uuid,
+                                      uint64_t maxAge)
+  {
+    namespace fs = boost::filesystem;
+
+    if (!HasColdTier())
+    {
+      return false;
+    }
+
+    fs::path source = GetPath(uuid);
+    if (IsColdPath(uuid, source))
+    {
+      return false;
+    }
+
+    bool touch;
+
+    {
+      boost::mutex::scoped_lock lock(pendingMutex_);
+      touch = (pendingTouches_.erase(uuid) > 0);
+    }
+
+    if (touch)
+    {
+      Touch(source);
+    }
+
+    try
+    {
+      time_t age = time(NULL) - fs::last_write_time(source);
+      if (age < 0 ||
+          static_cast<uint64_t>(age) < maxAge)
+      {
+        // This file was recently accessed
+        return false;
+      }
+    }
+    catch (fs::filesystem_error&)
+    {
+      // The file was removed in the meantime
+      return false;
+    }
+
+    LOG(INFO) << "Migrating file " << uuid << " to the cold tier";
+
+    if (MoveFile(source, MakePath(coldTier_, uuid)))
+    {
+      boost::mutex::scoped_lock lock(statisticsMutex_);
+      migrations_++;
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+  void FileStorage::FlushAccessTimes()
+  {
+    std::set<std::string> touches;
+
+    {
+      boost::mutex::scoped_lock lock(pendingMutex_);
+      touches.swap(pendingTouches_);
+    }
+
+    for (std::set<std::string>::const_iterator
+           it = touches.begin(); it != touches.end(); ++it)
+    {
+      boost::filesystem::path path = GetPath(*it);
+      if (!IsColdPath(*it, path))
+      {
+        Touch(path);
+      }
+    }
+  }
+
+
+  unsigned int FileStorage::PromoteColdFiles()
+  {
+    std::set<std::string> promotions;
+
+    {
+      boost::mutex::scoped_lock lock(pendingMutex_);
+      promotions.swap(pendingPromotions_);
+    }
+
+    unsigned int count = 0;
+
+    for (std::set<std::string>::const_iterator
+           it = promotions.begin(); it != promotions.end(); ++it)
+    {
+      try
+      {
+        boost::filesystem::path path = GetPath(*it);
+        if (IsColdPath(*it, path) &&
+            MoveFile(path, GetPlacementPath(*it)))
+        {
+          boost::mutex::scoped_lock lock(statisticsMutex_);
+          promotions_++;
+          count++;
+        }
+      }
+      catch (...)
+      {
+        LOG(ERROR) << "Unable to promote file " << *it << " to the hot tier";
+      }
+    }
+
+    return count;
+  }
+
+
+  void FileStorage::GetTierStatistics(uint64_t& hotReads,
+                                      uint64_t& coldReads,
+                                      uint64_t& migrations,
+                                      uint64_t& promotions) const
+  {
+    boost::mutex::scoped_lock lock(statisticsMutex_);
+    hotReads = hotReads_;
+    coldReads = coldReads_;
+    migrations = migrations_;
+    promotions = promotions_;
+  }
+
+
   uintmax_t FileStorage::GetCapacity() const
   {
-    return boost::filesystem::space(root_).capacity;
+    // This assumes that each volume lies on its own filesystem
+    uintmax_t capacity = 0;
+    for (size_t i = 0; i < volumes_.size(); i++)
+    {
+      capacity += boost::filesystem::space(volumes_[i]).capacity;
+    }
+
+    if (HasColdTier())
+    {
+      capacity += boost::filesystem::space(coldTier_).capacity;
+    }
+
+    return capacity;
   }
 
   uintmax_t FileStorage::GetAvailableSpace() const
   {
-    return boost::filesystem::space(root_).available;
+    uintmax_t available = 0;
+    for (size_t i = 0; i < volumes_.size(); i++)
+    {
+      available += boost::filesystem::space(volumes_[i]).available;
+    }
+
+    if (HasColdTier())
+    {
+      available += boost::filesystem::space(coldTier_).available;
+    }
+
+    return available;
   }
 }
@@ -33,9 +33,12 @@
 #pragma once
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 #include <set>
+#include <vector>
 
 #include "../Compression/BufferCompressor.h"
+#include "GroupSynchronizer.h"
 
 namespace Orthanc
 {
@@ -44,17 +47,112 @@ namespace Orthanc
     // TODO REMOVE THIS
     friend class FilesystemHttpSender;
     friend class FileStorageAccessor;
+    friend class ZlibFileHttpSender;
 
   private:
     std::auto_ptr<BufferCompressor> compressor_;
 
     boost::filesystem::path root_;
+    std::vector<boost::filesystem::path> volumes_;  // The first volume is "root_"
+    boost::filesystem::path coldTier_;  // Empty iff no cold tier
+    bool promoteColdFiles_;
+    bool contentAddressed_;
+    bool durable_;
+    mutable GroupSynchronizer synchronizer_;
+
+    mutable boost::mutex moveMutex_;
+    mutable boost::mutex statisticsMutex_;
+    mutable uint64_t hotReads_;
+    mutable uint64_t coldReads_;
+    uint64_t migrations_;
+    uint64_t promotions_;
+
+    // The reads only record the files whose modification time is to
+    // be refreshed, and the cold files to be promoted: The actual
+    // disk operations are deferred to a background thread
+    mutable boost::mutex pendingMutex_;
+    mutable std::set<std::string> pendingTouches_;
+    mutable std::set<std::string> pendingPromotions_;
+
+    // Cache of the "xx/yy" subdirectories that are known to exist in
+    // each volume, indexed by the first 4 hexadecimal digits of UUIDs
+    std::vector< std::vector<bool> > knownDirectories_;
+    boost::mutex directoriesMutex_;
+
+    size_t GetPlacementVolumeIndex(const std::string& uuid) const;
+
+    const boost::filesystem::path& GetPlacementVolume(const std::string& uuid) const
+    {
+      return volumes_[GetPlacementVolumeIndex(uuid)];
+    }
+
+    boost::filesystem::path GetPlacementPath(const std::string& uuid) const;
 
     boost::filesystem::path GetPath(const std::string& uuid) const;
 
+    boost::filesystem::path GetPathForReading(const std::string& uuid) const;
+
+    // The readers resolve the path of a file before opening it, while
+    // a move (relocation, tiering) can remove the file from this path
+    // in the meantime. If "path" has disappeared, this updates it to
+    // the new location of the file. Returns "false" if the file has
+    // not been moved. The readers retry at most this number of times.
+    static const unsigned int MAX_MOVED_FILE_LOOKUPS = 3;
+
+    bool LookupMovedFile(boost::filesystem::path& path,
+                         const std::string& uuid) const;
+
+    bool IsColdPath(const std::string& uuid,
+                    const boost::filesystem::path& path) const;
+
+    bool MoveFile(const boost::filesystem::path& source,
+                  const boost::filesystem::path& target) const;
+
+    void EnsureDirectory(size_t volume,
+                         const std::string& uuid,
+                         bool force);
+
+    int OpenNewFile(std::string& path,
+                    const std::string& uuid);
+
+    bool CreateNewFile(const std::string& uuid,
+                       const void* content, 
+                       size_t size);
+
+    // Returns "false" if the hash of the content is already used by
+    // a file with another content
+    bool CreateSharedFile(std::string& uuid,
+                          const void* content,
+                          size_t size);
+
     std::string CreateFileWithoutCompression(const void* content, size_t size);
 
   public:
+    /**
+     * Streaming creation of a new file, whose content is received by
+     * chunks. The file is removed if it is not committed. This is not
+     * available in the content-addressed mode.
+     **/
+    class FileWriter : public boost::noncopyable
+    {
+    private:
+      FileStorage& storage_;
+      std::string uuid_;
+      std::string path_;
+      int fd_;
+
+    public:
+      FileWriter(FileStorage& storage);
+
+      ~FileWriter();
+
+      void Write(const void* data,
+                 size_t size);
+
+      // Returns the UUID of the new file
+      std::string Commit();
+    };
+
     FileStorage(std::string root);
 
     void SetBufferCompressor(BufferCompressor* compressor)  // Takes the ownership
@@ -67,15 +165,130 @@ namespace Orthanc
       return compressor_.get() != NULL;
     }
 
+    /**
+     * In the content-addressed mode, the UUID of a new file is
+     * derived from the SHA-1 hash of its content. Creating a file
+     * whose content is already stored gives back the UUID of the
+     * existing file, that is then shared by several attachments.
+     **/
+    void SetContentAddressed(bool enabled)
+    {
+      contentAddressed_ = enabled;
+    }
+
+    bool IsContentAddressed() const
+    {
+      return contentAddressed_;
+    }
+
+    /**
+     * Files can be striped across several volumes (typically one per
+     * disk). The volume of a file is deterministically derived from
+     * its UUID by rendezvous hashing, so that adding a volume only
+     * displaces the files that must migrate to this new volume. Until
+     * "Relocate()" has been applied to them, displaced files are
+     * still found by probing the other volumes. Volumes must never be
+     * removed, as their files would become unreachable.
+     **/
+    void AddVolume(const std::string& path);
+
+    size_t GetVolumeCount() const
+    {
+      return volumes_.size();
+    }
+
+    std::string GetVolumePath(size_t index) const;
+
+    // Moves a file to its placement volume if needed. Returns "true"
+    // iff the file was moved.
+    bool Relocate(const std::string& uuid);
+
+    /**
+     * Optional cold tier (e.g. a large, slow disk). New files are
+     * always written to the hot volumes, and are migrated to the cold
+     * tier once they have not been accessed for some time. If
+     * promotion is enabled, reading a cold file schedules its move
+     * back to the hot volumes (cf. "PromoteColdFiles()").
+     **/
+    void SetColdTier(const std::string& path);
+
+    bool HasColdTier() const
+    {
+      return !coldTier_.empty();
+    }
+
+    void SetColdTierPromotion(bool enabled)
+    {
+      promoteColdFiles_ = enabled;
+    }
+
+    bool IsColdTierPromotion() const
+    {
+      return promoteColdFiles_;
+    }
+
+    bool IsInColdTier(const std::string& uuid) const;
+
+    /**
+     * In the durable mode, the callers must invoke "Synchronize()" on
+     * the newly created files before referring to them (e.g. from
+     * the index). The concurrent calls to "Synchronize()" are grouped
+     * to amortize the cost of flushing the disk.
+     **/
+    void SetDurable(bool durable)
+    {
+      durable_ = durable;
+    }
+
+    bool IsDurable() const
+    {
+      return durable_;
+    }
+
+    void Synchronize(const std::list<std::string>& uuids);
+
+    void GetSynchronizationStatistics(uint64_t& countBatches,
+                                      uint64_t& countFiles) const
+    {
+      synchronizer_.GetStatistics(countBatches, countFiles);
+    }
+
+    // Moves a hot file to the cold tier if it has not been accessed
+    // since "maxAge" seconds. Returns "true" iff the file was moved.
+    bool MigrateToColdTier(const std::string& uuid,
+                           uint64_t maxAge);
+
+    // Refreshes the modification time of the hot files that have
+    // been read since the last call
+    void FlushAccessTimes();
+
+    // Moves the cold files that have been read since the last call
+    // back to the hot volumes, if promotion is enabled. Returns the
+    // number of promoted files.
+    unsigned int PromoteColdFiles();
+
+    void GetTierStatistics(uint64_t& hotReads,
+                           uint64_t& coldReads,
+                           uint64_t& migrations,
+                           uint64_t& promotions) const;
+
     std::string Create(const void* content, size_t size);
 
     std::string Create(const std::vector<uint8_t>& content);
 
     std::string Create(const std::string& content);
 
+    // Same as "Create()", but also computes the MD5 hash of the
+    // content, in the same pass over the data if possible
+    std::string CreateWithMD5(std::string& md5,
+                              const void* content,
+                              size_t size);
+
     void ReadFile(std::string& content,
                   const std::string& uuid) const;
 
+    bool Exists(const std::string& uuid) const;
+
     void ListAllFiles(std::set<std::string>& result) const;
 
     uintmax_t GetCompressedSize(const std::string& uuid) const;
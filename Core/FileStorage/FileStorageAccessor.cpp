@@ -38,13 +38,15 @@ namespace Orthanc
                                               size_t size,
                                               FileContentType type)
   {
-    std::string md5;
-
     if (storeMD5_)
     {
-      Toolbox::ComputeMD5(md5, data, size);
+      std::string md5;
+      std::string uuid = storage_.CreateWithMD5(md5, data, size);
+      return FileInfo(uuid, type, size, md5);
+    }
+    else
+    {
+      return FileInfo(storage_.Create(data, size), type, size, "");
     }
-
-    return FileInfo(storage_.Create(data, size), type, size, md5);
   }
 }
@@ -61,7 +61,7 @@ namespace Orthanc
 
     virtual HttpFileSender* ConstructHttpFileSender(const std::string& uuid)
     {
-      return new FilesystemHttpSender(storage_.GetPath(uuid));
+      return new FilesystemHttpSender(storage_, uuid);
     }
   };
 }
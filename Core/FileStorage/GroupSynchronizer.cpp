@@ -0,0 +1,328 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "GroupSynchronizer.h"
+
+#include "../OrthancException.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Orthanc
+{
+  // Maximum number of concurrent flushes for one batch
+  static const size_t MAX_FLUSH_THREADS = 8;
+
+
+  struct GroupSynchronizer::Batch
+  {
+    std::set<std::string> files_;
+    bool done_;
+    bool success_;
+
+    Batch() : done_(false), success_(false)
+    {
+    }
+  };
+
+
+  struct GroupSynchronizer::PImpl
+  {
+    boost::mutex mutex_;
+    boost::condition_variable batchDone_;
+    bool isSynchronizing_;
+    boost::shared_ptr<Batch> nextBatch_;
+
+    uint64_t countBatches_;
+    uint64_t countFiles_;
+  };
+
+
+  static bool SynchronizeFile(const std::string& path,
+                              bool isDirectory)
+  {
+#if defined(_WIN32)
+    if (isDirectory)
+    {
+      // Directory entries cannot be flushed on Windows
+      return true;
+    }
+
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    bool success = (_commit(fd) == 0);
+    _close(fd);
+    return success;
+
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+#if defined(__APPLE__)
+    bool success = (fsync(fd) == 0);
+#else
+    // The metadata of a directory must be flushed, but not the
+    // metadata of a regular file (its size is flushed anyway)
+    bool success = (isDirectory ? fsync(fd) : fdatasync(fd)) == 0;
+#endif
+
+    close(fd);
+    return success;
+#endif
+  }
+
+
+  void GroupSynchronizer::SynchronizeDirectory(const std::string& path)
+  {
+    if (!SynchronizeFile(path, true))
+    {
+      LOG(ERROR) << "Unable to flush directory " << path;
+      throw OrthancException("Unable to flush a directory of the storage area");
+    }
+  }
+
+
+  namespace
+  {
+    struct FlushedEntry
+    {
+      std::string path_;
+      bool isDirectory_;
+
+      FlushedEntry(const std::string& path,
+                   bool isDirectory) :
+        path_(path),
+        isDirectory_(isDirectory)
+      {
+      }
+    };
+  }
+
+
+  static void FlushEntries(const std::vector<FlushedEntry>* entries,
+                           size_t start,
+                           size_t step,
+                           bool* success)
+  {
+    *success = true;
+
+    try
+    {
+      for (size_t i = start; i < entries->size(); i += step)
+      {
+        const FlushedEntry& entry = (*entries)[i];
+        if (!SynchronizeFile(entry.path_, entry.isDirectory_))
+        {
+          LOG(ERROR) << "Unable to flush " << (entry.isDirectory_ ? "directory " : "file ") << entry.path_;
+          *success = false;
+        }
+      }
+    }
+    catch (...)
+    {
+      *success = false;
+    }
+  }
+
+
+  bool GroupSynchronizer::SynchronizeBatch(const Batch& batch)
+  {
+    // The directories that contain the new files must also be
+    // flushed, otherwise the new directory entries might be lost. As
+    // the storage area creates the "xx/yy" subdirectories on the
+    // fly, the two levels of parent directories are flushed.
+    std::set<std::string> directories;
+    std::vector<FlushedEntry> entries;
+    entries.reserve(batch.files_.size());
+
+    for (std::set<std::string>::const_iterator 
+           it = batch.files_.begin(); it != batch.files_.end(); ++it)
+    {
+      entries.push_back(FlushedEntry(*it, false));
+
+      boost::filesystem::path parent = boost::filesystem::path(*it).parent_path();
+      directories.insert(parent.string());
+      directories.insert(parent.parent_path().string());
+    }
+
+    for (std::set<std::string>::const_iterator 
+           it = directories.begin(); it != directories.end(); ++it)
+    {
+      if (!it->empty())
+      {
+        entries.push_back(FlushedEntry(*it, true));
+      }
+    }
+
+    // The flushes are issued concurrently, as the writers would have
+    // done without grouping: The disk and the journal of the
+    // filesystem can then merge them, instead of waiting for each
+    // flush in turn. The leader thread takes the first share.
+    size_t countThreads = std::min(MAX_FLUSH_THREADS, entries.size());
+    if (countThreads <= 1)
+    {
+      bool success;
+      FlushEntries(&entries, 0, 1, &success);
+      return success;
+    }
+
+    // "std::vector<bool>" cannot be written concurrently
+    boost::scoped_array<bool> success(new bool[countThreads]);
+    boost::thread_group threads;
+
+    try
+    {
+      for (size_t i = 1; i < countThreads; i++)
+      {
+        threads.add_thread(new boost::thread(FlushEntries, &entries, i, countThreads, &success[i]));
+      }
+    }
+    catch (...)
+    {
+      // Not enough resources: The already running flushes refer to
+      // local variables, so they must be waited for
+      threads.join_all();
+      throw;
+    }
+
+    FlushEntries(&entries, 0, countThreads, &success[0]);
+    threads.join_all();
+
+    for (size_t i = 0; i < countThreads; i++)
+    {
+      if (!success[i])
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
+  GroupSynchronizer::GroupSynchronizer() : pimpl_(new PImpl)
+  {
+    pimpl_->isSynchronizing_ = false;
+    pimpl_->nextBatch_.reset(new Batch);
+    pimpl_->countBatches_ = 0;
+    pimpl_->countFiles_ = 0;
+  }
+
+
+  void GroupSynchronizer::Synchronize(const std::list<std::string>& paths)
+  {
+    if (paths.empty())
+    {
+      return;
+    }
+
+    boost::mutex::scoped_lock lock(pimpl_->mutex_);
+
+    // Register the files into the batch that is currently open
+    boost::shared_ptr<Batch> mine = pimpl_->nextBatch_;
+    mine->files_.insert(paths.begin(), paths.end());
+
+    while (!mine->done_)
+    {
+      if (pimpl_->isSynchronizing_)
+      {
+        // Another thread is flushing a previous batch: Wait for it
+        pimpl_->batchDone_.wait(lock);
+      }
+      else
+      {
+        // Become the leader: Close the open batch (that contains the
+        // files of this thread), and flush it
+        pimpl_->isSynchronizing_ = true;
+
+        boost::shared_ptr<Batch> batch = pimpl_->nextBatch_;
+        pimpl_->nextBatch_.reset(new Batch);
+
+        bool success;
+
+        {
+          lock.unlock();
+
+          try
+          {
+            success = SynchronizeBatch(*batch);
+          }
+          catch (...)
+          {
+            success = false;
+          }
+
+          lock.lock();
+        }
+
+        batch->done_ = true;
+        batch->success_ = success;
+        pimpl_->isSynchronizing_ = false;
+        pimpl_->countBatches_++;
+        pimpl_->countFiles_ += batch->files_.size();
+        pimpl_->batchDone_.notify_all();
+      }
+    }
+
+    if (!mine->success_)
+    {
+      throw OrthancException("Unable to flush the new files of the storage area to the disk");
+    }
+  }
+
+
+  void GroupSynchronizer::GetStatistics(uint64_t& countBatches,
+                                        uint64_t& countFiles) const
+  {
+    boost::mutex::scoped_lock lock(pimpl_->mutex_);
+    countBatches = pimpl_->countBatches_;
+    countFiles = pimpl_->countFiles_;
+  }
+}
@@ -0,0 +1,77 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <list>
+#include <set>
+#include <stdint.h>
+#include <string>
+
+namespace Orthanc
+{
+  /**
+   * Group commit of the files that are written to the storage area.
+   * The threads that must make new files durable are batched: While
+   * one thread flushes a batch of files to the disk, the files of the
+   * threads that arrive in the meantime are accumulated into the next
+   * batch, that will be flushed at once. The files of a batch are
+   * still flushed one by one, but concurrently, and the parent
+   * directories that are shared by the files of a batch are only
+   * flushed once.
+   **/
+  class GroupSynchronizer : public boost::noncopyable
+  {
+  private:
+    struct Batch;
+    struct PImpl;
+    boost::shared_ptr<PImpl> pimpl_;
+
+    static bool SynchronizeBatch(const Batch& batch);
+
+  public:
+    GroupSynchronizer();
+
+    // Blocks until the given files (and their parent directories)
+    // are durable. Throws an exception if flushing failed.
+    void Synchronize(const std::list<std::string>& paths);
+
+    void GetStatistics(uint64_t& countBatches,
+                       uint64_t& countFiles) const;
+
+    // Flushes the entries of a directory, e.g. once a subdirectory
+    // has been created inside it
+    static void SynchronizeDirectory(const std::string& path);
+  };
+}
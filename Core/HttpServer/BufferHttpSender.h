@@ -54,6 +54,19 @@ namespace Orthanc
       return true;
     }
 
+    virtual bool SendRange(HttpOutput& output,
+                           uint64_t start,
+                           uint64_t end)
+    {
+      if (end >= buffer_.size() || start > end)
+      {
+        return false;
+      }
+
+      output.Send(&buffer_[static_cast<size_t>(start)], static_cast<size_t>(end - start + 1));
+      return true;
+    }
+
   public:
     std::string& GetBuffer() 
     {
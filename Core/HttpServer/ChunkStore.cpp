@@ -0,0 +1,291 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "ChunkStore.h"
+
+#include "../OrthancException.h"
+
+#include <cassert>
+#include <stdio.h>
+#include <time.h>
+#include <glog/logging.h>
+
+namespace Orthanc
+{
+  // Beyond this number, the oldest discarded filenames are forgotten
+  static const size_t MAX_DISCARDED_FILES = 1000;
+
+
+  class ChunkStore::PendingFile : public boost::noncopyable
+  {
+  private:
+    std::string filename_;
+    std::auto_ptr<Toolbox::TemporaryFile> file_;
+    uint64_t size_;
+    time_t lastAccess_;
+
+  public:
+    PendingFile(const std::string& filename) :
+      filename_(filename),
+      file_(new Toolbox::TemporaryFile),
+      size_(0),
+      lastAccess_(time(NULL))
+    {
+    }
+
+    const std::string& GetFilename() const
+    {
+      return filename_;
+    }
+
+    uint64_t GetSize() const
+    {
+      return size_;
+    }
+
+    time_t GetLastAccess() const
+    {
+      return lastAccess_;
+    }
+
+    void Append(const char* data,
+                size_t size)
+    {
+      FILE* fp = fopen(file_->GetPath().c_str(), "ab");
+      if (!fp)
+      {
+        throw OrthancException(ErrorCode_CannotWriteFile);
+      }
+
+      bool ok = (fwrite(data, 1, size, fp) == size);
+      ok = (fclose(fp) == 0) && ok;
+
+      if (!ok)
+      {
+        throw OrthancException(ErrorCode_CannotWriteFile);
+      }
+
+      size_ += size;
+      lastAccess_ = time(NULL);
+    }
+
+    Toolbox::TemporaryFile* ReleaseFile()
+    {
+      return file_.release();
+    }
+  };
+
+
+  ChunkStore::Content::iterator ChunkStore::Find(const std::string& filename)
+  {
+    for (Content::iterator it = content_.begin();
+         it != content_.end(); ++it)
+    {
+      if ((*it)->GetFilename() == filename)
+      {
+        return it;
+      }
+    }
+
+    return content_.end();
+  }
+
+
+  void ChunkStore::Remove(Content::iterator it)
+  {
+    assert(totalSize_ >= (*it)->GetSize());
+    totalSize_ -= (*it)->GetSize();
+    delete *it;
+    content_.erase(it);
+  }
+
+
+  void ChunkStore::Discard(Content::iterator it)
+  {
+    // The next chunks of this file will be refused
+    if (discardedFiles_.size() >= MAX_DISCARDED_FILES)
+    {
+      discardedFiles_.clear();
+    }
+
+    discardedFiles_.insert((*it)->GetFilename());
+    Remove(it);
+  }
+
+
+  void ChunkStore::DiscardExpired()
+  {
+    if (expiration_ == 0)
+    {
+      return;
+    }
+
+    time_t now = time(NULL);
+
+    while (!content_.empty() &&
+           now - content_.front()->GetLastAccess() > static_cast<time_t>(expiration_))
+    {
+      LOG(WARNING) << "Discarding the expired chunked upload of file " << content_.front()->GetFilename();
+      Discard(content_.begin());
+    }
+  }
+
+
+  ChunkStore::ChunkStore() :
+    maxFiles_(10),
+    maxTotalSize_(static_cast<uint64_t>(2048) * 1024 * 1024),  // 2GB
+    expiration_(3600),  // 1 hour
+    totalSize_(0)
+  {
+  }
+
+
+  ChunkStore::~ChunkStore()
+  {
+    for (Content::iterator it = content_.begin();
+         it != content_.end(); ++it)
+    {
+      delete *it;
+    }
+  }
+
+
+  void ChunkStore::SetMaxFiles(unsigned int count)
+  {
+    if (count == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    maxFiles_ = count;
+  }
+
+
+  void ChunkStore::SetMaxTotalSize(uint64_t size)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    maxTotalSize_ = size;
+  }
+
+
+  void ChunkStore::SetExpiration(unsigned int seconds)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    expiration_ = seconds;
+  }
+
+
+  uint64_t ChunkStore::GetTotalSize()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return totalSize_;
+  }
+
+
+  ChunkStore::Status ChunkStore::Store(std::auto_ptr<Toolbox::TemporaryFile>& completed,
+                                       const char* chunkData,
+                                       size_t chunkSize,
+                                       const std::string& filename,
+                                       uint64_t filesize)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    DiscardExpired();
+
+    std::set<std::string>::iterator wasDiscarded = discardedFiles_.find(filename);
+    if (wasDiscarded != discardedFiles_.end())
+    {
+      discardedFiles_.erase(wasDiscarded);
+      return Status_Failure;
+    }
+
+    if (filesize > maxTotalSize_)
+    {
+      LOG(ERROR) << "The file " << filename << " is too large for a chunked upload";
+      return Status_Failure;
+    }
+
+    Content::iterator it = Find(filename);
+    if (it == content_.end())
+    {
+      // Make some room
+      while (content_.size() >= maxFiles_)
+      {
+        Discard(content_.begin());
+      }
+
+      content_.push_back(new PendingFile(filename));
+    }
+    else
+    {
+      // Mark this file as the most recently used
+      content_.splice(content_.end(), content_, it);
+    }
+
+    PendingFile& f = *content_.back();
+
+    if (f.GetSize() + chunkSize > filesize)
+    {
+      Remove(--content_.end());
+      return Status_Failure;
+    }
+
+    // Discard the least recently used uploads until the new chunk fits
+    // within the budget
+    while (totalSize_ + chunkSize > maxTotalSize_ &&
+           content_.front() != &f)
+    {
+      Discard(content_.begin());
+    }
+
+    try
+    {
+      f.Append(chunkData, chunkSize);
+      totalSize_ += chunkSize;
+    }
+    catch (OrthancException&)
+    {
+      Remove(--content_.end());
+      throw;
+    }
+
+    if (f.GetSize() == filesize)
+    {
+      completed.reset(f.ReleaseFile());
+      Remove(--content_.end());
+      return Status_Completed;
+    }
+
+    return Status_Pending;
+  }
+}
@@ -0,0 +1,112 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../Uuid.h"
+
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+namespace Orthanc
+{
+  /**
+   * Reassembly of the files that are uploaded in several chunks by
+   * the file uploader of Orthanc Explorer. The chunks are appended to
+   * temporary files, so that the pending uploads do not stay in
+   * memory. The pending uploads are bounded in number and in total
+   * size (the least recently used being discarded first), and expire
+   * if no chunk is received for some time.
+   **/
+  class ChunkStore : public boost::noncopyable
+  {
+  public:
+    enum Status
+    {
+      Status_Pending,
+      Status_Completed,
+      Status_Failure
+    };
+
+  private:
+    class PendingFile;
+
+    // The least recently used pending file is at the front
+    typedef std::list<PendingFile*>  Content;
+
+    boost::mutex mutex_;
+    Content  content_;
+    std::set<std::string> discardedFiles_;
+    unsigned int maxFiles_;
+    uint64_t maxTotalSize_;
+    unsigned int expiration_;
+    uint64_t totalSize_;
+
+    Content::iterator Find(const std::string& filename);
+
+    void Remove(Content::iterator it);
+
+    void Discard(Content::iterator it);
+
+    void DiscardExpired();
+
+  public:
+    ChunkStore();
+
+    ~ChunkStore();
+
+    void SetMaxFiles(unsigned int count);
+
+    // Maximum total size of the pending uploads, in bytes
+    void SetMaxTotalSize(uint64_t size);
+
+    // Number of seconds after which a pending upload is discarded if
+    // it does not receive any chunk
+    void SetExpiration(unsigned int seconds);
+
+    uint64_t GetTotalSize();
+
+    // Once the last chunk is received, "completed" receives the
+    // temporary file that contains the whole file, which avoids a
+    // final copy in memory
+    Status Store(std::auto_ptr<Toolbox::TemporaryFile>& completed,
+                 const char* chunkData,
+                 size_t chunkSize,
+                 const std::string& filename,
+                 uint64_t filesize);
+  };
+}
@@ -0,0 +1,170 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "ChunkedHttpOutput.h"
+
+#include "../OrthancException.h"
+
+#include <stdio.h>
+
+namespace Orthanc
+{
+  // The data is sent by chunks of at least this size, except for the
+  // explicit flushes and the last chunk
+  static const size_t CHUNK_SIZE = 64 * 1024;
+
+
+  ChunkedHttpOutput::ChunkedHttpOutput(HttpOutput& target,
+                                       const std::string& contentType,
+                                       const std::string& contentFilename,
+                                       bool isCompressible) :
+    target_(target),
+    chunked_(target.IsChunkedTransferAllowed()),
+    finished_(false),
+    sink_(*this)
+  {
+    HttpCompression encoding = HttpCompression_None;
+
+    // The size of the answer is unknown: Compress it whatever the
+    // compression threshold
+    size_t threshold = target.GetCompressionThreshold();
+    if (isCompressible ?
+        target.IsCompressionApplicable(threshold) :
+        target.IsCompressionApplicable(contentType, threshold))
+    {
+      encoding = target.GetCompression();
+      compressor_.reset(new CompressedHttpOutput(sink_, encoding, target.GetCompressionLevel()));
+    }
+
+    target.SendStreamHeader(contentType.c_str(), contentFilename.c_str(), encoding, chunked_);
+  }
+
+
+  void ChunkedHttpOutput::SendChunk(const void* buffer, size_t length)
+  {
+    if (length == 0)
+    {
+      // An empty chunk would mark the end of the answer
+      return;
+    }
+
+    if (chunked_)
+    {
+      char size[32];
+      sprintf(size, "%lx\r\n", static_cast<unsigned long>(length));
+      target_.SendString(size);
+      target_.Send(buffer, length);
+      target_.SendString("\r\n");
+    }
+    else
+    {
+      target_.Send(buffer, length);
+    }
+  }
+
+
+  void ChunkedHttpOutput::Write(const void* buffer, size_t length)
+  {
+    if (buffer_.empty() &&
+        length >= CHUNK_SIZE)
+    {
+      // Large writes are directly sent, without a copy
+      SendChunk(buffer, length);
+    }
+    else
+    {
+      buffer_.append(reinterpret_cast<const char*>(buffer), length);
+
+      if (buffer_.size() >= CHUNK_SIZE)
+      {
+        Flush();
+      }
+    }
+  }
+
+
+  void ChunkedHttpOutput::SendInternal(const void* buffer, size_t length)
+  {
+    if (finished_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    if (length == 0)
+    {
+      return;
+    }
+
+    if (compressor_.get() != NULL)
+    {
+      compressor_->Send(buffer, length);
+    }
+    else
+    {
+      Write(buffer, length);
+    }
+  }
+
+
+  void ChunkedHttpOutput::Flush()
+  {
+    if (!buffer_.empty())
+    {
+      SendChunk(buffer_.c_str(), buffer_.size());
+      buffer_.clear();
+    }
+  }
+
+
+  void ChunkedHttpOutput::Finish()
+  {
+    if (finished_)
+    {
+      return;
+    }
+
+    if (compressor_.get() != NULL)
+    {
+      compressor_->Finish();
+    }
+
+    Flush();
+
+    if (chunked_)
+    {
+      // Last chunk, with no trailer
+      target_.SendString("0\r\n\r\n");
+    }
+
+    finished_ = true;
+  }
+}
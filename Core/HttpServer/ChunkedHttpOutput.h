@@ -0,0 +1,99 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "CompressedHttpOutput.h"
+
+#include <memory>
+#include <string>
+
+namespace Orthanc
+{
+  /**
+   * Answer whose size is not known in advance: The producer pushes
+   * the data as it is produced, without materializing the whole answer
+   * in memory or in a temporary file. The data is sent to HTTP/1.1
+   * clients with the chunked transfer encoding, and is compressed if
+   * the client accepts it. The header of the answer is sent by the
+   * constructor, and "Finish()" must be called at the end of the data.
+   **/
+  class ChunkedHttpOutput : public HttpOutput
+  {
+  private:
+    // Receives the data to be framed into chunks, possibly after its
+    // compression
+    class Sink : public HttpOutput
+    {
+    private:
+      ChunkedHttpOutput& that_;
+
+    public:
+      Sink(ChunkedHttpOutput& that) : that_(that)
+      {
+      }
+
+      virtual void SendInternal(const void* buffer, size_t length)
+      {
+        that_.Write(buffer, length);
+      }
+    };
+
+    HttpOutput& target_;
+    bool chunked_;
+    bool finished_;
+    std::string buffer_;
+    Sink sink_;
+    std::auto_ptr<CompressedHttpOutput> compressor_;
+
+    void Write(const void* buffer, size_t length);
+
+    void SendChunk(const void* buffer, size_t length);
+
+  protected:
+    virtual void SendInternal(const void* buffer, size_t length);
+
+  public:
+    // If "isCompressible" is true, the data is compressed whatever
+    // its content type
+    ChunkedHttpOutput(HttpOutput& target,
+                      const std::string& contentType,
+                      const std::string& contentFilename,
+                      bool isCompressible = false);
+
+    // Sends the buffered data to the client right now, for instance to
+    // reduce the latency of a slow producer
+    void Flush();
+
+    void Finish();
+  };
+}
@@ -0,0 +1,188 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "CompressedHttpOutput.h"
+
+#include "../OrthancException.h"
+#include "StringHttpOutput.h"
+
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+namespace Orthanc
+{
+  // Size of the chunks that are given to zlib, and that are
+  // produced by zlib
+  static const size_t INPUT_CHUNK = 256 * 1024;
+  static const size_t OUTPUT_CHUNK = 64 * 1024;
+
+
+  struct CompressedHttpOutput::PImpl
+  {
+    z_stream stream_;
+    std::vector<uint8_t> buffer_;
+  };
+
+
+  CompressedHttpOutput::CompressedHttpOutput(HttpOutput& target,
+                                             HttpCompression compression,
+                                             uint8_t level) :
+    target_(target),
+    pimpl_(new PImpl),
+    finished_(false)
+  {
+    if (level >= 10)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    int windowBits;
+    switch (compression)
+    {
+      case HttpCompression_Deflate:
+        // The "deflate" content encoding is the zlib format (RFC 1950)
+        windowBits = MAX_WBITS;
+        break;
+
+      case HttpCompression_Gzip:
+        // Adding 16 to the window size produces a gzip header (RFC 1952)
+        windowBits = MAX_WBITS + 16;
+        break;
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    memset(&pimpl_->stream_, 0, sizeof(pimpl_->stream_));
+
+    switch (deflateInit2(&pimpl_->stream_, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY))
+    {
+      case Z_OK:
+        break;
+
+      case Z_MEM_ERROR:
+        throw OrthancException(ErrorCode_NotEnoughMemory);
+
+      default:
+        throw OrthancException(ErrorCode_InternalError);
+    }
+
+    pimpl_->buffer_.resize(OUTPUT_CHUNK);
+  }
+
+
+  CompressedHttpOutput::~CompressedHttpOutput()
+  {
+    deflateEnd(&pimpl_->stream_);
+  }
+
+
+  void CompressedHttpOutput::Deflate(const void* buffer,
+                                     size_t length,
+                                     bool finish)
+  {
+    z_stream& stream = pimpl_->stream_;
+    std::vector<uint8_t>& output = pimpl_->buffer_;
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(buffer));
+    stream.avail_in = static_cast<uInt>(length);
+
+    int result;
+
+    do
+    {
+      stream.next_out = &output[0];
+      stream.avail_out = static_cast<uInt>(output.size());
+
+      result = deflate(&stream, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (result == Z_STREAM_ERROR)
+      {
+        throw OrthancException(ErrorCode_InternalError);
+      }
+
+      size_t produced = output.size() - stream.avail_out;
+      if (produced > 0)
+      {
+        target_.Send(&output[0], produced);
+      }
+    }
+    while (stream.avail_out == 0 ||
+           (finish && result != Z_STREAM_END));
+  }
+
+
+  void CompressedHttpOutput::SendInternal(const void* buffer, size_t length)
+  {
+    if (finished_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    const uint8_t* current = reinterpret_cast<const uint8_t*>(buffer);
+
+    // zlib counts the input bytes with an "unsigned int"
+    while (length > 0)
+    {
+      size_t chunk = (length < INPUT_CHUNK ? length : INPUT_CHUNK);
+      Deflate(current, chunk, false);
+      current += chunk;
+      length -= chunk;
+    }
+  }
+
+
+  void CompressedHttpOutput::Finish()
+  {
+    if (!finished_)
+    {
+      Deflate(NULL, 0, true);
+      finished_ = true;
+    }
+  }
+
+
+  void CompressedHttpOutput::Compress(std::string& compressed,
+                                      const void* uncompressed,
+                                      size_t uncompressedSize,
+                                      HttpCompression compression,
+                                      uint8_t level)
+  {
+    compressed.clear();
+    compressed.reserve(uncompressedSize / 4);
+
+    StringHttpOutput output(compressed);
+    CompressedHttpOutput compressor(output, compression, level);
+    compressor.Send(uncompressed, uncompressedSize);
+    compressor.Finish();
+  }
+}
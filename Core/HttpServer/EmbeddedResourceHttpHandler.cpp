@@ -62,7 +62,7 @@ namespace Orthanc
     const UriComponents& uri,
     const Arguments& headers,
     const Arguments& arguments,
-    const std::string&)
+    HttpRequestBody&)
   {
     if (method != HttpMethod_Get)
     {
@@ -75,9 +75,21 @@ namespace Orthanc
 
     try
     {
-      const void* buffer = EmbeddedResources::GetDirectoryResourceBuffer(resourceId_, resourcePath.c_str());
-      size_t size = EmbeddedResources::GetDirectoryResourceSize(resourceId_, resourcePath.c_str());
-      output.AnswerBufferWithContentType(buffer, size, contentType);
+      const void* buffer;
+      size_t size;
+
+      if (output.GetCompression() == HttpCompression_Gzip &&
+          EmbeddedResources::LookupGzipDirectoryResource(buffer, size, resourceId_, resourcePath.c_str()))
+      {
+        // Serve the version of the resource that was compressed at build time
+        output.AnswerCompressedBuffer(buffer, size, contentType, HttpCompression_Gzip);
+      }
+      else
+      {
+        buffer = EmbeddedResources::GetDirectoryResourceBuffer(resourceId_, resourcePath.c_str());
+        size = EmbeddedResources::GetDirectoryResourceSize(resourceId_, resourcePath.c_str());
+        output.AnswerBufferWithContentType(buffer, size, contentType);
+      }
     }
     catch (OrthancException&)
     {
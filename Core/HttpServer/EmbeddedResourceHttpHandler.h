@@ -58,6 +58,6 @@ namespace Orthanc
       const UriComponents& uri,
       const Arguments& headers,
       const Arguments& arguments,
-      const std::string&);
+      HttpRequestBody&);
   };
 }
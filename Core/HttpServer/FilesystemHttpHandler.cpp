@@ -131,7 +131,7 @@ namespace Orthanc
     const UriComponents& uri,
     const Arguments& headers,
     const Arguments& arguments,
-    const std::string&)
+    HttpRequestBody&)
   {
     if (method != HttpMethod_Get)
     {
@@ -60,7 +60,7 @@ namespace Orthanc
       const UriComponents& uri,
       const Arguments& headers,
       const Arguments& arguments,
-      const std::string&);
+      HttpRequestBody&);
 
     bool IsListDirectoryContent() const
     {
@@ -31,12 +31,92 @@
 
 #include "FilesystemHttpSender.h"
 
+#include "../OrthancException.h"
 #include "../Toolbox.h"
 
+#include <algorithm>
 #include <stdio.h>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Orthanc
 {
+  static const size_t CHUNK_SIZE = 1024 * 1024;  // Chunks of 1MB
+
+
+#if !defined(_WIN32)
+  static bool SendMappedFile(HttpOutput& output,
+                             const std::string& path)
+  {
+    // Map the file in memory, so that its content is directly pushed
+    // from the page cache to the socket, without being copied into
+    // an intermediate buffer. Returns "false" if the caller must fall
+    // back to regular reads.
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        info.st_size < static_cast<off_t>(CHUNK_SIZE) ||
+        static_cast<uint64_t>(info.st_size) > static_cast<uint64_t>(static_cast<size_t>(-1)))
+    {
+      // Small files are read in one single chunk anyway
+      close(fd);
+      return false;
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void* content = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping remains valid after closing the descriptor
+
+    if (content == MAP_FAILED)
+    {
+      return false;
+    }
+
+    posix_madvise(content, size, POSIX_MADV_SEQUENTIAL);
+
+    try
+    {
+      output.Send(content, size);
+    }
+    catch (...)
+    {
+      munmap(content, size);
+      throw;
+    }
+
+    munmap(content, size);
+    return true;
+  }
+#endif
+
+
+  FILE* FilesystemHttpSender::OpenFile()
+  {
+    for (unsigned int i = 1; ; i++)
+    {
+      FILE* fp = fopen(path_.string().c_str(), "rb");
+      if (fp != NULL ||
+          storage_ == NULL ||
+          i >= FileStorage::MAX_MOVED_FILE_LOOKUPS ||
+          !storage_->LookupMovedFile(path_, uuid_))
+      {
+        return fp;
+      }
+    }
+  }
+
+
   void FilesystemHttpSender::Setup()
   {
     //SetDownloadFilename(path_.filename().string());
@@ -50,18 +130,40 @@ namespace Orthanc
 
   uint64_t FilesystemHttpSender::GetFileSize()
   {
-    return Toolbox::GetFileSize(path_.string());
+    for (unsigned int i = 1; ; i++)
+    {
+      try
+      {
+        return Toolbox::GetFileSize(path_.string());
+      }
+      catch (OrthancException&)
+      {
+        if (storage_ == NULL ||
+            i >= FileStorage::MAX_MOVED_FILE_LOOKUPS ||
+            !storage_->LookupMovedFile(path_, uuid_))
+        {
+          throw;
+        }
+      }
+    }
   }
 
   bool FilesystemHttpSender::SendData(HttpOutput& output)
   {
-    FILE* fp = fopen(path_.string().c_str(), "rb");
+#if !defined(_WIN32)
+    if (SendMappedFile(output, path_.string()))
+    {
+      return true;
+    }
+#endif
+
+    FILE* fp = OpenFile();
     if (!fp)
     {
       return false;
     }
 
-    std::vector<uint8_t> buffer(1024 * 1024);  // Chunks of 1MB
+    std::vector<uint8_t> buffer(CHUNK_SIZE);
 
     for (;;)
     {
@@ -81,22 +183,71 @@ namespace Orthanc
     return true;
   }
 
-  FilesystemHttpSender::FilesystemHttpSender(const char* path)
+  bool FilesystemHttpSender::SendRange(HttpOutput& output,
+                                       uint64_t start,
+                                       uint64_t end)
+  {
+    if (start > end)
+    {
+      return false;
+    }
+
+    FILE* fp = OpenFile();
+    if (!fp)
+    {
+      return false;
+    }
+
+    // Seek to the beginning of the range, taking large files into account
+#if defined(_WIN32)
+    bool ok = (_fseeki64(fp, static_cast<__int64>(start), SEEK_SET) == 0);
+#else
+    bool ok = (fseeko(fp, static_cast<off_t>(start), SEEK_SET) == 0);
+#endif
+
+    std::vector<uint8_t> buffer(CHUNK_SIZE);
+    uint64_t remaining = end - start + 1;
+
+    while (ok && remaining > 0)
+    {
+      size_t n = static_cast<size_t>(std::min(static_cast<uint64_t>(buffer.size()), remaining));
+      size_t nbytes = fread(&buffer[0], 1, n, fp);
+      if (nbytes == 0)
+      {
+        // The file is smaller than expected
+        ok = false;
+      }
+      else
+      {
+        output.Send(&buffer[0], nbytes);
+        remaining -= nbytes;
+      }
+    }
+
+    fclose(fp);
+
+    return ok;
+  }
+
+
+  FilesystemHttpSender::FilesystemHttpSender(const char* path) : storage_(NULL)
   {
     path_ = std::string(path);
     Setup();
   }
 
-  FilesystemHttpSender::FilesystemHttpSender(const boost::filesystem::path& path)
+  FilesystemHttpSender::FilesystemHttpSender(const boost::filesystem::path& path) : storage_(NULL)
   {
     path_ = path;
     Setup();
   }
 
   FilesystemHttpSender::FilesystemHttpSender(const FileStorage& storage,
-                                             const std::string& uuid)
+                                             const std::string& uuid) :
+    storage_(&storage),
+    uuid_(uuid)
   {
-    path_ = storage.GetPath(uuid).string();
+    path_ = storage.GetPathForReading(uuid).string();
     Setup();
   }
 }
@@ -34,6 +34,8 @@
 #include "HttpFileSender.h"
 #include "../FileStorage/FileStorage.h"
 
+#include <stdio.h>
+
 namespace Orthanc
 {
   class FilesystemHttpSender : public HttpFileSender
@@ -41,13 +43,24 @@ namespace Orthanc
   private:
     boost::filesystem::path path_;
 
+    // Set iff the file belongs to a storage area, whose files can be
+    // moved while they are being sent
+    const FileStorage* storage_;
+    std::string uuid_;
+
     void Setup();
 
+    FILE* OpenFile();
+
   protected:
     virtual uint64_t GetFileSize();
 
     virtual bool SendData(HttpOutput& output);
 
+    virtual bool SendRange(HttpOutput& output,
+                           uint64_t start,
+                           uint64_t end);
+
   public:
     FilesystemHttpSender(const char* path);
 
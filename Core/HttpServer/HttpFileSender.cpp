@@ -32,17 +32,130 @@
 
 #include "HttpFileSender.h"
 
+#include "ChunkedHttpOutput.h"
+#include "StringHttpOutput.h"
+
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 
 namespace Orthanc
 {
+  namespace
+  {
+    // Forwards to another output the part of the data sent through it
+    // that lies within some range
+    class RangeHttpOutput : public HttpOutput
+    {
+    private:
+      HttpOutput& target_;
+      uint64_t start_;
+      uint64_t end_;
+      uint64_t position_;
+
+    public:
+      RangeHttpOutput(HttpOutput& target,
+                      uint64_t start,
+                      uint64_t end) :
+        target_(target),
+        start_(start),
+        end_(end),
+        position_(0)
+      {
+      }
+
+      virtual void SendInternal(const void* buffer, size_t length)
+      {
+        uint64_t from = std::max(start_, position_);
+        uint64_t to = std::min(end_ + 1, position_ + length);
+
+        if (from < to)
+        {
+          target_.Send(reinterpret_cast<const uint8_t*>(buffer) + (from - position_),
+                       static_cast<size_t>(to - from));
+        }
+
+        position_ += length;
+      }
+    };
+  }
+
+
+  bool HttpFileSender::SendRange(HttpOutput& output,
+                                 uint64_t start,
+                                 uint64_t end)
+  {
+    RangeHttpOutput range(output, start, end);
+    return SendData(range);
+  }
+
+
+  bool HttpFileSender::ReadPrefix(std::string& target,
+                                  size_t size)
+  {
+    target.clear();
+
+    uint64_t end = std::min(GetFileSize(), static_cast<uint64_t>(size));
+    if (end == 0)
+    {
+      return true;
+    }
+
+    StringHttpOutput output(target);
+    return SendRange(output, 0, end - 1);
+  }
+
+
   void HttpFileSender::SendHeader(HttpOutput& output)
   {
-    output.SendOkHeader(contentType_.c_str(), true, GetFileSize(), downloadFilename_.c_str());
+    output.SendFileHeader(contentType_.c_str(), GetFileSize(), downloadFilename_.c_str());
   }
 
   void HttpFileSender::Send(HttpOutput& output)
   {
+    if (!output.GetRange().empty() &&
+        output.IsRangeAllowed())
+    {
+      uint64_t size = GetFileSize();
+      uint64_t start, end;
+
+      switch (HttpOutput::ParseRange(start, end, output.GetRange(), size))
+      {
+        case HttpOutput::RangeStatus_Satisfiable:
+          // Partial content is never compressed
+          output.SendPartialContentHeader(contentType_.c_str(), start, end, size, downloadFilename_.c_str());
+          if (!SendRange(output, start, end))
+          {
+            output.SendHeader(HttpStatus_500_InternalServerError);
+          }
+          return;
+
+        case HttpOutput::RangeStatus_Unsatisfiable:
+          output.SendRangeNotSatisfiable(size);
+          return;
+
+        default:
+          // Send the whole file
+          break;
+      }
+    }
+
+    uint64_t size = GetFileSize();
+    if (compressible_ ?
+        output.IsCompressionApplicable(size) :
+        output.IsCompressionApplicable(contentType_, size))
+    {
+      // The file is compressed while it is streamed to the client
+      ChunkedHttpOutput stream(output, contentType_, downloadFilename_, true);
+      if (!SendData(stream))
+      {
+        output.SendHeader(HttpStatus_500_InternalServerError);
+        return;
+      }
+
+      stream.Finish();
+      return;
+    }
+
     SendHeader(output);
 
     if (!SendData(output))
@@ -41,6 +41,7 @@ namespace Orthanc
   private:
     std::string contentType_;
     std::string downloadFilename_;
+    bool compressible_;
 
     void SendHeader(HttpOutput& output);
 
@@ -49,7 +50,19 @@ namespace Orthanc
 
     virtual bool SendData(HttpOutput& output) = 0;
 
+    // Sends the bytes from "start" to "end" (inclusive) of the file.
+    // The default implementation skips the data produced by
+    // "SendData()" outside of the range: It should be overridden by
+    // the senders that can seek in their file.
+    virtual bool SendRange(HttpOutput& output,
+                           uint64_t start,
+                           uint64_t end);
+
   public:
+    HttpFileSender() : compressible_(false)
+    {
+    }
+
     virtual ~HttpFileSender()
     {
     }
@@ -84,6 +97,24 @@ namespace Orthanc
       return downloadFilename_;
     }
 
+    // By default, the HTTP compression of the file depends on its
+    // content type. A compressible file is compressed whatever its
+    // content type.
+    void SetCompressible(bool compressible)
+    {
+      compressible_ = compressible;
+    }
+
+    bool IsCompressible() const
+    {
+      return compressible_;
+    }
+
+    // Reads the first bytes of the file (at most "size"), e.g. to
+    // inspect its format before sending it
+    bool ReadPrefix(std::string& target,
+                    size_t size);
+
     void Send(HttpOutput& output);
   };
 }
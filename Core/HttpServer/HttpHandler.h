@@ -36,6 +36,7 @@
 #include <vector>
 #include <stdint.h>
 #include "../Toolbox.h"
+#include "HttpRequestBody.h"
 
 namespace Orthanc
 {
@@ -57,7 +58,7 @@ namespace Orthanc
                         const UriComponents& uri,
                         const Arguments& headers,
                         const Arguments& getArguments,
-                        const std::string& postData) = 0;
+                        HttpRequestBody& body) = 0;
 
     static void ParseGetQuery(HttpHandler::Arguments& result, 
                               const char* query);
@@ -38,9 +38,215 @@
 #include <boost/lexical_cast.hpp>
 #include "../OrthancException.h"
 #include "../Toolbox.h"
+#include "CompressedHttpOutput.h"
 
 namespace Orthanc
 {
+  static const char* GetContentEncoding(HttpCompression compression)
+  {
+    switch (compression)
+    {
+      case HttpCompression_Deflate:
+        return "deflate";
+
+      case HttpCompression_Gzip:
+        return "gzip";
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  static bool IsCompressibleContentType(const std::string& contentType)
+  {
+    // Ignore the parameters of the MIME type (e.g. "; charset=utf-8")
+    std::string mime = Toolbox::StripSpaces(contentType.substr(0, contentType.find(';')));
+    Toolbox::ToLowerCase(mime);
+
+    // "application/dicom" is not listed, as the pixel data is often
+    // already compressed (JPEG, JPEG-LS, JPEG2000...): The senders of
+    // the DICOM files whose pixel data is not compressed explicitly
+    // mark them as compressible (cf. "HttpFileSender::SetCompressible()")
+    return (mime.compare(0, 5, "text/") == 0 ||
+            mime == "application/json" ||
+            mime == "application/javascript" ||
+            mime == "application/xml" ||
+            mime == "image/svg+xml");
+  }
+
+
+  HttpOutput::HttpOutput() :
+    compression_(HttpCompression_None),
+    compressionLevel_(6),
+    compressionThreshold_(1024),
+    chunkedAllowed_(false),
+    headerSent_(false),
+    status_(HttpStatus_200_Ok),
+    sentBytes_(0),
+    closeConnection_(false)
+  {
+  }
+
+
+  void HttpOutput::Send(const void* buffer, size_t length)
+  {
+    SendInternal(buffer, length);
+    sentBytes_ += length;
+  }
+
+
+  HttpOutput::~HttpOutput()
+  {
+    try
+    {
+      SignalAnswerCompleted();
+    }
+    catch (...)
+    {
+      // Never throw from a destructor
+    }
+  }
+
+
+  void HttpOutput::SetAnswerObserver(IAnswerObserver* observer)
+  {
+    std::auto_ptr<IAnswerObserver> protection(observer);
+
+    if (observer_.get() != NULL)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    observer_ = protection;
+  }
+
+
+  void HttpOutput::SignalAnswerCompleted()
+  {
+    // The observer is released first, so that it is notified once
+    std::auto_ptr<IAnswerObserver> observer(observer_);
+
+    if (observer.get() != NULL)
+    {
+      observer->SignalAnswerCompleted(*this);
+    }
+  }
+
+
+  void HttpOutput::SignalHeaderSent(HttpStatus status)
+  {
+    headerSent_ = true;
+    status_ = status;
+  }
+
+
+  void HttpOutput::SetCompressionLevel(uint8_t level)
+  {
+    if (level >= 10)
+    {
+      throw OrthancException("The compression level must be between 0 (no compression) and 9 (highest compression)");
+    }
+
+    compressionLevel_ = level;
+  }
+
+
+  bool HttpOutput::IsCompressionApplicable(uint64_t size) const
+  {
+    return (compression_ != HttpCompression_None &&
+            compressionLevel_ > 0 &&
+            size >= compressionThreshold_);
+  }
+
+
+  bool HttpOutput::IsCompressionApplicable(const std::string& contentType,
+                                           uint64_t size) const
+  {
+    return (IsCompressionApplicable(size) &&
+            IsCompressibleContentType(contentType));
+  }
+
+
+  HttpCompression HttpOutput::NegotiateCompression(const std::string& acceptEncoding)
+  {
+    // Quality values of the content encodings, "-1" meaning that the
+    // encoding is not listed by the client
+    float gzip = -1;
+    float deflate = -1;
+    float any = -1;
+
+    std::vector<std::string> codings;
+    Toolbox::TokenizeString(codings, acceptEncoding, ',');
+
+    for (size_t i = 0; i < codings.size(); i++)
+    {
+      std::vector<std::string> tokens;
+      Toolbox::TokenizeString(tokens, codings[i], ';');
+
+      std::string name = Toolbox::StripSpaces(tokens[0]);
+      Toolbox::ToLowerCase(name);
+
+      float quality = 1;
+      for (size_t j = 1; j < tokens.size(); j++)
+      {
+        std::string parameter = Toolbox::StripSpaces(tokens[j]);
+        if (parameter.size() > 2 &&
+            (parameter[0] == 'q' || parameter[0] == 'Q') &&
+            parameter[1] == '=')
+        {
+          try
+          {
+            quality = boost::lexical_cast<float>(Toolbox::StripSpaces(parameter.substr(2)));
+          }
+          catch (boost::bad_lexical_cast&)
+          {
+            quality = 0;
+          }
+        }
+      }
+
+      if (name == "gzip" || name == "x-gzip")
+      {
+        gzip = quality;
+      }
+      else if (name == "deflate")
+      {
+        deflate = quality;
+      }
+      else if (name == "*")
+      {
+        any = quality;
+      }
+    }
+
+    if (gzip < 0)
+    {
+      gzip = any;
+    }
+
+    if (deflate < 0)
+    {
+      deflate = any;
+    }
+
+    // gzip is preferred, as some clients wrongly expect raw deflate
+    // data instead of the zlib format
+    if (gzip > 0 && gzip >= deflate)
+    {
+      return HttpCompression_Gzip;
+    }
+    else if (deflate > 0)
+    {
+      return HttpCompression_Deflate;
+    }
+    else
+    {
+      return HttpCompression_None;
+    }
+  }
+
+
   void HttpOutput::SendString(const std::string& s)
   {
     if (s.size() > 0)
@@ -72,6 +278,40 @@ namespace Orthanc
       std::string attachment = "attachment; filename=\"" + std::string(contentFilename) + "\"";
       header.push_back(std::make_pair("Content-Disposition", attachment));
     }
+
+    PrepareCacheHeader(header);
+  }
+
+  void HttpOutput::PrepareCacheHeader(Header& header)
+  {
+    if (!etag_.empty())
+    {
+      header.push_back(std::make_pair("ETag", "\"" + etag_ + "\""));
+    }
+
+    if (!cacheControl_.empty())
+    {
+      header.push_back(std::make_pair("Cache-Control", cacheControl_));
+    }
+  }
+
+  void HttpOutput::PrepareContentEncoding(Header& header,
+                                          HttpCompression encoding)
+  {
+    std::string name = GetContentEncoding(encoding);
+
+    header.push_back(std::make_pair("Content-Encoding", name));
+    header.push_back(std::make_pair("Vary", std::string("Accept-Encoding")));
+
+    // Each content encoding is a different representation of the
+    // resource, which must have its own strong entity tag
+    for (Header::iterator it = header.begin(); it != header.end(); ++it)
+    {
+      if (it->first == "ETag")
+      {
+        it->second = "\"" + etag_ + "-" + name + "\"";
+      }
+    }
   }
 
   void HttpOutput::SendOkHeader(const char* contentType,
@@ -84,9 +324,32 @@ namespace Orthanc
     SendOkHeader(header);
   }
 
+  void HttpOutput::SendFileHeader(const char* contentType,
+                                  uint64_t contentLength,
+                                  const char* contentFilename)
+  {
+    Header header;
+    PrepareOkHeader(header, contentType, true, contentLength, contentFilename);
+
+    if (IsRangeAllowed())
+    {
+      header.push_back(std::make_pair("Accept-Ranges", std::string("bytes")));
+    }
+
+    SendOkHeader(header);
+  }
+
   void HttpOutput::SendOkHeader(const Header& header)
   {
-    std::string s = "HTTP/1.1 200 OK\r\n";
+    SendHeader(HttpStatus_200_Ok, header);
+  }
+
+  void HttpOutput::SendHeader(HttpStatus status,
+                              const Header& header)
+  {
+    std::string s = "HTTP/1.1 " + 
+      boost::lexical_cast<std::string>(status) +
+      " " + std::string(EnumerationToString(status)) + "\r\n";
 
     for (Header::const_iterator 
            it = header.begin(); it != header.end(); ++it)
@@ -96,16 +359,228 @@ namespace Orthanc
 
     s += "\r\n";
 
+    SignalHeaderSent(status);
     Send(&s[0], s.size());
   }
 
 
+  HttpOutput::RangeStatus HttpOutput::ParseRange(uint64_t& start,
+                                                 uint64_t& end,
+                                                 const std::string& range,
+                                                 uint64_t size)
+  {
+    std::string s = Toolbox::StripSpaces(range);
+    if (s.compare(0, 6, "bytes=") != 0 ||
+        s.find(',') != std::string::npos)
+    {
+      // Not a byte range, or several ranges
+      return RangeStatus_None;
+    }
+
+    s = s.substr(6);
+    size_t dash = s.find('-');
+    if (dash == std::string::npos)
+    {
+      return RangeStatus_None;
+    }
+
+    std::string first = Toolbox::StripSpaces(s.substr(0, dash));
+    std::string last = Toolbox::StripSpaces(s.substr(dash + 1));
+
+    try
+    {
+      if (first.empty())
+      {
+        // Suffix range ("bytes=-500" for the last 500 bytes)
+        if (last.empty())
+        {
+          return RangeStatus_None;
+        }
+
+        uint64_t suffix = boost::lexical_cast<uint64_t>(last);
+        if (suffix == 0 || size == 0)
+        {
+          return RangeStatus_Unsatisfiable;
+        }
+
+        start = (suffix >= size ? 0 : size - suffix);
+        end = size - 1;
+        return RangeStatus_Satisfiable;
+      }
+
+      start = boost::lexical_cast<uint64_t>(first);
+      end = (last.empty() ? size - 1 : boost::lexical_cast<uint64_t>(last));
+    }
+    catch (boost::bad_lexical_cast&)
+    {
+      // Ill-formed ranges are ignored
+      return RangeStatus_None;
+    }
+
+    if (!last.empty() && end < start)
+    {
+      return RangeStatus_None;
+    }
+
+    if (start >= size)
+    {
+      return RangeStatus_Unsatisfiable;
+    }
+
+    if (end >= size)
+    {
+      end = size - 1;
+    }
+
+    return RangeStatus_Satisfiable;
+  }
+
+
+  static bool MatchEntityTag(const std::string& candidates,
+                             const std::string& etag,
+                             bool weak)
+  {
+    std::vector<std::string> tokens;
+    Toolbox::TokenizeString(tokens, candidates, ',');
+
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+      std::string candidate = Toolbox::StripSpaces(tokens[i]);
+
+      if (candidate == "*")
+      {
+        return true;
+      }
+
+      if (candidate.compare(0, 2, "W/") == 0)
+      {
+        if (!weak)
+        {
+          // Weak entity tags are not allowed in "If-Range"
+          continue;
+        }
+
+        candidate = candidate.substr(2);
+      }
+
+      if (candidate.size() >= 2 &&
+          candidate[0] == '"' &&
+          candidate[candidate.size() - 1] == '"')
+      {
+        candidate = candidate.substr(1, candidate.size() - 2);
+      }
+
+      if (candidate == etag)
+      {
+        return true;
+      }
+
+      // The compressed representations only match in "If-None-Match",
+      // as the ranges are always sent without compression
+      if (weak &&
+          (candidate == etag + "-gzip" ||
+           candidate == etag + "-deflate"))
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  bool HttpOutput::IsNotModified() const
+  {
+    return (!etag_.empty() &&
+            !ifNoneMatch_.empty() &&
+            MatchEntityTag(ifNoneMatch_, etag_, true));
+  }
+
+
+  bool HttpOutput::IsRangeAllowed() const
+  {
+    // Only the entity tags are supported in "If-Range", not the dates
+    return (ifRange_.empty() ||
+            (!etag_.empty() && MatchEntityTag(ifRange_, etag_, false)));
+  }
+
+
+  void HttpOutput::SendNotModified()
+  {
+    Header header;
+    PrepareCacheHeader(header);
+    SendHeader(HttpStatus_304_NotModified, header);
+  }
+
+
+  void HttpOutput::SendPartialContentHeader(const char* contentType,
+                                            uint64_t start,
+                                            uint64_t end,
+                                            uint64_t size,
+                                            const char* contentFilename)
+  {
+    if (start > end || end >= size)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    Header header;
+    PrepareOkHeader(header, contentType, true, end - start + 1, contentFilename);
+    header.push_back(std::make_pair("Content-Range", "bytes " + 
+                                    boost::lexical_cast<std::string>(start) + "-" +
+                                    boost::lexical_cast<std::string>(end) + "/" +
+                                    boost::lexical_cast<std::string>(size)));
+    header.push_back(std::make_pair("Accept-Ranges", std::string("bytes")));
+    SendHeader(HttpStatus_206_PartialContent, header);
+  }
+
+
+  void HttpOutput::SendRangeNotSatisfiable(uint64_t size)
+  {
+    Header header;
+    header.push_back(std::make_pair("Content-Range", "bytes */" + boost::lexical_cast<std::string>(size)));
+    header.push_back(std::make_pair("Content-Length", std::string("0")));
+    SendHeader(HttpStatus_416_RequestedRangeNotSatisfiable, header);
+  }
+
+
+  void HttpOutput::SendStreamHeader(const char* contentType,
+                                    const char* contentFilename,
+                                    HttpCompression encoding,
+                                    bool chunked)
+  {
+    Header header;
+    PrepareOkHeader(header, contentType, false, 0, contentFilename);
+
+    if (encoding != HttpCompression_None)
+    {
+      PrepareContentEncoding(header, encoding);
+    }
+
+    if (chunked)
+    {
+      header.push_back(std::make_pair("Transfer-Encoding", std::string("chunked")));
+    }
+    else
+    {
+      // The end of the body is signaled by the closing of the
+      // connection, which must thus not be kept alive
+      header.push_back(std::make_pair("Connection", std::string("close")));
+      closeConnection_ = true;
+    }
+
+    SendOkHeader(header);
+  }
+
+
   void HttpOutput::SendMethodNotAllowedError(const std::string& allowed)
   {
     std::string s = 
       "HTTP/1.1 405 " + std::string(EnumerationToString(HttpStatus_405_MethodNotAllowed)) +
       "\r\nAllow: " + allowed + 
+      "\r\nContent-Length: 0"
       "\r\n\r\n";
+    SignalHeaderSent(HttpStatus_405_MethodNotAllowed);
     Send(&s[0], s.size());
   }
 
@@ -124,22 +599,18 @@ namespace Orthanc
 
   void HttpOutput::SendHeaderInternal(HttpStatus status)
   {
+    // The length of the empty body is explicit, so that the
+    // connection can be kept alive
     std::string s = "HTTP/1.1 " + 
       boost::lexical_cast<std::string>(status) +
       " " + std::string(EnumerationToString(status)) +
+      "\r\nContent-Length: 0"
       "\r\n\r\n";
+    SignalHeaderSent(status);
     Send(&s[0], s.size());
   }
 
 
-  void HttpOutput::AnswerBufferWithContentType(const std::string& buffer,
-                                               const std::string& contentType)
-  {
-    SendOkHeader(contentType.c_str(), true, buffer.size(), NULL);
-    SendString(buffer);
-  }
-
-
   void HttpOutput::PrepareCookies(Header& header,
                                   const HttpHandler::Arguments& cookies)
   {
@@ -151,15 +622,68 @@ namespace Orthanc
   }
 
 
+  void HttpOutput::AnswerBufferInternal(HttpStatus status,
+                                        const void* buffer,
+                                        size_t size,
+                                        const std::string& contentType,
+                                        const HttpHandler::Arguments* cookies)
+  {
+    std::string compressed;
+    bool isCompressed = false;
+
+    if (IsCompressionApplicable(contentType, size))
+    {
+      CompressedHttpOutput::Compress(compressed, buffer, size, compression_, compressionLevel_);
+
+      // Data that is already compressed (e.g. JPEG-encoded DICOM)
+      // might grow through the compression
+      isCompressed = (compressed.size() < size);
+    }
+
+    Header header;
+    PrepareOkHeader(header, contentType.c_str(), true, 
+                    isCompressed ? compressed.size() : size, NULL);
+
+    if (isCompressed)
+    {
+      PrepareContentEncoding(header, compression_);
+    }
+    else if (compression_ != HttpCompression_None &&
+             IsCompressibleContentType(contentType))
+    {
+      header.push_back(std::make_pair("Vary", std::string("Accept-Encoding")));
+    }
+
+    if (cookies != NULL)
+    {
+      PrepareCookies(header, *cookies);
+    }
+
+    SendHeader(status, header);
+
+    if (isCompressed)
+    {
+      SendString(compressed);
+    }
+    else
+    {
+      Send(buffer, size);
+    }
+  }
+
+
+  void HttpOutput::AnswerBufferWithContentType(const std::string& buffer,
+                                               const std::string& contentType)
+  {
+    AnswerBufferInternal(HttpStatus_200_Ok, buffer.c_str(), buffer.size(), contentType, NULL);
+  }
+
+
   void HttpOutput::AnswerBufferWithContentType(const std::string& buffer,
                                                const std::string& contentType,
                                                const HttpHandler::Arguments& cookies)
   {
-    Header header;
-    PrepareOkHeader(header, contentType.c_str(), true, buffer.size(), NULL);
-    PrepareCookies(header, cookies);
-    SendOkHeader(header);
-    SendString(buffer);
+    AnswerBufferInternal(HttpStatus_200_Ok, buffer.c_str(), buffer.size(), contentType, &cookies);
   }
 
 
@@ -167,8 +691,7 @@ namespace Orthanc
                                                size_t size,
                                                const std::string& contentType)
   {
-    SendOkHeader(contentType.c_str(), true, size, NULL);
-    Send(buffer, size);
+    AnswerBufferInternal(HttpStatus_200_Ok, buffer, size, contentType, NULL);
   }
 
 
@@ -176,22 +699,47 @@ namespace Orthanc
                                                size_t size,
                                                const std::string& contentType,
                                                const HttpHandler::Arguments& cookies)
+  {
+    AnswerBufferInternal(HttpStatus_200_Ok, buffer, size, contentType, &cookies);
+  }
+
+
+  void HttpOutput::AnswerCompressedBuffer(const void* buffer,
+                                          size_t size,
+                                          const std::string& contentType,
+                                          HttpCompression compression)
   {
     Header header;
     PrepareOkHeader(header, contentType.c_str(), true, size, NULL);
-    PrepareCookies(header, cookies);
+    PrepareContentEncoding(header, compression);
     SendOkHeader(header);
     Send(buffer, size);
   }
 
 
+  void HttpOutput::AnswerBufferWithStatus(HttpStatus status,
+                                          const std::string& buffer,
+                                          const std::string& contentType,
+                                          const HttpHandler::Arguments& cookies)
+  {
+    if (status < 200 || status >= 300)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    AnswerBufferInternal(status, buffer.c_str(), buffer.size(), contentType, &cookies);
+  }
+
+
 
   void HttpOutput::Redirect(const std::string& path)
   {
     std::string s = 
       "HTTP/1.1 301 " + std::string(EnumerationToString(HttpStatus_301_MovedPermanently)) + 
       "\r\nLocation: " + path +
+      "\r\nContent-Length: 0"
       "\r\n\r\n";
+    SignalHeaderSent(HttpStatus_301_MovedPermanently);
     Send(&s[0], s.size());  
   }
 }
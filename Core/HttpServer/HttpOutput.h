@@ -33,45 +33,280 @@
 #pragma once
 
 #include <list>
+#include <memory>
 #include <string>
 #include <stdint.h>
+#include <boost/noncopyable.hpp>
 #include "../Enumerations.h"
 #include "HttpHandler.h"
 
 namespace Orthanc
 {
-  class HttpOutput
+  class HttpOutput : public boost::noncopyable
   {
+  public:
+    /**
+     * Notified once the answer is complete, including the error that
+     * the HTTP server sends if the handler fails. This gives access to
+     * the actual status of the answer.
+     **/
+    class IAnswerObserver : public boost::noncopyable
+    {
+    public:
+      virtual ~IAnswerObserver()
+      {
+      }
+
+      virtual void SignalAnswerCompleted(const HttpOutput& output) = 0;
+    };
+
+    enum RangeStatus
+    {
+      RangeStatus_None,           // No range, or a range that is ignored
+      RangeStatus_Satisfiable,
+      RangeStatus_Unsatisfiable
+    };
+
   private:
     typedef std::list< std::pair<std::string, std::string> >  Header;
 
+    HttpCompression compression_;
+    uint8_t compressionLevel_;
+    size_t compressionThreshold_;
+    bool chunkedAllowed_;
+    std::string range_;
+    std::string ifRange_;
+    std::string ifNoneMatch_;
+    std::string etag_;
+    std::string cacheControl_;
+    bool headerSent_;
+    HttpStatus status_;
+    uint64_t sentBytes_;
+    bool closeConnection_;
+    std::auto_ptr<IAnswerObserver> observer_;
+
     void SendHeaderInternal(HttpStatus status);
 
+    void SignalHeaderSent(HttpStatus status);
+
     void PrepareOkHeader(Header& header,
                          const char* contentType,
                          bool hasContentLength,
                          uint64_t contentLength,
                          const char* contentFilename);
 
+    void PrepareCacheHeader(Header& header);
+
+    void PrepareContentEncoding(Header& header,
+                                HttpCompression encoding);
+
     void SendOkHeader(const Header& header);
 
+    void SendHeader(HttpStatus status,
+                    const Header& header);
+
     void PrepareCookies(Header& header,
                         const HttpHandler::Arguments& cookies);
 
+    void AnswerBufferInternal(HttpStatus status,
+                              const void* buffer,
+                              size_t size,
+                              const std::string& contentType,
+                              const HttpHandler::Arguments* cookies);
+
+  protected:
+    // Writes raw bytes to the client (or to the decorated output)
+    virtual void SendInternal(const void* buffer, size_t length) = 0;
+
   public:
-    virtual ~HttpOutput()
+    HttpOutput();
+
+    virtual ~HttpOutput();
+
+    // Content encoding that was negotiated with the client. By
+    // default, the answers are not compressed.
+    void SetCompression(HttpCompression compression)
     {
+      compression_ = compression;
     }
 
-    virtual void Send(const void* buffer, size_t length) = 0;
+    HttpCompression GetCompression() const
+    {
+      return compression_;
+    }
+
+    void SetCompressionLevel(uint8_t level);
+
+    uint8_t GetCompressionLevel() const
+    {
+      return compressionLevel_;
+    }
+
+    // The answers that are smaller than this size are never compressed
+    void SetCompressionThreshold(size_t threshold)
+    {
+      compressionThreshold_ = threshold;
+    }
+
+    size_t GetCompressionThreshold() const
+    {
+      return compressionThreshold_;
+    }
+
+    bool IsCompressionApplicable(const std::string& contentType,
+                                 uint64_t size) const;
+
+    // Same as above, for an answer that is known to be compressible
+    // whatever its content type
+    bool IsCompressionApplicable(uint64_t size) const;
+
+    // Parses the value of the "Accept-Encoding" header
+    static HttpCompression NegotiateCompression(const std::string& acceptEncoding);
+
+    // Whether the client supports the chunked transfer encoding
+    // (i.e. HTTP/1.1)
+    void SetChunkedTransferAllowed(bool allowed)
+    {
+      chunkedAllowed_ = allowed;
+    }
+
+    bool IsChunkedTransferAllowed() const
+    {
+      return chunkedAllowed_;
+    }
+
+    // Value of the "Range" header of the request, if any
+    void SetRange(const std::string& range)
+    {
+      range_ = range;
+    }
+
+    const std::string& GetRange() const
+    {
+      return range_;
+    }
+
+    // Value of the "If-Range" header of the request, if any
+    void SetIfRange(const std::string& value)
+    {
+      ifRange_ = value;
+    }
+
+    // Whether the range must be applied, given the "If-Range" header
+    // and the entity tag of the answer
+    bool IsRangeAllowed() const;
+
+    // Value of the "If-None-Match" header of the request, if any
+    void SetIfNoneMatch(const std::string& value)
+    {
+      ifNoneMatch_ = value;
+    }
+
+    // Strong entity tag of the answer (without the quotes), which is
+    // sent in the "ETag" header
+    void SetETag(const std::string& etag)
+    {
+      etag_ = etag;
+    }
+
+    const std::string& GetETag() const
+    {
+      return etag_;
+    }
+
+    // Value of the "Cache-Control" header of the answer
+    void SetCacheControl(const std::string& value)
+    {
+      cacheControl_ = value;
+    }
+
+    // Whether the client already has the version of the resource that
+    // is identified by the entity tag ("If-None-Match")
+    bool IsNotModified() const;
+
+    void SendNotModified();
+
+    // Parses the value of a "Range" header, for a resource of the
+    // given size. Only single byte ranges are supported: The other
+    // requests are answered with the whole resource. On success,
+    // "start" and "end" are the inclusive bounds of the range.
+    static RangeStatus ParseRange(uint64_t& start,
+                                  uint64_t& end,
+                                  const std::string& range,
+                                  uint64_t size);
+
+    void Send(const void* buffer, size_t length);
+
+    // Number of bytes sent so far, including the header
+    uint64_t GetSentBytes() const
+    {
+      return sentBytes_;
+    }
+
+    bool IsHeaderSent() const
+    {
+      return headerSent_;
+    }
+
+    // Status of the answer, once its header has been sent
+    HttpStatus GetStatus() const
+    {
+      return status_;
+    }
+
+    // Once the header is sent, an error can only be reported to the
+    // client by closing the connection before the end of the answer
+    void Abort()
+    {
+      closeConnection_ = true;
+    }
+
+    // Takes the ownership of the observer
+    void SetAnswerObserver(IAnswerObserver* observer);
+
+    // Called by the HTTP server once it has sent the answer. If not
+    // called explicitly, the observer is notified by the destructor.
+    void SignalAnswerCompleted();
+
+    // Whether the connection must not be kept alive after this answer
+    // (because it was aborted, or because its body is delimited by
+    // the closing of the connection)
+    bool IsCloseConnectionRequired() const
+    {
+      return closeConnection_;
+    }
 
     void SendOkHeader(const char* contentType,
                       bool hasContentLength,
                       uint64_t contentLength,
                       const char* contentFilename);
 
+    // Header of the "200 OK" answer of a file that can be downloaded
+    // by ranges, which lets the clients know they can resume it
+    void SendFileHeader(const char* contentType,
+                        uint64_t contentLength,
+                        const char* contentFilename);
+
     void SendString(const std::string& s);
 
+    // Header of an answer whose size is not known in advance (cf.
+    // "ChunkedHttpOutput"). The body is either sent with the chunked
+    // transfer encoding, or delimited by the closing of the connection.
+    void SendStreamHeader(const char* contentType,
+                          const char* contentFilename,
+                          HttpCompression encoding,
+                          bool chunked);
+
+    // Header of a "206 Partial Content" answer, for the bytes from
+    // "start" to "end" (inclusive) of a resource of size "size"
+    void SendPartialContentHeader(const char* contentType,
+                                  uint64_t start,
+                                  uint64_t end,
+                                  uint64_t size,
+                                  const char* contentFilename);
+
+    void SendRangeNotSatisfiable(uint64_t size);
+
     void SendMethodNotAllowedError(const std::string& allowed);
 
     void SendHeader(HttpStatus status);
@@ -95,5 +330,20 @@ namespace Orthanc
                                      size_t size,
                                      const std::string& contentType,
                                      const HttpHandler::Arguments& cookies);
+
+    // Answers with a buffer that is already compressed with the given
+    // content encoding (for instance, resources that are compressed
+    // at build time)
+    void AnswerCompressedBuffer(const void* buffer,
+                                size_t size,
+                                const std::string& contentType,
+                                HttpCompression compression);
+
+    // For the successful answers whose status is not "200 OK" (for
+    // instance, "202 Accepted")
+    void AnswerBufferWithStatus(HttpStatus status,
+                                const std::string& buffer,
+                                const std::string& contentType,
+                                const HttpHandler::Arguments& cookies);
   };
 }
@@ -0,0 +1,335 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "HttpRequestBody.h"
+
+#include "../OrthancException.h"
+#include "../Toolbox.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Orthanc
+{
+  static const size_t CHUNK_SIZE = 64 * 1024;
+
+
+  void HttpRequestBody::ReadFromConnection(void* buffer,
+                                           size_t size)
+  {
+    uint8_t* p = reinterpret_cast<uint8_t*>(buffer);
+
+    while (size > 0)
+    {
+      size_t r = reader_->Read(p, size);
+      if (r == 0)
+      {
+        // The connection was closed before the end of the body
+        throw OrthancException(ErrorCode_NetworkProtocol);
+      }
+
+      assert(r <= size);
+      p += r;
+      size -= r;
+      consumed_ += r;
+    }
+  }
+
+
+  void HttpRequestBody::Buffer()
+  {
+    if (isBuffered_)
+    {
+      return;
+    }
+
+    if (consumed_ != 0)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    if (size_ <= spillThreshold_)
+    {
+      content_.resize(static_cast<size_t>(size_));
+      if (size_ > 0)
+      {
+        ReadFromConnection(&content_[0], content_.size());
+      }
+    }
+    else
+    {
+      std::auto_ptr<Toolbox::TemporaryFile> spill(new Toolbox::TemporaryFile);
+
+      FILE* fp = fopen(spill->GetPath().c_str(), "wb");
+      if (!fp)
+      {
+        throw OrthancException(ErrorCode_CannotWriteFile);
+      }
+
+      try
+      {
+        std::vector<uint8_t> buffer(CHUNK_SIZE);
+
+        while (consumed_ < size_)
+        {
+          size_t n = static_cast<size_t>(std::min(static_cast<uint64_t>(CHUNK_SIZE), size_ - consumed_));
+          ReadFromConnection(&buffer[0], n);
+
+          if (fwrite(&buffer[0], 1, n, fp) != n)
+          {
+            throw OrthancException(ErrorCode_CannotWriteFile);
+          }
+        }
+      }
+      catch (...)
+      {
+        fclose(fp);
+        throw;
+      }
+
+      if (fclose(fp) != 0)
+      {
+        throw OrthancException(ErrorCode_CannotWriteFile);
+      }
+
+      spill_ = spill;
+    }
+
+    isBuffered_ = true;
+  }
+
+
+  void HttpRequestBody::Unmap()
+  {
+#if !defined(_WIN32)
+    if (mapped_ != NULL)
+    {
+      munmap(mapped_, static_cast<size_t>(size_));
+      mapped_ = NULL;
+    }
+#endif
+  }
+
+
+  HttpRequestBody::HttpRequestBody() :
+    reader_(NULL),
+    size_(0),
+    consumed_(0),
+    position_(0),
+    spillThreshold_(0),
+    isBuffered_(true),
+    mapped_(NULL)
+  {
+  }
+
+
+  HttpRequestBody::HttpRequestBody(IReader& reader,
+                                   uint64_t size,
+                                   size_t spillThreshold) :
+    reader_(&reader),
+    size_(size),
+    consumed_(0),
+    position_(0),
+    spillThreshold_(spillThreshold),
+    isBuffered_(false),
+    mapped_(NULL)
+  {
+  }
+
+
+  HttpRequestBody::~HttpRequestBody()
+  {
+    Unmap();
+  }
+
+
+  void HttpRequestBody::SetContent(std::string& content)
+  {
+    Unmap();
+    spill_.reset(NULL);
+
+    content_.swap(content);
+    reader_ = NULL;
+    size_ = content_.size();
+    consumed_ = size_;
+    position_ = 0;
+    isBuffered_ = true;
+  }
+
+
+  void HttpRequestBody::SetFile(Toolbox::TemporaryFile* file,
+                                uint64_t size)
+  {
+    if (file == NULL)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    Unmap();
+    spill_.reset(file);
+
+    content_.clear();
+    reader_ = NULL;
+    size_ = size;
+    consumed_ = size_;
+    position_ = 0;
+    isBuffered_ = true;
+  }
+
+
+  size_t HttpRequestBody::Read(void* buffer,
+                               size_t size)
+  {
+    if (isBuffered_)
+    {
+      size_t n = static_cast<size_t>(std::min(static_cast<uint64_t>(size), size_ - position_));
+      if (n > 0)
+      {
+        memcpy(buffer, GetData() + position_, n);
+        position_ += n;
+      }
+
+      return n;
+    }
+    else
+    {
+      size_t n = static_cast<size_t>(std::min(static_cast<uint64_t>(size), size_ - consumed_));
+      if (n == 0)
+      {
+        return 0;
+      }
+
+      size_t r = reader_->Read(buffer, n);
+      if (r == 0)
+      {
+        throw OrthancException(ErrorCode_NetworkProtocol);
+      }
+
+      consumed_ += r;
+      return r;
+    }
+  }
+
+
+  const char* HttpRequestBody::GetData()
+  {
+    if (size_ > static_cast<uint64_t>(static_cast<size_t>(-1)))
+    {
+      // The body cannot be addressed on this architecture
+      throw OrthancException(ErrorCode_NotEnoughMemory);
+    }
+
+    Buffer();
+
+    if (spill_.get() == NULL)
+    {
+      return content_.empty() ? NULL : content_.c_str();
+    }
+
+    if (size_ == 0)
+    {
+      return NULL;
+    }
+
+#if !defined(_WIN32)
+    if (mapped_ == NULL)
+    {
+      int fd = open(spill_->GetPath().c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        throw OrthancException(ErrorCode_InexistentFile);
+      }
+
+      void* mapped = mmap(NULL, static_cast<size_t>(size_), PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);  // The mapping remains valid after closing the descriptor
+
+      if (mapped == MAP_FAILED)
+      {
+        throw OrthancException(ErrorCode_NotEnoughMemory);
+      }
+
+      mapped_ = mapped;
+    }
+
+    return reinterpret_cast<const char*>(mapped_);
+#else
+    return GetContent().c_str();
+#endif
+  }
+
+
+  const std::string& HttpRequestBody::GetContent()
+  {
+    Buffer();
+
+    if (spill_.get() != NULL)
+    {
+      Unmap();
+      Toolbox::ReadFile(content_, spill_->GetPath());
+      spill_.reset(NULL);
+    }
+
+    return content_;
+  }
+
+
+  void HttpRequestBody::Discard()
+  {
+    if (isBuffered_)
+    {
+      return;
+    }
+
+    std::vector<uint8_t> buffer(CHUNK_SIZE);
+
+    while (consumed_ < size_)
+    {
+      size_t n = static_cast<size_t>(std::min(static_cast<uint64_t>(CHUNK_SIZE), size_ - consumed_));
+      size_t r = reader_->Read(&buffer[0], n);
+      if (r == 0)
+      {
+        break;
+      }
+
+      consumed_ += r;
+    }
+  }
+}
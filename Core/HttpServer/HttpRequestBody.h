@@ -0,0 +1,131 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../Uuid.h"
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+
+namespace Orthanc
+{
+  /**
+   * Body of an incoming HTTP request (PUT or POST). The body is pulled
+   * from the connection by the handler, instead of being entirely
+   * read in memory before the handler is called. The handler can
+   * either process the body incrementally with "Read()", or access it
+   * as a whole with "GetData()". In the latter case, a body that is
+   * larger than the spill threshold is written to a temporary file,
+   * which is then mapped in memory.
+   **/
+  class HttpRequestBody : public boost::noncopyable
+  {
+  public:
+    class IReader
+    {
+    public:
+      virtual ~IReader()
+      {
+      }
+
+      // Returns the number of bytes that were read, or 0 if the
+      // connection is closed
+      virtual size_t Read(void* buffer,
+                          size_t size) = 0;
+    };
+
+  private:
+    IReader* reader_;
+    uint64_t size_;
+    uint64_t consumed_;
+    uint64_t position_;
+    size_t spillThreshold_;
+    bool isBuffered_;
+    std::string content_;
+    std::auto_ptr<Toolbox::TemporaryFile> spill_;
+    void* mapped_;
+
+    void ReadFromConnection(void* buffer,
+                            size_t size);
+
+    void Buffer();
+
+    void Unmap();
+
+  public:
+    // Empty body
+    HttpRequestBody();
+
+    HttpRequestBody(IReader& reader,
+                    uint64_t size,
+                    size_t spillThreshold);
+
+    ~HttpRequestBody();
+
+    // The content is swapped into the body, without a copy
+    void SetContent(std::string& content);
+
+    // The body becomes the content of a temporary file, whose
+    // ownership is taken
+    void SetFile(Toolbox::TemporaryFile* file,
+                 uint64_t size);
+
+    uint64_t GetSize() const
+    {
+      return size_;
+    }
+
+    bool IsSpilledToDisk() const
+    {
+      return spill_.get() != NULL;
+    }
+
+    // Sequential read of the body. Returns the number of bytes that
+    // were read, or 0 at the end of the body.
+    size_t Read(void* buffer,
+                size_t size);
+
+    // Gives access to the whole body. This is not allowed once
+    // "Read()" has consumed a part of the body from the connection.
+    const char* GetData();
+
+    // Copy of the whole body in memory, for the handlers that need a
+    // string. "GetData()" is to be preferred for large bodies.
+    const std::string& GetContent();
+
+    // Skips the part of the body that was not read by the handler
+    void Discard();
+  };
+}
@@ -35,6 +35,8 @@
 #include "MongooseServer.h"
 
 #include <algorithm>
+#include <cassert>
+#include <limits>
 #include <string.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
@@ -45,7 +47,7 @@
 #include <glog/logging.h>
 
 #include "../OrthancException.h"
-#include "../ChunkedBuffer.h"
+#include "ChunkStore.h"
 #include "HttpOutput.h"
 #include "mongoose.h"
 
@@ -57,6 +59,10 @@
 
 static const long LOCALHOST = (127ll << 24) + 1ll;
 
+// Above this size, the body of a request that is accessed as a whole
+// by its handler is written to a temporary file instead of memory
+static const size_t BODY_SPILL_THRESHOLD = 16 * 1024 * 1024;
+
 
 namespace Orthanc
 {
@@ -77,7 +83,7 @@ namespace Orthanc
       {
       }
 
-      virtual void Send(const void* buffer, size_t length)
+      virtual void SendInternal(const void* buffer, size_t length)
       {
         if (length > 0)
         {
@@ -87,163 +93,44 @@ namespace Orthanc
     };
 
 
-    enum PostDataStatus
-    {
-      PostDataStatus_Success,
-      PostDataStatus_NoLength,
-      PostDataStatus_Pending,
-      PostDataStatus_Failure
-    };
-  }
-
-
-// TODO Move this to external file
-
-
-  class ChunkedFile : public ChunkedBuffer
-  {
-  private:
-    std::string filename_;
-
-  public:
-    ChunkedFile(const std::string& filename) :
-      filename_(filename)
-    {
-    }
-
-    const std::string& GetFilename() const
-    {
-      return filename_;
-    }
-  };
-
-
-
-  class ChunkStore
-  {
-  private:
-    typedef std::list<ChunkedFile*>  Content;
-    Content  content_;
-    unsigned int numPlaces_;
-
-    boost::mutex mutex_;
-    std::set<std::string> discardedFiles_;
-
-    void Clear()
+    class MongooseReader : public HttpRequestBody::IReader
     {
-      for (Content::iterator it = content_.begin();
-           it != content_.end(); ++it)
-      {
-        delete *it;
-      }
-    }
+    private:
+      struct mg_connection* connection_;
 
-    Content::iterator Find(const std::string& filename)
-    {
-      for (Content::iterator it = content_.begin();
-           it != content_.end(); ++it)
+    public:
+      MongooseReader(struct mg_connection* connection) : connection_(connection)
       {
-        if ((*it)->GetFilename() == filename)
-        {
-          return it;
-        }
       }
 
-      return content_.end();
-    }
-
-    void Remove(const std::string& filename)
-    {
-      Content::iterator it = Find(filename);
-      if (it != content_.end())
+      virtual size_t Read(void* buffer, size_t size)
       {
-        delete *it;
-        content_.erase(it);
+        int r = mg_read(connection_, buffer, size);
+        return (r <= 0 ? 0 : static_cast<size_t>(r));
       }
-    }
-
-  public:
-    ChunkStore()
-    {
-      numPlaces_ = 10;
-    }
+    };
 
-    ~ChunkStore()
-    {
-      Clear();
-    }
 
-    PostDataStatus Store(std::string& completed,
-                         const char* chunkData,
-                         size_t chunkSize,
-                         const std::string& filename,
-                         size_t filesize)
+    enum PostDataStatus
     {
-      boost::mutex::scoped_lock lock(mutex_);
-
-      std::set<std::string>::iterator wasDiscarded = discardedFiles_.find(filename);
-      if (wasDiscarded != discardedFiles_.end())
-      {
-        discardedFiles_.erase(wasDiscarded);
-        return PostDataStatus_Failure;
-      }
-
-      ChunkedFile* f;
-      Content::iterator it = Find(filename);
-      if (it == content_.end())
-      {
-        f = new ChunkedFile(filename);
-
-        // Make some room
-        if (content_.size() >= numPlaces_)
-        {
-          discardedFiles_.insert(content_.front()->GetFilename());
-          delete content_.front();
-          content_.pop_front();
-        }
-
-        content_.push_back(f);
-      }
-      else
-      {
-        f = *it;
-      }
-
-      f->AddChunk(chunkData, chunkSize);
-
-      if (f->GetNumBytes() > filesize)
-      {
-        Remove(filename);
-      }
-      else if (f->GetNumBytes() == filesize)
-      {
-        f->Flatten(completed);
-        Remove(filename);
-        return PostDataStatus_Success;
-      }
-
-      return PostDataStatus_Pending;
-    }
-
-    /*void Print() 
-      {
-      boost::mutex::scoped_lock lock(mutex_);
-
-      printf("ChunkStore status:\n");
-      for (Content::const_iterator i = content_.begin();
-      i != content_.end(); i++)
-      {
-      printf("  [%s]: %d\n", (*i)->GetFilename().c_str(), (*i)->GetNumBytes());
-      }
-      printf("-----\n");
-      }*/
-  };
+      PostDataStatus_Success,
+      PostDataStatus_NoLength,
+      PostDataStatus_Pending,
+      PostDataStatus_Failure
+    };
+  }
 
 
   struct MongooseServer::PImpl
   {
     struct mg_context *context_;
     ChunkStore chunkStore_;
+
+    boost::mutex statisticsMutex_;
+    unsigned int activeRequests_;
+    unsigned int peakActiveRequests_;
+    uint64_t totalRequests_;
+    uint64_t saturations_;
   };
 
 
@@ -271,31 +158,46 @@ namespace Orthanc
 
 
 
-  static PostDataStatus ReadBody(std::string& postData,
-                                 struct mg_connection *connection,
-                                 const HttpHandler::Arguments& headers)
+  static bool GetContentLength(uint64_t& length,
+                               const HttpHandler::Arguments& headers)
   {
     HttpHandler::Arguments::const_iterator cs = headers.find("content-length");
     if (cs == headers.end())
     {
-      return PostDataStatus_NoLength;
+      return false;
     }
 
-    int length;      
+    int64_t value;
     try
     {
-      length = boost::lexical_cast<int>(cs->second);
+      value = boost::lexical_cast<int64_t>(cs->second);
     }
     catch (boost::bad_lexical_cast)
+    {
+      return false;
+    }
+
+    length = (value < 0 ? 0 : static_cast<uint64_t>(value));
+    return true;
+  }
+
+
+  static PostDataStatus ReadBody(std::string& postData,
+                                 struct mg_connection *connection,
+                                 const HttpHandler::Arguments& headers)
+  {
+    uint64_t contentLength;
+    if (!GetContentLength(contentLength, headers))
     {
       return PostDataStatus_NoLength;
     }
 
-    if (length < 0)
+    if (contentLength > static_cast<uint64_t>(std::numeric_limits<int>::max()))
     {
-      length = 0;
+      return PostDataStatus_Failure;
     }
 
+    int length = static_cast<int>(contentLength);
     postData.resize(length);
 
     size_t pos = 0;
@@ -317,7 +219,7 @@ namespace Orthanc
 
 
 
-  static PostDataStatus ParseMultipartPost(std::string &completedFile,
+  static PostDataStatus ParseMultipartPost(HttpRequestBody& completedFile,
                                            struct mg_connection *connection,
                                            const HttpHandler::Arguments& headers,
                                            const std::string& contentType,
@@ -351,12 +253,12 @@ namespace Orthanc
       return PostDataStatus_Failure; 
     }
 
-    size_t fileSize = 0;
+    uint64_t fileSize = 0;
     if (fileSizeStr != headers.end())
     {
       try
       {
-        fileSize = boost::lexical_cast<size_t>(fileSizeStr->second);
+        fileSize = boost::lexical_cast<uint64_t>(fileSizeStr->second);
       }
       catch (boost::bad_lexical_cast)
       {
@@ -393,16 +295,26 @@ namespace Orthanc
               if (fileName == headers.end())
               {
                 // This file is stored in a single chunk
-                completedFile.resize(chunkSize);
-                if (chunkSize > 0)
-                {
-                  memcpy(&completedFile[0], chunkData, chunkSize);
-                }
+                std::string content(chunkData, chunkSize);
+                completedFile.SetContent(content);
                 return PostDataStatus_Success;
               }
               else
               {
-                return chunkStore.Store(completedFile, chunkData, chunkSize, fileName->second, fileSize);
+                std::auto_ptr<Toolbox::TemporaryFile> completed;
+
+                switch (chunkStore.Store(completed, chunkData, chunkSize, fileName->second, fileSize))
+                {
+                  case ChunkStore::Status_Completed:
+                    completedFile.SetFile(completed.release(), fileSize);
+                    return PostDataStatus_Success;
+
+                  case ChunkStore::Status_Pending:
+                    return PostDataStatus_Pending;
+
+                  default:
+                    return PostDataStatus_Failure;
+                }
               }
             }
           }
@@ -424,6 +336,7 @@ namespace Orthanc
   {
     std::string s = "HTTP/1.1 401 Unauthorized\r\n" 
       "WWW-Authenticate: Basic realm=\"" ORTHANC_REALM "\""
+      "\r\nContent-Length: 0"
       "\r\n\r\n";
     output.Send(&s[0], s.size());
   }
@@ -568,6 +481,66 @@ namespace Orthanc
 
 
 
+  namespace
+  {
+    // Accounts for the request being served by the current thread
+    class ActiveRequest
+    {
+    private:
+      MongooseServer& server_;
+
+    public:
+      ActiveRequest(MongooseServer& server) : server_(server)
+      {
+        server_.SignalRequestStarted();
+      }
+
+      ~ActiveRequest()
+      {
+        server_.SignalRequestFinished();
+      }
+    };
+  }
+
+
+  static void SendError(HttpOutput& output,
+                        HttpStatus status)
+  {
+    if (output.IsHeaderSent())
+    {
+      // The handler failed while streaming its answer: Sending an
+      // error header would corrupt the body
+      LOG(ERROR) << "Interrupting an answer whose header is already sent";
+      output.Abort();
+    }
+    else
+    {
+      output.SendHeader(status);
+    }
+  }
+
+
+  static void CloseConnectionAfterAnswer(const struct mg_request_info* request)
+  {
+    // Mongoose 3.1 offers no way to close a connection from the
+    // callback. It keeps the connection alive if the request is
+    // HTTP/1.1 without a "Connection" header, or if this header is
+    // "keep-alive": Make the request look like a HTTP/1.0 request
+    // asking for the closing of the connection.
+    struct mg_request_info& info = const_cast<struct mg_request_info&>(*request);
+
+    for (int i = 0; i < info.num_headers; i++)
+    {
+      if (boost::iequals(info.http_headers[i].name, "connection"))
+      {
+        info.http_headers[i].value = const_cast<char*>("close");
+      }
+    }
+
+    info.http_version = const_cast<char*>("1.0");
+  }
+
+
   static void* Callback(enum mg_event event,
                         struct mg_connection *connection,
                         const struct mg_request_info *request)
@@ -575,7 +548,11 @@ namespace Orthanc
     if (event == MG_NEW_REQUEST) 
     {
       MongooseServer* that = reinterpret_cast<MongooseServer*>(request->user_data);
+      ActiveRequest active(*that);
+
       MongooseOutput output(connection);
+      output.SetChunkedTransferAllowed(request->http_version != NULL &&
+                                       !strcmp(request->http_version, "1.1"));
 
       // Check remote calls
       if (!that->IsRemoteAccessAllowed() &&
@@ -596,11 +573,44 @@ namespace Orthanc
       }
 
 
+      // Negotiate the compression of the answer
+      if (that->IsHttpCompressionEnabled())
+      {
+        HttpHandler::Arguments::const_iterator accept = headers.find("accept-encoding");
+        if (accept != headers.end())
+        {
+          output.SetCompression(HttpOutput::NegotiateCompression(accept->second));
+          output.SetCompressionLevel(that->GetHttpCompressionLevel());
+          output.SetCompressionThreshold(that->GetHttpCompressionThreshold());
+        }
+      }
+
+
       // Extract the GET arguments
       HttpHandler::Arguments argumentsGET;
       if (!strcmp(request->request_method, "GET"))
       {
         HttpHandler::ParseGetQuery(argumentsGET, request->query_string);
+
+        // Partial downloads of files
+        HttpHandler::Arguments::const_iterator range = headers.find("range");
+        if (range != headers.end())
+        {
+          output.SetRange(range->second);
+        }
+
+        HttpHandler::Arguments::const_iterator ifRange = headers.find("if-range");
+        if (ifRange != headers.end())
+        {
+          output.SetIfRange(ifRange->second);
+        }
+
+        // Conditional requests on the entity tags
+        HttpHandler::Arguments::const_iterator ifNoneMatch = headers.find("if-none-match");
+        if (ifNoneMatch != headers.end())
+        {
+          output.SetIfNoneMatch(ifNoneMatch->second);
+        }
       }
 
 
@@ -642,30 +652,35 @@ namespace Orthanc
       }
 
 
-      // Extract the body of the request for PUT and POST
-      std::string body;
+      // Prepare the body of the request for PUT and POST. Unless it
+      // is a multipart upload, the body is not read at this point:
+      // It is pulled from the connection by the handler.
+      MongooseReader reader(connection);
+      std::auto_ptr<HttpRequestBody> body;
+
       if (method == HttpMethod_Post ||
           method == HttpMethod_Put)
       {
-        PostDataStatus status;
+        PostDataStatus status = PostDataStatus_Success;
 
         HttpHandler::Arguments::const_iterator ct = headers.find("content-type");
-        if (ct == headers.end())
+        if (ct != headers.end() &&
+            ct->second.size() >= multipartLength &&
+            !memcmp(ct->second.c_str(), multipart, multipartLength))
         {
-          // No content-type specified. Assume no multi-part content occurs at this point.
-          status = ReadBody(body, connection, headers);          
+          body.reset(new HttpRequestBody);
+          status = ParseMultipartPost(*body, connection, headers, ct->second, that->GetChunkStore());
         }
         else
         {
-          std::string contentType = ct->second;
-          if (contentType.size() >= multipartLength &&
-              !memcmp(contentType.c_str(), multipart, multipartLength))
+          uint64_t contentLength;
+          if (GetContentLength(contentLength, headers))
           {
-            status = ParseMultipartPost(body, connection, headers, contentType, that->GetChunkStore());
+            body.reset(new HttpRequestBody(reader, contentLength, BODY_SPILL_THRESHOLD));
           }
           else
           {
-            status = ReadBody(body, connection, headers);
+            status = PostDataStatus_NoLength;
           }
         }
 
@@ -689,6 +704,12 @@ namespace Orthanc
       }
 
 
+      if (body.get() == NULL)
+      {
+        body.reset(new HttpRequestBody);
+      }
+
+
       // Call the proper handler for this URI
       UriComponents uri;
       try
@@ -697,6 +718,7 @@ namespace Orthanc
       }
       catch (OrthancException)
       {
+        body->Discard();
         output.SendHeader(HttpStatus_400_BadRequest);
         return (void*) "";
       }
@@ -708,22 +730,22 @@ namespace Orthanc
         try
         {
           LOG(INFO) << EnumerationToString(method) << " " << Toolbox::FlattenUri(uri);
-          handler->Handle(output, method, uri, headers, argumentsGET, body);
+          handler->Handle(output, method, uri, headers, argumentsGET, *body);
         }
         catch (OrthancException& e)
         {
           LOG(ERROR) << "MongooseServer Exception [" << e.What() << "]";
-          output.SendHeader(HttpStatus_500_InternalServerError);        
+          SendError(output, HttpStatus_500_InternalServerError);
         }
         catch (boost::bad_lexical_cast&)
         {
           LOG(ERROR) << "MongooseServer Exception: Bad lexical cast";
-          output.SendHeader(HttpStatus_400_BadRequest);
+          SendError(output, HttpStatus_400_BadRequest);
         }
         catch (std::runtime_error&)
         {
           LOG(ERROR) << "MongooseServer Exception: Presumably a bad JSON request";
-          output.SendHeader(HttpStatus_400_BadRequest);
+          SendError(output, HttpStatus_400_BadRequest);
         }
       }
       else
@@ -731,6 +753,24 @@ namespace Orthanc
         output.SendHeader(HttpStatus_404_NotFound);
       }
 
+      // The answer is complete, including the error answers above
+      output.SignalAnswerCompleted();
+
+      // Skip the part of the body that was not read by the handler,
+      // so that the connection can be reused
+      try
+      {
+        body->Discard();
+      }
+      catch (OrthancException&)
+      {
+      }
+
+      if (output.IsCloseConnectionRequired())
+      {
+        CloseConnectionAfterAnswer(request);
+      }
+
       // Mark as processed
       return (void*) "";
     } 
@@ -750,11 +790,20 @@ namespace Orthanc
   MongooseServer::MongooseServer() : pimpl_(new PImpl)
   {
     pimpl_->context_ = NULL;
+    pimpl_->activeRequests_ = 0;
+    pimpl_->peakActiveRequests_ = 0;
+    pimpl_->totalRequests_ = 0;
+    pimpl_->saturations_ = 0;
     remoteAllowed_ = false;
     authentication_ = false;
     ssl_ = false;
     port_ = 8000;
     filter_ = NULL;
+    compressionEnabled_ = true;
+    compressionLevel_ = 6;
+    compressionThreshold_ = 1024;
+    threadsCount_ = 50;
+    keepAlive_ = false;
 
 #if ORTHANC_SSL_ENABLED == 1
     // Check for the Heartbleed exploit
@@ -792,8 +841,12 @@ namespace Orthanc
         port += "s";
       }
 
+      std::string threads = boost::lexical_cast<std::string>(threadsCount_);
+
       const char *options[] = {
         "listening_ports", port.c_str(), 
+        "num_threads", threads.c_str(),
+        "enable_keep_alive", keepAlive_ ? "yes" : "no",
         ssl_ ? "ssl_certificate" : NULL,
         certificate_.c_str(),
         NULL
@@ -891,6 +944,85 @@ namespace Orthanc
     remoteAllowed_ = allowed;
   }
 
+  void MongooseServer::SetHttpCompressionEnabled(bool enabled)
+  {
+    Stop();
+    compressionEnabled_ = enabled;
+  }
+
+  void MongooseServer::SetHttpCompressionLevel(uint8_t level)
+  {
+    if (level >= 10)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    Stop();
+    compressionLevel_ = level;
+  }
+
+  void MongooseServer::SetHttpCompressionThreshold(size_t threshold)
+  {
+    Stop();
+    compressionThreshold_ = threshold;
+  }
+
+  void MongooseServer::SetThreadsCount(unsigned int threads)
+  {
+    if (threads == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    Stop();
+    threadsCount_ = threads;
+  }
+
+  void MongooseServer::SetKeepAliveEnabled(bool enabled)
+  {
+    Stop();
+    keepAlive_ = enabled;
+  }
+
+  void MongooseServer::SignalRequestStarted()
+  {
+    boost::mutex::scoped_lock lock(pimpl_->statisticsMutex_);
+
+    pimpl_->activeRequests_++;
+    pimpl_->totalRequests_++;
+
+    if (pimpl_->activeRequests_ > pimpl_->peakActiveRequests_)
+    {
+      pimpl_->peakActiveRequests_ = pimpl_->activeRequests_;
+    }
+
+    if (pimpl_->activeRequests_ >= threadsCount_)
+    {
+      pimpl_->saturations_++;
+    }
+  }
+
+  void MongooseServer::SignalRequestFinished()
+  {
+    boost::mutex::scoped_lock lock(pimpl_->statisticsMutex_);
+
+    assert(pimpl_->activeRequests_ > 0);
+    pimpl_->activeRequests_--;
+  }
+
+  void MongooseServer::GetThreadsStatistics(unsigned int& activeRequests,
+                                            unsigned int& peakActiveRequests,
+                                            uint64_t& totalRequests,
+                                            uint64_t& saturations) const
+  {
+    boost::mutex::scoped_lock lock(pimpl_->statisticsMutex_);
+
+    activeRequests = pimpl_->activeRequests_;
+    peakActiveRequests = pimpl_->peakActiveRequests_;
+    totalRequests = pimpl_->totalRequests_;
+    saturations = pimpl_->saturations_;
+  }
+
   void MongooseServer::SetIncomingHttpRequestFilter(IIncomingHttpRequestFilter& filter)
   {
     Stop();
@@ -76,6 +76,11 @@ namespace Orthanc
     std::string certificate_;
     uint16_t port_;
     IIncomingHttpRequestFilter* filter_;
+    bool compressionEnabled_;
+    uint8_t compressionLevel_;
+    size_t compressionThreshold_;
+    unsigned int threadsCount_;
+    bool keepAlive_;
   
     bool IsRunning() const;
 
@@ -137,6 +142,61 @@ namespace Orthanc
 
     void SetIncomingHttpRequestFilter(IIncomingHttpRequestFilter& filter);
 
+    bool IsHttpCompressionEnabled() const
+    {
+      return compressionEnabled_;
+    }
+
+    void SetHttpCompressionEnabled(bool enabled);
+
+    uint8_t GetHttpCompressionLevel() const
+    {
+      return compressionLevel_;
+    }
+
+    void SetHttpCompressionLevel(uint8_t level);
+
+    size_t GetHttpCompressionThreshold() const
+    {
+      return compressionThreshold_;
+    }
+
+    void SetHttpCompressionThreshold(size_t threshold);
+
+    unsigned int GetThreadsCount() const
+    {
+      return threadsCount_;
+    }
+
+    // Size of the pool of threads that serve the HTTP connections
+    void SetThreadsCount(unsigned int threads);
+
+    bool IsKeepAliveEnabled() const
+    {
+      return keepAlive_;
+    }
+
+    void SetKeepAliveEnabled(bool enabled);
+
+    /**
+     * Load of the pool of threads. Each thread serves one connection
+     * at a time: Once all of them are busy, the new connections wait
+     * in the queue of the listening thread until a thread is
+     * released. "saturations" counts the requests that have occupied
+     * the last idle thread of the pool. The depth of this queue, and
+     * the number of connections, are internal to Mongoose 3.1: They
+     * cannot be observed from its callback.
+     **/
+    void GetThreadsStatistics(unsigned int& activeRequests,
+                              unsigned int& peakActiveRequests,
+                              uint64_t& totalRequests,
+                              uint64_t& saturations) const;
+
+    // Called by the threads of the pool (internal use)
+    void SignalRequestStarted();
+
+    void SignalRequestFinished();
+
     void ClearHandlers();
 
     // Can return NULL if no handler is associated to this URI
@@ -0,0 +1,268 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "ZlibFileHttpSender.h"
+
+#include "../OrthancException.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+namespace Orthanc
+{
+  // Size of the chunks that are read from the disk, and that are
+  // produced by zlib
+  static const size_t INPUT_CHUNK = 64 * 1024;
+  static const size_t OUTPUT_CHUNK = 256 * 1024;
+
+
+  namespace
+  {
+    class FileCloser : public boost::noncopyable
+    {
+    private:
+      FILE* fp_;
+
+    public:
+      FileCloser(FILE* fp) : fp_(fp)
+      {
+      }
+
+      ~FileCloser()
+      {
+        fclose(fp_);
+      }
+    };
+
+    class InflateEnder : public boost::noncopyable
+    {
+    private:
+      z_stream& stream_;
+
+    public:
+      InflateEnder(z_stream& stream) : stream_(stream)
+      {
+      }
+
+      ~InflateEnder()
+      {
+        inflateEnd(&stream_);
+      }
+    };
+  }
+
+
+  // Reads the uncompressed size that "ZlibCompressor" writes at the
+  // beginning of the compressed file. Returns "false" if the file is
+  // empty, which corresponds to an empty uncompressed file.
+  static bool ReadUncompressedSize(uint64_t& size,
+                                   FILE* fp)
+  {
+    size_t header;
+    size_t n = fread(&header, 1, sizeof(size_t), fp);
+
+    if (n == 0)
+    {
+      size = 0;
+      return false;
+    }
+
+    if (n != sizeof(size_t))
+    {
+      throw OrthancException("Zlib: The compressed buffer is ill-formed");
+    }
+
+    size = header;
+    return true;
+  }
+
+
+  ZlibFileHttpSender::ZlibFileHttpSender(const boost::filesystem::path& path) :
+    path_(path),
+    storage_(NULL),
+    hasSize_(false),
+    size_(0)
+  {
+    SetContentType("application/octet-stream");
+  }
+
+
+  ZlibFileHttpSender::ZlibFileHttpSender(const FileStorage& storage,
+                                         const std::string& uuid) :
+    path_(storage.GetPathForReading(uuid)),
+    storage_(&storage),
+    uuid_(uuid),
+    hasSize_(false),
+    size_(0)
+  {
+    SetContentType("application/octet-stream");
+  }
+
+
+  FILE* ZlibFileHttpSender::OpenFile()
+  {
+    for (unsigned int i = 1; ; i++)
+    {
+      FILE* fp = fopen(path_.string().c_str(), "rb");
+      if (fp != NULL ||
+          storage_ == NULL ||
+          i >= FileStorage::MAX_MOVED_FILE_LOOKUPS ||
+          !storage_->LookupMovedFile(path_, uuid_))
+      {
+        return fp;
+      }
+    }
+  }
+
+
+  uint64_t ZlibFileHttpSender::GetFileSize()
+  {
+    if (!hasSize_)
+    {
+      FILE* fp = OpenFile();
+      if (!fp)
+      {
+        throw OrthancException(ErrorCode_InexistentFile);
+      }
+
+      FileCloser closer(fp);
+      ReadUncompressedSize(size_, fp);
+      hasSize_ = true;
+    }
+
+    return size_;
+  }
+
+
+  bool ZlibFileHttpSender::SendData(HttpOutput& output)
+  {
+    uint64_t size = GetFileSize();
+    if (size == 0)
+    {
+      return true;
+    }
+    else
+    {
+      return SendRange(output, 0, size - 1);
+    }
+  }
+
+
+  bool ZlibFileHttpSender::SendRange(HttpOutput& output,
+                                     uint64_t start,
+                                     uint64_t end)
+  {
+    if (start > end)
+    {
+      return false;
+    }
+
+    FILE* fp = OpenFile();
+    if (!fp)
+    {
+      return false;
+    }
+
+    FileCloser closer(fp);
+
+    uint64_t size;
+    if (!ReadUncompressedSize(size, fp) ||
+        end >= size)
+    {
+      return false;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    if (inflateInit(&stream) != Z_OK)
+    {
+      throw OrthancException(ErrorCode_NotEnoughMemory);
+    }
+
+    InflateEnder ender(stream);
+
+    std::vector<uint8_t> input(INPUT_CHUNK);
+    std::vector<uint8_t> uncompressed(OUTPUT_CHUNK);
+
+    // Position of the next uncompressed byte in the file
+    uint64_t position = 0;
+    int result = Z_OK;
+
+    while (position <= end)
+    {
+      if (stream.avail_in == 0)
+      {
+        // If the end of the file is reached, zlib might still have
+        // some pending output
+        size_t n = fread(&input[0], 1, input.size(), fp);
+        stream.next_in = &input[0];
+        stream.avail_in = static_cast<uInt>(n);
+      }
+
+      stream.next_out = &uncompressed[0];
+      stream.avail_out = static_cast<uInt>(uncompressed.size());
+
+      // "Z_BUF_ERROR" is returned if no progress is possible, which
+      // means that the compressed stream is truncated
+      result = inflate(&stream, Z_NO_FLUSH);
+      if (result != Z_OK &&
+          result != Z_STREAM_END)
+      {
+        return false;
+      }
+
+      size_t produced = uncompressed.size() - stream.avail_out;
+
+      // Forward the part of the uncompressed chunk within the range
+      uint64_t from = std::max(start, position);
+      uint64_t to = std::min(end + 1, position + produced);
+      if (from < to)
+      {
+        output.Send(&uncompressed[static_cast<size_t>(from - position)],
+                    static_cast<size_t>(to - from));
+      }
+
+      position += produced;
+
+      if (result == Z_STREAM_END)
+      {
+        break;
+      }
+    }
+
+    return (position > end);
+  }
+}
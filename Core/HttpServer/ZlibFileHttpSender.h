@@ -0,0 +1,77 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "HttpFileSender.h"
+#include "../FileStorage/FileStorage.h"
+
+#include <stdio.h>
+
+namespace Orthanc
+{
+  /**
+   * Sends a file of the storage area that was compressed by
+   * "ZlibCompressor". The file is uncompressed while it is streamed
+   * to the client, without being entirely loaded in memory.
+   **/
+  class ZlibFileHttpSender : public HttpFileSender
+  {
+  private:
+    boost::filesystem::path path_;
+    const FileStorage* storage_;  // Can be NULL
+    std::string uuid_;
+    bool hasSize_;
+    uint64_t size_;
+
+    // Follows the file if it is moved by the storage area between the
+    // computation of the size and the sending of the content
+    FILE* OpenFile();
+
+  protected:
+    virtual uint64_t GetFileSize();
+
+    virtual bool SendData(HttpOutput& output);
+
+    // The compressed data before the range is uncompressed and
+    // skipped, and the decompression stops at the end of the range
+    virtual bool SendRange(HttpOutput& output,
+                           uint64_t start,
+                           uint64_t end);
+
+  public:
+    ZlibFileHttpSender(const boost::filesystem::path& path);
+
+    ZlibFileHttpSender(const FileStorage& storage,
+                       const std::string& uuid);
+  };
+}
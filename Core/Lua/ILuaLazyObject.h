@@ -0,0 +1,65 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <json/value.h>
+
+namespace Orthanc
+{
+  /**
+   * Object that is given to a Lua callback as a userdata, whose
+   * fields are only computed when the script reads them (through the
+   * "__index" metamethod). The object is only valid during the call.
+   *
+   * As Lua 5.1 cannot iterate over a userdata with "pairs()", the
+   * script can convert the whole object to a table by calling its
+   * "ToTable()" method.
+   **/
+  class ILuaLazyObject : public boost::noncopyable
+  {
+  public:
+    virtual ~ILuaLazyObject()
+    {
+    }
+
+    // Returns "false" if the field does not exist (the script then
+    // reads "nil")
+    virtual bool LookupField(Json::Value& value,
+                             const std::string& name) = 0;
+
+    // Computes all the fields at once, as a JSON object
+    virtual void GetAllFields(Json::Value& target) = 0;
+  };
+}
@@ -0,0 +1,209 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "LuaContextPool.h"
+
+#include "../OrthancException.h"
+
+#include <memory>
+#include <glog/logging.h>
+
+
+namespace Orthanc
+{
+  LuaContext* LuaContextPool::Acquire()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    while (available_.empty() &&
+           contexts_.size() >= maxSize_)
+    {
+      released_.wait(lock);
+    }
+
+    if (!available_.empty())
+    {
+      LuaContext* context = available_.back();
+      available_.pop_back();
+      return context;
+    }
+
+    // Create a new context, and bring it to the same state as the
+    // other contexts by replaying the startup scripts
+    std::auto_ptr<LuaContext> context(new LuaContext);
+
+    for (std::list<std::string>::const_iterator 
+           it = scripts_.begin(); it != scripts_.end(); ++it)
+    {
+      context->Execute(*it);
+    }
+
+    contexts_.push_back(context.get());
+    return context.release();
+  }
+
+
+  void LuaContextPool::Release(LuaContext* context)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    available_.push_back(context);
+    released_.notify_all();
+  }
+
+
+  LuaContextPool::LuaContextPool(size_t maxSize) : 
+    maxSize_(maxSize)
+  {
+    if (maxSize == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  LuaContextPool::~LuaContextPool()
+  {
+    for (size_t i = 0; i < contexts_.size(); i++)
+    {
+      delete contexts_[i];
+    }
+  }
+
+
+  void LuaContextPool::SetMaxSize(size_t maxSize)
+  {
+    if (maxSize == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // The contexts that are already created are kept
+    maxSize_ = maxSize;
+    released_.notify_all();
+  }
+
+
+  size_t LuaContextPool::GetMaxSize()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return maxSize_;
+  }
+
+
+  void LuaContextPool::WaitAllReleased(boost::mutex::scoped_lock& lock)
+  {
+    // Wait for all the contexts to be released, so that no callback
+    // runs while the contexts are modified
+    while (available_.size() != contexts_.size())
+    {
+      released_.wait(lock);
+    }
+  }
+
+
+  LuaContext& LuaContextPool::GetFirstContext()
+  {
+    if (contexts_.empty())
+    {
+      LuaContext* context = new LuaContext;
+      contexts_.push_back(context);
+      available_.push_back(context);
+    }
+
+    return *contexts_[0];
+  }
+
+
+  void LuaContextPool::DropOtherContexts()
+  {
+    for (size_t i = 1; i < contexts_.size(); i++)
+    {
+      delete contexts_[i];
+    }
+
+    contexts_.resize(1);
+    available_.clear();
+    available_.push_back(contexts_[0]);
+  }
+
+
+  void LuaContextPool::LoadScript(const std::string& script)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    WaitAllReleased(lock);
+
+    // The first context reports the errors in the script
+    GetFirstContext().Execute(script);
+    scripts_.push_back(script);
+
+    // Drop the other contexts instead of running the script in each
+    // of them, which could leave them in different states if the
+    // script fails. They are re-created on demand by "Acquire()".
+    DropOtherContexts();
+  }
+
+
+  void LuaContextPool::LoadScript(EmbeddedResources::FileResourceId resource)
+  {
+    std::string script;
+    EmbeddedResources::GetFileResource(script, resource);
+    LoadScript(script);
+  }
+
+
+  void LuaContextPool::Execute(std::string& output,
+                               const std::string& command)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    WaitAllReleased(lock);
+
+    if (maxSize_ != 1)
+    {
+      LOG(ERROR) << "Cannot execute a Lua script if more than one Lua context is allowed (option \"LuaContexts\")";
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    // The contexts that were created before the pool was shrunk
+    // would miss the script
+    GetFirstContext().Execute(output, command);
+    DropOtherContexts();
+  }
+
+
+  bool LuaContextPool::IsExistingFunction(const char* name)
+  {
+    Locker locker(*this);
+    return locker.GetContext().IsExistingFunction(name);
+  }
+}
@@ -0,0 +1,124 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "LuaContext.h"
+
+#include <list>
+#include <vector>
+
+
+namespace Orthanc
+{
+  /**
+   * Pool of Lua contexts that are initialized by the same scripts, so
+   * that several threads can run Lua callbacks in parallel. A context
+   * is checked out of the pool by a "Locker" for the duration of a
+   * call.
+   *
+   * The startup scripts given to "LoadScript()" are replayed in each
+   * context of the pool. However, each context has its own global
+   * variables: The changes made by a callback to a global variable
+   * are only visible to the later calls that check out the same
+   * context. The scripts that keep a global state across calls
+   * (e.g. counters) must thus use a pool of size 1, which serializes
+   * all the calls as before.
+   *
+   * The ad-hoc scripts given to "Execute()" are not recorded. As they
+   * could not be run consistently in all the contexts, they are only
+   * accepted by a pool of size 1.
+   **/
+  class LuaContextPool : public boost::noncopyable
+  {
+  private:
+    boost::mutex mutex_;
+    boost::condition_variable released_;
+    size_t maxSize_;
+    std::vector<LuaContext*> contexts_;
+    std::vector<LuaContext*> available_;
+    std::list<std::string> scripts_;
+
+    LuaContext* Acquire();
+
+    void Release(LuaContext* context);
+
+    void WaitAllReleased(boost::mutex::scoped_lock& lock);
+
+    LuaContext& GetFirstContext();
+
+    void DropOtherContexts();
+
+  public:
+    class Locker : public boost::noncopyable
+    {
+    private:
+      LuaContextPool& that_;
+      LuaContext* context_;
+
+    public:
+      Locker(LuaContextPool& that) :
+        that_(that),
+        context_(that.Acquire())
+      {
+      }
+
+      ~Locker()
+      {
+        that_.Release(context_);
+      }
+
+      LuaContext& GetContext()
+      {
+        return *context_;
+      }
+    };
+
+    // The contexts are created on demand, up to "maxSize"
+    LuaContextPool(size_t maxSize = 1);
+
+    ~LuaContextPool();
+
+    void SetMaxSize(size_t maxSize);
+
+    size_t GetMaxSize();
+
+    void LoadScript(const std::string& script);
+
+    void LoadScript(EmbeddedResources::FileResourceId resource);
+
+    void Execute(std::string& output,
+                 const std::string& command);
+
+    bool IsExistingFunction(const char* name);
+  };
+}
@@ -32,9 +32,19 @@
 
 #include "LuaFunctionCall.h"
 
+#include <string.h>
+
+extern "C" 
+{
+#include <lauxlib.h>
+}
+
 
 namespace Orthanc
 {
+  static const char* LAZY_OBJECT_METATABLE = "Orthanc.LazyObject";
+  static const char* LAZY_OBJECT_TO_TABLE = "ToTable";
+
   void LuaFunctionCall::CheckAlreadyExecuted()
   {
     if (isExecuted_)
@@ -54,6 +64,26 @@ namespace Orthanc
     lua_getglobal(context_.lua_, functionName);
   }
 
+  LuaFunctionCall::~LuaFunctionCall()
+  {
+    // The function might have kept a reference to the lazy objects
+    // (e.g. in a global variable): Prevent them from accessing the
+    // C++ objects after the call
+    for (size_t i = 0; i < lazyObjects_.size(); i++)
+    {
+      lua_rawgeti(context_.lua_, LUA_REGISTRYINDEX, lazyObjects_[i]);
+
+      ILuaLazyObject** userdata = reinterpret_cast<ILuaLazyObject**>(lua_touserdata(context_.lua_, -1));
+      if (userdata != NULL)
+      {
+        *userdata = NULL;
+      }
+
+      lua_pop(context_.lua_, 1);
+      luaL_unref(context_.lua_, LUA_REGISTRYINDEX, lazyObjects_[i]);
+    }
+  }
+
   void LuaFunctionCall::PushString(const std::string& value)
   {
     CheckAlreadyExecuted();
@@ -81,51 +111,56 @@ namespace Orthanc
   void LuaFunctionCall::PushJSON(const Json::Value& value)
   {
     CheckAlreadyExecuted();
+    PushJSON(context_.lua_, value);
+  }
 
+  void LuaFunctionCall::PushJSON(lua_State* state,
+                                 const Json::Value& value)
+  {
     if (value.isString())
     {
-      lua_pushstring(context_.lua_, value.asCString());
+      lua_pushstring(state, value.asCString());
     }
     else if (value.isDouble())
     {
-      lua_pushnumber(context_.lua_, value.asDouble());
+      lua_pushnumber(state, value.asDouble());
     }
     else if (value.isInt())
     {
-      lua_pushinteger(context_.lua_, value.asInt());
+      lua_pushinteger(state, value.asInt());
     }
     else if (value.isUInt())
     {
-      lua_pushinteger(context_.lua_, value.asUInt());
+      lua_pushinteger(state, value.asUInt());
     }
     else if (value.isBool())
     {
-      lua_pushboolean(context_.lua_, value.asBool());
+      lua_pushboolean(state, value.asBool());
     }
     else if (value.isNull())
     {
-      lua_pushnil(context_.lua_);
+      lua_pushnil(state);
     }
     else if (value.isArray())
     {
-      lua_newtable(context_.lua_);
+      lua_newtable(state);
 
       // http://lua-users.org/wiki/SimpleLuaApiExample
       for (Json::Value::ArrayIndex i = 0; i < value.size(); i++)
       {
         // Push the table index (note the "+1" because of Lua conventions)
-        lua_pushnumber(context_.lua_, i + 1);
+        lua_pushnumber(state, i + 1);
 
         // Push the value of the cell
-        PushJSON(value[i]);
+        PushJSON(state, value[i]);
 
         // Stores the pair in the table
-        lua_rawset(context_.lua_, -3);
+        lua_rawset(state, -3);
       }
     }
     else if (value.isObject())
     {
-      lua_newtable(context_.lua_);
+      lua_newtable(state);
 
       Json::Value::Members members = value.getMemberNames();
 
@@ -133,13 +168,13 @@ namespace Orthanc
              it = members.begin(); it != members.end(); ++it)
       {
         // Push the index of the cell
-        lua_pushstring(context_.lua_, it->c_str());
+        lua_pushstring(state, it->c_str());
 
         // Push the value of the cell
-        PushJSON(value[*it]);
+        PushJSON(state, value[*it]);
 
         // Stores the pair in the table
-        lua_rawset(context_.lua_, -3);
+        lua_rawset(state, -3);
       }
     }
     else
@@ -148,6 +183,129 @@ namespace Orthanc
     }
   }
 
+  int LuaFunctionCall::IndexLazyObject(lua_State* state)
+  {
+    // The userdata contains a pointer to the C++ object, which is
+    // reset to NULL once the call is over
+    ILuaLazyObject** object = reinterpret_cast<ILuaLazyObject**>
+      (luaL_checkudata(state, 1, LAZY_OBJECT_METATABLE));
+    const char* name = luaL_checkstring(state, 2);
+
+    // No C++ exception must cross the Lua interpreter, and no C++
+    // object must be alive when "lua_error()" jumps out of this
+    // function
+    bool success = false;
+
+    if (*object == NULL)
+    {
+      lua_pushstring(state, "This object can only be accessed during the call to the function");
+    }
+    else if (!strcmp(name, LAZY_OBJECT_TO_TABLE))
+    {
+      lua_pushcfunction(state, LazyObjectToTable);
+      success = true;
+    }
+    else
+    {
+      try
+      {
+        Json::Value value;
+        if ((*object)->LookupField(value, name))
+        {
+          PushJSON(state, value);
+        }
+        else
+        {
+          lua_pushnil(state);
+        }
+
+        success = true;
+      }
+      catch (OrthancException& e)
+      {
+        lua_pushstring(state, e.What());
+      }
+      catch (...)
+      {
+        lua_pushstring(state, "Cannot read the field of an object");
+      }
+    }
+
+    if (success)
+    {
+      return 1;
+    }
+    else
+    {
+      return lua_error(state);
+    }
+  }
+
+  int LuaFunctionCall::LazyObjectToTable(lua_State* state)
+  {
+    // Called as "object:ToTable()"
+    ILuaLazyObject** object = reinterpret_cast<ILuaLazyObject**>
+      (luaL_checkudata(state, 1, LAZY_OBJECT_METATABLE));
+
+    // Same error handling as in "IndexLazyObject()"
+    bool success = false;
+
+    if (*object == NULL)
+    {
+      lua_pushstring(state, "This object can only be accessed during the call to the function");
+    }
+    else
+    {
+      try
+      {
+        Json::Value value;
+        (*object)->GetAllFields(value);
+        PushJSON(state, value);
+        success = true;
+      }
+      catch (OrthancException& e)
+      {
+        lua_pushstring(state, e.What());
+      }
+      catch (...)
+      {
+        lua_pushstring(state, "Cannot convert an object to a table");
+      }
+    }
+
+    if (success)
+    {
+      return 1;
+    }
+    else
+    {
+      return lua_error(state);
+    }
+  }
+
+  void LuaFunctionCall::PushLazyObject(ILuaLazyObject& object)
+  {
+    CheckAlreadyExecuted();
+
+    ILuaLazyObject** userdata = reinterpret_cast<ILuaLazyObject**>
+      (lua_newuserdata(context_.lua_, sizeof(ILuaLazyObject*)));
+    *userdata = &object;
+
+    if (luaL_newmetatable(context_.lua_, LAZY_OBJECT_METATABLE))
+    {
+      // First use of a lazy object in this Lua context
+      lua_pushcfunction(context_.lua_, IndexLazyObject);
+      lua_setfield(context_.lua_, -2, "__index");
+    }
+
+    lua_setmetatable(context_.lua_, -2);
+
+    // Keep a reference to the userdata, so as to invalidate it after
+    // the call
+    lua_pushvalue(context_.lua_, -1);
+    lazyObjects_.push_back(luaL_ref(context_.lua_, LUA_REGISTRYINDEX));
+  }
+
   void LuaFunctionCall::Execute(int numOutputs)
   {
     CheckAlreadyExecuted();
@@ -33,8 +33,10 @@
 #pragma once
 
 #include "LuaContext.h"
+#include "ILuaLazyObject.h"
 
 #include <json/json.h>
+#include <vector>
 
 
 namespace Orthanc
@@ -45,13 +47,23 @@ namespace Orthanc
     LuaContext& context_;
     boost::mutex::scoped_lock lock_;
     bool isExecuted_;
+    std::vector<int> lazyObjects_;
 
     void CheckAlreadyExecuted();
 
+    static void PushJSON(lua_State* state,
+                         const Json::Value& value);
+
+    static int IndexLazyObject(lua_State* state);
+
+    static int LazyObjectToTable(lua_State* state);
+
   public:
     LuaFunctionCall(LuaContext& context,
                     const char* functionName);
 
+    ~LuaFunctionCall();
+
     void PushString(const std::string& value);
 
     void PushBoolean(bool value);
@@ -62,6 +74,10 @@ namespace Orthanc
 
     void PushJSON(const Json::Value& value);
 
+    // The fields of the object are converted only if the function
+    // reads them. The object must outlive this call.
+    void PushLazyObject(ILuaLazyObject& object);
+
     void Execute(int numOutputs = 0);
 
     bool ExecutePredicate();
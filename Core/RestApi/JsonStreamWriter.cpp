@@ -0,0 +1,295 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "JsonStreamWriter.h"
+
+#include "../OrthancException.h"
+
+#include <boost/lexical_cast.hpp>
+
+namespace Orthanc
+{
+  // Same indentation as "Json::StyledWriter"
+  static const size_t INDENTATION = 3;
+
+
+  JsonStreamWriter::JsonStreamWriter(HttpOutput& target,
+                                     bool styled) :
+    target_(target),
+    styled_(styled),
+    hasKey_(false),
+    isComplete_(false)
+  {
+  }
+
+
+  void JsonStreamWriter::WriteNewLine()
+  {
+    if (styled_)
+    {
+      Write("\n" + std::string(INDENTATION * stack_.size(), ' '));
+    }
+  }
+
+
+  void JsonStreamWriter::StartValue()
+  {
+    if (isComplete_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    if (stack_.empty())
+    {
+      // Top-level value
+      return;
+    }
+
+    Level& level = stack_.back();
+
+    if (level.isObject_)
+    {
+      // The separator was written together with the key
+      if (!hasKey_)
+      {
+        throw OrthancException(ErrorCode_BadSequenceOfCalls);
+      }
+
+      hasKey_ = false;
+    }
+    else
+    {
+      if (!level.isEmpty_)
+      {
+        Write(",");
+      }
+
+      level.isEmpty_ = false;
+      WriteNewLine();
+    }
+  }
+
+
+  void JsonStreamWriter::EndValue()
+  {
+    if (stack_.empty())
+    {
+      isComplete_ = true;
+
+      if (styled_)
+      {
+        Write("\n");
+      }
+    }
+  }
+
+
+  void JsonStreamWriter::EndContainer(bool isObject,
+                                      const char* end)
+  {
+    if (stack_.empty() ||
+        stack_.back().isObject_ != isObject ||
+        hasKey_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    bool isEmpty = stack_.back().isEmpty_;
+    stack_.pop_back();
+
+    if (!isEmpty)
+    {
+      WriteNewLine();
+    }
+
+    Write(end);
+    EndValue();
+  }
+
+
+  void JsonStreamWriter::StartObject()
+  {
+    StartValue();
+    Write("{");
+    stack_.push_back(Level(true));
+  }
+
+
+  void JsonStreamWriter::EndObject()
+  {
+    EndContainer(true, "}");
+  }
+
+
+  void JsonStreamWriter::StartArray()
+  {
+    StartValue();
+    Write("[");
+    stack_.push_back(Level(false));
+  }
+
+
+  void JsonStreamWriter::EndArray()
+  {
+    EndContainer(false, "]");
+  }
+
+
+  void JsonStreamWriter::WriteKey(const std::string& key)
+  {
+    if (stack_.empty() ||
+        !stack_.back().isObject_ ||
+        hasKey_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    Level& level = stack_.back();
+    if (!level.isEmpty_)
+    {
+      Write(",");
+    }
+
+    level.isEmpty_ = false;
+    WriteNewLine();
+
+    Write(Json::valueToQuotedString(key.c_str()));
+    Write(styled_ ? " : " : ":");
+    hasKey_ = true;
+  }
+
+
+  void JsonStreamWriter::WriteNull()
+  {
+    StartValue();
+    Write("null");
+    EndValue();
+  }
+
+
+  void JsonStreamWriter::WriteBoolean(bool value)
+  {
+    StartValue();
+    Write(value ? "true" : "false");
+    EndValue();
+  }
+
+
+  void JsonStreamWriter::WriteInteger(int64_t value)
+  {
+    StartValue();
+    Write(boost::lexical_cast<std::string>(value));
+    EndValue();
+  }
+
+
+  void JsonStreamWriter::WriteUnsignedInteger(uint64_t value)
+  {
+    StartValue();
+    Write(boost::lexical_cast<std::string>(value));
+    EndValue();
+  }
+
+
+  void JsonStreamWriter::WriteDouble(double value)
+  {
+    StartValue();
+    Write(Json::valueToString(value));
+    EndValue();
+  }
+
+
+  void JsonStreamWriter::WriteString(const std::string& value)
+  {
+    StartValue();
+    Write(Json::valueToQuotedString(value.c_str()));
+    EndValue();
+  }
+
+
+  void JsonStreamWriter::WriteValue(const Json::Value& value)
+  {
+    switch (value.type())
+    {
+      case Json::nullValue:
+        WriteNull();
+        break;
+
+      case Json::booleanValue:
+        WriteBoolean(value.asBool());
+        break;
+
+      case Json::intValue:
+        WriteInteger(value.asLargestInt());
+        break;
+
+      case Json::uintValue:
+        WriteUnsignedInteger(value.asLargestUInt());
+        break;
+
+      case Json::realValue:
+        WriteDouble(value.asDouble());
+        break;
+
+      case Json::stringValue:
+        WriteString(value.asString());
+        break;
+
+      case Json::arrayValue:
+        StartArray();
+        for (Json::Value::ArrayIndex i = 0; i < value.size(); i++)
+        {
+          WriteValue(value[i]);
+        }
+        EndArray();
+        break;
+
+      case Json::objectValue:
+      {
+        StartObject();
+
+        Json::Value::Members members = value.getMemberNames();
+        for (size_t i = 0; i < members.size(); i++)
+        {
+          WriteKey(members[i]);
+          WriteValue(value[members[i]]);
+        }
+
+        EndObject();
+        break;
+      }
+
+      default:
+        throw OrthancException(ErrorCode_InternalError);
+    }
+  }
+}
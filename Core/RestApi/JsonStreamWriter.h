@@ -0,0 +1,123 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../HttpServer/HttpOutput.h"
+
+#include <json/json.h>
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+namespace Orthanc
+{
+  /**
+   * Writes a JSON document incrementally into an HTTP output, without
+   * building the tree of the whole document in memory. The output is
+   * compact, unless the styled format is requested (for humans). The
+   * calls are checked against the JSON grammar: Each member of an
+   * object must be preceded by a call to "WriteKey()".
+   **/
+  class JsonStreamWriter : public boost::noncopyable
+  {
+  private:
+    struct Level
+    {
+      bool isObject_;
+      bool isEmpty_;
+
+      Level(bool isObject) : isObject_(isObject), isEmpty_(true)
+      {
+      }
+    };
+
+    HttpOutput& target_;
+    bool styled_;
+    std::vector<Level> stack_;
+    bool hasKey_;
+    bool isComplete_;
+
+    void Write(const std::string& s)
+    {
+      target_.SendString(s);
+    }
+
+    void WriteNewLine();
+
+    void StartValue();
+
+    void EndValue();
+
+    void EndContainer(bool isObject,
+                      const char* end);
+
+  public:
+    JsonStreamWriter(HttpOutput& target,
+                     bool styled = false);
+
+    bool IsStyled() const
+    {
+      return styled_;
+    }
+
+    // Whether the top-level value has been entirely written
+    bool IsComplete() const
+    {
+      return isComplete_;
+    }
+
+    void StartObject();
+
+    void EndObject();
+
+    void StartArray();
+
+    void EndArray();
+
+    void WriteKey(const std::string& key);
+
+    void WriteNull();
+
+    void WriteBoolean(bool value);
+
+    void WriteInteger(int64_t value);
+
+    void WriteUnsignedInteger(uint64_t value);
+
+    void WriteDouble(double value);
+
+    void WriteString(const std::string& value);
+
+    // Writes a whole subtree, e.g. the description of one resource
+    void WriteValue(const Json::Value& value);
+  };
+}
@@ -32,6 +32,10 @@
 
 #include "RestApi.h"
 
+#include "RestApiHierarchy.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <stdlib.h>   // To define "_exit()" under Windows
 #include <glog/logging.h>
 
@@ -60,62 +64,143 @@ namespace Orthanc
   }
 
 
-  bool RestApi::IsGetAccepted(const UriComponents& uri)
+  namespace
   {
-    for (GetHandlers::const_iterator it = getHandlers_.begin();
-         it != getHandlers_.end(); ++it)
+    // Records the metrics of the route that served a request, once
+    // its answer has been sent. If the handler fails, the HTTP server
+    // sends the error answer before the metrics are recorded, so that
+    // its actual status is known.
+    class MetricsRecorder : public HttpOutput::IAnswerObserver
     {
-      if (it->first->Match(uri))
+    private:
+      uint64_t receivedBytes_;
+      uint64_t sentBytes_;
+      boost::posix_time::ptime start_;
+      RestApiMetrics* metrics_;
+
+    public:
+      MetricsRecorder(const HttpOutput& output,
+                      const HttpRequestBody& body) :
+        receivedBytes_(body.GetSize()),
+        sentBytes_(output.GetSentBytes()),
+        start_(boost::posix_time::microsec_clock::universal_time()),
+        metrics_(NULL)
       {
-        return true;
       }
-    }
 
-    return false;
-  }
+      virtual void SignalAnswerCompleted(const HttpOutput& output)
+      {
+        if (metrics_ == NULL)
+        {
+          return;
+        }
 
-  bool RestApi::IsPutAccepted(const UriComponents& uri)
-  {
-    for (PutHandlers::const_iterator it = putHandlers_.begin();
-         it != putHandlers_.end(); ++it)
-    {
-      if (it->first->Match(uri))
+        boost::posix_time::time_duration elapsed = 
+          boost::posix_time::microsec_clock::universal_time() - start_;
+
+        // If no answer was sent at all, the client sees the connection
+        // being closed, which is reported as an internal error
+        HttpStatus status = (output.IsHeaderSent() ? 
+                             output.GetStatus() : 
+                             HttpStatus_500_InternalServerError);
+
+        metrics_->Record(status, receivedBytes_, 
+                         output.GetSentBytes() - sentBytes_,
+                         elapsed.is_negative() ? 0 : elapsed.total_microseconds());
+      }
+
+      void SetMetrics(RestApiMetrics& metrics)
       {
-        return true;
+        metrics_ = &metrics;
       }
-    }
+    };
 
-    return false;
-  }
 
-  bool RestApi::IsPostAccepted(const UriComponents& uri)
-  {
-    for (PostHandlers::const_iterator it = postHandlers_.begin();
-         it != postHandlers_.end(); ++it)
+    // Calls the handler of the first resource that matches the URI
+    // and that accepts the HTTP method
+    class HandlerVisitor : public RestApiHierarchy::IVisitor
     {
-      if (it->first->Match(uri))
+    private:
+      MetricsRecorder& recorder_;
+      RestApiOutput& output_;
+      RestApi& context_;
+      HttpMethod method_;
+      const UriComponents& uri_;
+      const HttpHandler::Arguments& headers_;
+      const HttpHandler::Arguments& getArguments_;
+      HttpRequestBody& body_;
+
+    public:
+      HandlerVisitor(MetricsRecorder& recorder,
+                     RestApiOutput& output,
+                     RestApi& context,
+                     HttpMethod method,
+                     const UriComponents& uri,
+                     const HttpHandler::Arguments& headers,
+                     const HttpHandler::Arguments& getArguments,
+                     HttpRequestBody& body) :
+        recorder_(recorder),
+        output_(output),
+        context_(context),
+        method_(method),
+        uri_(uri),
+        headers_(headers),
+        getArguments_(getArguments),
+        body_(body)
       {
-        return true;
       }
-    }
 
-    return false;
-  }
-
-  bool RestApi::IsDeleteAccepted(const UriComponents& uri)
-  {
-    for (DeleteHandlers::const_iterator it = deleteHandlers_.begin();
-         it != deleteHandlers_.end(); ++it)
-    {
-      if (it->first->Match(uri))
+      virtual bool Visit(const RestApiHierarchy::Resource& resource,
+                         const RestApiPath::Components& components,
+                         const UriComponents& trailing)
       {
+        if (!resource.HasHandler(method_))
+        {
+          return false;
+        }
+
+        recorder_.SetMetrics(resource.GetMetrics(method_));
+
+        switch (method_)
+        {
+          case HttpMethod_Get:
+          {
+            RestApi::GetCall call(output_, context_, headers_, components, trailing, uri_, getArguments_);
+            resource.GetGetHandler() (call);
+            break;
+          }
+
+          case HttpMethod_Put:
+          {
+            RestApi::PutCall call(output_, context_, headers_, components, trailing, uri_, body_);
+            resource.GetPutHandler() (call);
+            break;
+          }
+
+          case HttpMethod_Post:
+          {
+            RestApi::PostCall call(output_, context_, headers_, components, trailing, uri_, body_);
+            resource.GetPostHandler() (call);
+            break;
+          }
+
+          case HttpMethod_Delete:
+          {
+            RestApi::DeleteCall call(output_, context_, headers_, components, trailing, uri_);
+            resource.GetDeleteHandler() (call);
+            break;
+          }
+
+          default:
+            return false;
+        }
+
         return true;
       }
-    }
-
-    return false;
+    };
   }
 
+
   static void AddMethod(std::string& target,
                         const std::string& method)
   {
@@ -127,56 +212,37 @@ namespace Orthanc
 
   std::string  RestApi::GetAcceptedMethods(const UriComponents& uri)
   {
+    std::set<HttpMethod> methods;
+    root_->GetAcceptedMethods(methods, uri);
+
     std::string s;
 
-    if (IsGetAccepted(uri))
+    if (methods.find(HttpMethod_Get) != methods.end())
       AddMethod(s, "GET");
 
-    if (IsPutAccepted(uri))
+    if (methods.find(HttpMethod_Put) != methods.end())
       AddMethod(s, "PUT");
 
-    if (IsPostAccepted(uri))
+    if (methods.find(HttpMethod_Post) != methods.end())
       AddMethod(s, "POST");
 
-    if (IsDeleteAccepted(uri))
+    if (methods.find(HttpMethod_Delete) != methods.end())
       AddMethod(s, "DELETE");
 
     return s;
   }
 
-  RestApi::~RestApi()
+  RestApi::RestApi() : root_(new RestApiHierarchy)
   {
-    for (GetHandlers::iterator it = getHandlers_.begin(); 
-         it != getHandlers_.end(); ++it)
-    {
-      delete it->first;
-    } 
-
-    for (PutHandlers::iterator it = putHandlers_.begin(); 
-         it != putHandlers_.end(); ++it)
-    {
-      delete it->first;
-    } 
-
-    for (PostHandlers::iterator it = postHandlers_.begin(); 
-         it != postHandlers_.end(); ++it)
-    {
-      delete it->first;
-    } 
+  }
 
-    for (DeleteHandlers::iterator it = deleteHandlers_.begin(); 
-         it != deleteHandlers_.end(); ++it)
-    {
-      delete it->first;
-    } 
+  RestApi::~RestApi()
+  {
   }
 
   bool RestApi::IsServedUri(const UriComponents& uri)
   {
-    return (IsGetAccepted(uri) ||
-            IsPutAccepted(uri) ||
-            IsPostAccepted(uri) ||
-            IsDeleteAccepted(uri));
+    return root_->IsServedUri(uri);
   }
 
   void RestApi::Handle(HttpOutput& output,
@@ -184,71 +250,19 @@ namespace Orthanc
                        const UriComponents& uri,
                        const Arguments& headers,
                        const Arguments& getArguments,
-                       const std::string& postData)
+                       HttpRequestBody& body)
   {
-    bool ok = false;
+    // The recorder is owned by the output, which notifies it once the
+    // answer is complete
+    MetricsRecorder* recorder = new MetricsRecorder(output, body);
+    output.SetAnswerObserver(recorder);
+
     RestApiOutput restOutput(output);
-    RestApiPath::Components components;
-    UriComponents trailing;
+    restOutput.SetStyledJson(getArguments.find("pretty") != getArguments.end());
 
-    if (method == HttpMethod_Get)
-    {
-      for (GetHandlers::const_iterator it = getHandlers_.begin();
-           it != getHandlers_.end(); ++it)
-      {
-        if (it->first->Match(components, trailing, uri))
-        {
-          //LOG(INFO) << "REST GET call on: " << Toolbox::FlattenUri(uri);
-          ok = true;
-          GetCall call(restOutput, *this, headers, components, trailing, uri, getArguments);
-          it->second(call);
-        }
-      }
-    }
-    else if (method == HttpMethod_Put)
-    {
-      for (PutHandlers::const_iterator it = putHandlers_.begin();
-           it != putHandlers_.end(); ++it)
-      {
-        if (it->first->Match(components, trailing, uri))
-        {
-          //LOG(INFO) << "REST PUT call on: " << Toolbox::FlattenUri(uri);
-          ok = true;
-          PutCall call(restOutput, *this, headers, components, trailing, uri, postData);
-          it->second(call);
-        }
-      }
-    }
-    else if (method == HttpMethod_Post)
-    {
-      for (PostHandlers::const_iterator it = postHandlers_.begin();
-           it != postHandlers_.end(); ++it)
-      {
-        if (it->first->Match(components, trailing, uri))
-        {
-          //LOG(INFO) << "REST POST call on: " << Toolbox::FlattenUri(uri);
-          ok = true;
-          PostCall call(restOutput, *this, headers, components, trailing, uri, postData);
-          it->second(call);
-        }
-      }
-    }
-    else if (method == HttpMethod_Delete)
-    {
-      for (DeleteHandlers::const_iterator it = deleteHandlers_.begin();
-           it != deleteHandlers_.end(); ++it)
-      {
-        if (it->first->Match(components, trailing, uri))
-        {
-          //LOG(INFO) << "REST DELETE call on: " << Toolbox::FlattenUri(uri);
-          ok = true;
-          DeleteCall call(restOutput, *this, headers, components, trailing, uri);
-          it->second(call);
-        }
-      }
-    }
+    HandlerVisitor visitor(*recorder, restOutput, *this, method, uri, headers, getArguments, body);
 
-    if (!ok)
+    if (!root_->LookupResource(uri, visitor))
     {
       LOG(INFO) << "REST method " << EnumerationToString(method) 
                 << " not allowed on: " << Toolbox::FlattenUri(uri);
@@ -259,24 +273,116 @@ namespace Orthanc
   void RestApi::Register(const std::string& path,
                          GetHandler handler)
   {
-    getHandlers_.push_back(std::make_pair(new RestApiPath(path), handler));
+    root_->Register(path, handler);
   }
 
   void RestApi::Register(const std::string& path,
                          PutHandler handler)
   {
-    putHandlers_.push_back(std::make_pair(new RestApiPath(path), handler));
+    root_->Register(path, handler);
   }
 
   void RestApi::Register(const std::string& path,
                          PostHandler handler)
   {
-    postHandlers_.push_back(std::make_pair(new RestApiPath(path), handler));
+    root_->Register(path, handler);
   }
 
   void RestApi::Register(const std::string& path,
                          DeleteHandler handler)
   {
-    deleteHandlers_.push_back(std::make_pair(new RestApiPath(path), handler));
+    root_->Register(path, handler);
+  }
+
+  static const unsigned int METHODS_COUNT = 4;
+  static const HttpMethod METHODS[METHODS_COUNT] = {
+    HttpMethod_Get,
+    HttpMethod_Put,
+    HttpMethod_Post,
+    HttpMethod_Delete
+  };
+
+  static std::string EscapePrometheusLabel(const std::string& value)
+  {
+    std::string s;
+    s.reserve(value.size());
+
+    for (size_t i = 0; i < value.size(); i++)
+    {
+      switch (value[i])
+      {
+        case '\\':
+          s += "\\\\";
+          break;
+
+        case '"':
+          s += "\\\"";
+          break;
+
+        case '\n':
+          s += "\\n";
+          break;
+
+        default:
+          s += value[i];
+      }
+    }
+
+    return s;
+  }
+
+  void RestApi::GetRoutesMetrics(Json::Value& target)
+  {
+    std::list<const RestApiHierarchy::Resource*> resources;
+    root_->ListResources(resources);
+
+    target = Json::arrayValue;
+
+    for (std::list<const RestApiHierarchy::Resource*>::const_iterator
+           it = resources.begin(); it != resources.end(); ++it)
+    {
+      for (unsigned int i = 0; i < METHODS_COUNT; i++)
+      {
+        if ((*it)->HasHandler(METHODS[i]))
+        {
+          Json::Value route;
+          (*it)->GetMetrics(METHODS[i]).Format(route);
+          route["Method"] = EnumerationToString(METHODS[i]);
+          route["Route"] = (*it)->GetPath();
+          target.append(route);
+        }
+      }
+    }
+  }
+
+  void RestApi::FormatPrometheus(std::string& target)
+  {
+    std::list<const RestApiHierarchy::Resource*> resources;
+    root_->ListResources(resources);
+
+    RestApiMetrics::LabeledSnapshots snapshots;
+
+    for (std::list<const RestApiHierarchy::Resource*>::const_iterator
+           it = resources.begin(); it != resources.end(); ++it)
+    {
+      for (unsigned int i = 0; i < METHODS_COUNT; i++)
+      {
+        if ((*it)->HasHandler(METHODS[i]))
+        {
+          RestApiMetrics::Snapshot snapshot;
+          (*it)->GetMetrics(METHODS[i]).GetSnapshot(snapshot);
+
+          // Only the routes that have been called are reported
+          if (snapshot.count_ > 0)
+          {
+            std::string labels = ("method=\"" + std::string(EnumerationToString(METHODS[i])) + 
+                                  "\",route=\"" + EscapePrometheusLabel((*it)->GetPath()) + "\"");
+            snapshots.push_back(std::make_pair(labels, snapshot));
+          }
+        }
+      }
+    }
+
+    RestApiMetrics::FormatPrometheus(target, snapshots);
   }
 }
@@ -36,10 +36,12 @@
 #include "RestApiPath.h"
 #include "RestApiOutput.h"
 
-#include <list>
+#include <memory>
 
 namespace Orthanc
 {
+  class RestApiHierarchy;
+
   class RestApi : public HttpHandler
   {
   public:
@@ -161,7 +163,7 @@ namespace Orthanc
       friend class RestApi;
 
     private:
-      const std::string& data_;
+      HttpRequestBody& body_;
 
     public:
       PutCall(RestApiOutput& output,
@@ -170,15 +172,22 @@ namespace Orthanc
               const RestApiPath::Components& uriComponents,
               const UriComponents& trailing,
               const UriComponents& fullUri,
-              const std::string& data) :
+              HttpRequestBody& body) :
         Call(output, context, httpHeaders, uriComponents, trailing, fullUri),
-        data_(data)
+        body_(body)
       {
       }
 
+      // The whole body, copied in memory
       const std::string& GetPutBody() const
       {
-        return data_;
+        return body_.GetContent();
+      }
+
+      // Streaming access to the body, for the large uploads
+      HttpRequestBody& GetBody() const
+      {
+        return body_;
       }
 
       virtual bool ParseJsonRequest(Json::Value& result) const
@@ -192,7 +201,7 @@ namespace Orthanc
       friend class RestApi;
 
     private:
-      const std::string& data_;
+      HttpRequestBody& body_;
 
     public:
       PostCall(RestApiOutput& output,
@@ -201,15 +210,22 @@ namespace Orthanc
                const RestApiPath::Components& uriComponents,
                const UriComponents& trailing,
                const UriComponents& fullUri,
-               const std::string& data) :
+               HttpRequestBody& body) :
         Call(output, context, httpHeaders, uriComponents, trailing, fullUri),
-        data_(data)
+        body_(body)
       {
       }
 
+      // The whole body, copied in memory
       const std::string& GetPostBody() const
       {
-        return data_;
+        return body_.GetContent();
+      }
+
+      // Streaming access to the body, for the large uploads
+      HttpRequestBody& GetBody() const
+      {
+        return body_;
       }
 
       virtual bool ParseJsonRequest(Json::Value& result) const
@@ -247,27 +263,12 @@ namespace Orthanc
     typedef void (*PostHandler) (PostCall& call);
     
   private:
-    typedef std::list< std::pair<RestApiPath*, GetHandler> > GetHandlers;
-    typedef std::list< std::pair<RestApiPath*, PutHandler> > PutHandlers;
-    typedef std::list< std::pair<RestApiPath*, PostHandler> > PostHandlers;
-    typedef std::list< std::pair<RestApiPath*, DeleteHandler> > DeleteHandlers;
-
-    GetHandlers  getHandlers_;
-    PutHandlers  putHandlers_;
-    PostHandlers  postHandlers_;
-    DeleteHandlers  deleteHandlers_;
-
-    bool IsGetAccepted(const UriComponents& uri);
-    bool IsPutAccepted(const UriComponents& uri);
-    bool IsPostAccepted(const UriComponents& uri);
-    bool IsDeleteAccepted(const UriComponents& uri);
+    std::auto_ptr<RestApiHierarchy>  root_;
 
     std::string  GetAcceptedMethods(const UriComponents& uri);
 
   public:
-    RestApi()
-    {
-    }
+    RestApi();
 
     ~RestApi();
 
@@ -278,7 +279,7 @@ namespace Orthanc
                         const UriComponents& uri,
                         const Arguments& headers,
                         const Arguments& getArguments,
-                        const std::string& postData);
+                        HttpRequestBody& body);
 
     void Register(const std::string& path,
                   GetHandler handler);
@@ -291,5 +292,11 @@ namespace Orthanc
 
     void Register(const std::string& path,
                   DeleteHandler handler);
+
+    // Metrics about the calls to each route of the REST API
+    void GetRoutesMetrics(Json::Value& target);
+
+    // Same metrics, in the text exposition format of Prometheus
+    void FormatPrometheus(std::string& target);
   };
 }
@@ -0,0 +1,420 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "RestApiHierarchy.h"
+
+#include "../OrthancException.h"
+
+#include <cassert>
+
+namespace Orthanc
+{
+  RestApiHierarchy::Resource::Resource() :
+    getHandler_(NULL),
+    putHandler_(NULL),
+    postHandler_(NULL),
+    deleteHandler_(NULL)
+  {
+  }
+
+
+  bool RestApiHierarchy::Resource::HasHandler(HttpMethod method) const
+  {
+    switch (method)
+    {
+      case HttpMethod_Get:
+        return getHandler_ != NULL;
+
+      case HttpMethod_Put:
+        return putHandler_ != NULL;
+
+      case HttpMethod_Post:
+        return postHandler_ != NULL;
+
+      case HttpMethod_Delete:
+        return deleteHandler_ != NULL;
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  RestApiMetrics& RestApiHierarchy::Resource::GetMetrics(HttpMethod method) const
+  {
+    RestApiMetrics* metrics = NULL;
+
+    switch (method)
+    {
+      case HttpMethod_Get:
+        metrics = getMetrics_.get();
+        break;
+
+      case HttpMethod_Put:
+        metrics = putMetrics_.get();
+        break;
+
+      case HttpMethod_Post:
+        metrics = postMetrics_.get();
+        break;
+
+      case HttpMethod_Delete:
+        metrics = deleteMetrics_.get();
+        break;
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    if (metrics == NULL)
+    {
+      throw OrthancException(ErrorCode_InexistentItem);
+    }
+
+    return *metrics;
+  }
+
+
+  bool RestApiHierarchy::Resource::IsEmpty() const
+  {
+    return (getHandler_ == NULL &&
+            putHandler_ == NULL &&
+            postHandler_ == NULL &&
+            deleteHandler_ == NULL);
+  }
+
+
+  // Two handlers for the same method on the same URI is a programming
+  // error, as only one of them could be reached
+  template <typename Handler>
+  static void SetHandler(Handler& target,
+                         Handler handler)
+  {
+    if (target != NULL)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    target = handler;
+  }
+
+
+  void RestApiHierarchy::Resource::Register(RestApi::GetHandler handler)
+  {
+    SetHandler(getHandler_, handler);
+    getMetrics_.reset(new RestApiMetrics);
+  }
+
+
+  void RestApiHierarchy::Resource::Register(RestApi::PutHandler handler)
+  {
+    SetHandler(putHandler_, handler);
+    putMetrics_.reset(new RestApiMetrics);
+  }
+
+
+  void RestApiHierarchy::Resource::Register(RestApi::PostHandler handler)
+  {
+    SetHandler(postHandler_, handler);
+    postMetrics_.reset(new RestApiMetrics);
+  }
+
+
+  void RestApiHierarchy::Resource::Register(RestApi::DeleteHandler handler)
+  {
+    SetHandler(deleteHandler_, handler);
+    deleteMetrics_.reset(new RestApiMetrics);
+  }
+
+
+  RestApiHierarchy& RestApiHierarchy::AddChild(Children& children,
+                                               const std::string& name)
+  {
+    Children::iterator it = children.find(name);
+
+    if (it == children.end())
+    {
+      RestApiHierarchy* child = new RestApiHierarchy;
+      children[name] = child;
+      return *child;
+    }
+    else
+    {
+      return *it->second;
+    }
+  }
+
+
+  void RestApiHierarchy::DeleteChildren(Children& children)
+  {
+    for (Children::iterator it = children.begin(); 
+         it != children.end(); ++it)
+    {
+      delete it->second;
+    }
+
+    children.clear();
+  }
+
+
+  RestApiHierarchy::~RestApiHierarchy()
+  {
+    DeleteChildren(children_);
+    DeleteChildren(wildcardChildren_);
+  }
+
+
+  RestApiHierarchy::Resource& RestApiHierarchy::CreateResource(const UriComponents& path,
+                                                               size_t level,
+                                                               bool hasTrailing)
+  {
+    if (level == path.size())
+    {
+      return hasTrailing ? universalHandlers_ : handlers_;
+    }
+
+    const std::string& component = path[level];
+    size_t s = component.size();
+    assert(s > 0);
+
+    if (component[0] == '{' && 
+        component[s - 1] == '}')
+    {
+      // This URI component is a free parameter
+      return AddChild(wildcardChildren_, component.substr(1, s - 2)).
+        CreateResource(path, level + 1, hasTrailing);
+    }
+    else
+    {
+      return AddChild(children_, component).
+        CreateResource(path, level + 1, hasTrailing);
+    }
+  }
+
+
+  RestApiHierarchy::Resource& RestApiHierarchy::CreateResource(const std::string& path)
+  {
+    UriComponents uri;
+    Toolbox::SplitUriComponents(uri, path);
+
+    bool hasTrailing = false;
+    if (uri.size() > 0 &&
+        uri.back() == "*")
+    {
+      hasTrailing = true;
+      uri.pop_back();
+    }
+
+    Resource& resource = CreateResource(uri, 0, hasTrailing);
+    resource.SetPath(path);
+    return resource;
+  }
+
+
+  bool RestApiHierarchy::LookupResource(RestApiPath::Components& components,
+                                        const UriComponents& uri,
+                                        IVisitor& visitor,
+                                        size_t level)
+  {
+    assert(level <= uri.size());
+
+    if (level == uri.size())
+    {
+      if (!handlers_.IsEmpty() &&
+          visitor.Visit(handlers_, components, UriComponents()))
+      {
+        return true;
+      }
+    }
+    else
+    {
+      Children::const_iterator child = children_.find(uri[level]);
+      if (child != children_.end() &&
+          child->second->LookupResource(components, uri, visitor, level + 1))
+      {
+        return true;
+      }
+
+      for (child = wildcardChildren_.begin(); 
+           child != wildcardChildren_.end(); ++child)
+      {
+        components[child->first] = uri[level];
+
+        if (child->second->LookupResource(components, uri, visitor, level + 1))
+        {
+          return true;
+        }
+
+        components.erase(child->first);
+      }
+    }
+
+    if (!universalHandlers_.IsEmpty())
+    {
+      UriComponents trailing(uri.begin() + level, uri.end());
+      return visitor.Visit(universalHandlers_, components, trailing);
+    }
+
+    return false;
+  }
+
+
+  bool RestApiHierarchy::LookupResource(const UriComponents& uri,
+                                        IVisitor& visitor)
+  {
+    RestApiPath::Components components;
+    return LookupResource(components, uri, visitor, 0);
+  }
+
+
+  void RestApiHierarchy::Register(const std::string& path,
+                                  RestApi::GetHandler handler)
+  {
+    CreateResource(path).Register(handler);
+  }
+
+
+  void RestApiHierarchy::Register(const std::string& path,
+                                  RestApi::PutHandler handler)
+  {
+    CreateResource(path).Register(handler);
+  }
+
+
+  void RestApiHierarchy::Register(const std::string& path,
+                                  RestApi::PostHandler handler)
+  {
+    CreateResource(path).Register(handler);
+  }
+
+
+  void RestApiHierarchy::Register(const std::string& path,
+                                  RestApi::DeleteHandler handler)
+  {
+    CreateResource(path).Register(handler);
+  }
+
+
+  namespace
+  {
+    class ServedUriVisitor : public RestApiHierarchy::IVisitor
+    {
+    public:
+      virtual bool Visit(const RestApiHierarchy::Resource& resource,
+                         const RestApiPath::Components& components,
+                         const UriComponents& trailing)
+      {
+        // Only the resources with at least one handler are visited
+        return true;
+      }
+    };
+
+
+    class AcceptedMethodsVisitor : public RestApiHierarchy::IVisitor
+    {
+    private:
+      std::set<HttpMethod>& methods_;
+
+      void Check(const RestApiHierarchy::Resource& resource,
+                 HttpMethod method)
+      {
+        if (resource.HasHandler(method))
+        {
+          methods_.insert(method);
+        }
+      }
+
+    public:
+      AcceptedMethodsVisitor(std::set<HttpMethod>& methods) : methods_(methods)
+      {
+      }
+
+      virtual bool Visit(const RestApiHierarchy::Resource& resource,
+                         const RestApiPath::Components& components,
+                         const UriComponents& trailing)
+      {
+        Check(resource, HttpMethod_Get);
+        Check(resource, HttpMethod_Put);
+        Check(resource, HttpMethod_Post);
+        Check(resource, HttpMethod_Delete);
+
+        // Continue the lookup, to collect all the matching resources
+        return false;
+      }
+    };
+  }
+
+
+  void RestApiHierarchy::GetAcceptedMethods(std::set<HttpMethod>& methods,
+                                            const UriComponents& uri)
+  {
+    methods.clear();
+
+    AcceptedMethodsVisitor visitor(methods);
+    LookupResource(uri, visitor);
+  }
+
+
+  void RestApiHierarchy::ListResources(std::list<const Resource*>& target,
+                                       const Children& children)
+  {
+    for (Children::const_iterator it = children.begin();
+         it != children.end(); ++it)
+    {
+      it->second->ListResources(target);
+    }
+  }
+
+
+  void RestApiHierarchy::ListResources(std::list<const Resource*>& target) const
+  {
+    if (!handlers_.IsEmpty())
+    {
+      target.push_back(&handlers_);
+    }
+
+    if (!universalHandlers_.IsEmpty())
+    {
+      target.push_back(&universalHandlers_);
+    }
+
+    ListResources(target, children_);
+    ListResources(target, wildcardChildren_);
+  }
+
+
+  bool RestApiHierarchy::IsServedUri(const UriComponents& uri)
+  {
+    ServedUriVisitor visitor;
+    return LookupResource(uri, visitor);
+  }
+}
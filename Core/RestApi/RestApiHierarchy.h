@@ -0,0 +1,196 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "RestApi.h"
+#include "RestApiMetrics.h"
+
+#include <boost/noncopyable.hpp>
+#include <set>
+
+namespace Orthanc
+{
+  /**
+   * Prefix tree of the URIs served by a REST API. Each level of the
+   * tree corresponds to one component of the URI: The constant
+   * components are looked up in a table indexed by their value, and
+   * the free parameters (e.g. "{id}") are stored as wildcard
+   * children. The handlers registered with a trailing "*" match all
+   * the URIs that are below their node. The cost of a lookup thus
+   * depends on the depth of the URI, not on the number of routes.
+   **/
+  class RestApiHierarchy : public boost::noncopyable
+  {
+  public:
+    class Resource : public boost::noncopyable
+    {
+    private:
+      RestApi::GetHandler     getHandler_;
+      RestApi::PutHandler     putHandler_;
+      RestApi::PostHandler    postHandler_;
+      RestApi::DeleteHandler  deleteHandler_;
+
+      std::string path_;
+      std::auto_ptr<RestApiMetrics>  getMetrics_;
+      std::auto_ptr<RestApiMetrics>  putMetrics_;
+      std::auto_ptr<RestApiMetrics>  postMetrics_;
+      std::auto_ptr<RestApiMetrics>  deleteMetrics_;
+
+    public:
+      Resource();
+
+      // Template of the route, as it was registered
+      const std::string& GetPath() const
+      {
+        return path_;
+      }
+
+      void SetPath(const std::string& path)
+      {
+        path_ = path;
+      }
+
+      bool HasHandler(HttpMethod method) const;
+
+      // Metrics about the calls to the handler of some HTTP method
+      RestApiMetrics& GetMetrics(HttpMethod method) const;
+
+      bool IsEmpty() const;
+
+      void Register(RestApi::GetHandler handler);
+
+      void Register(RestApi::PutHandler handler);
+
+      void Register(RestApi::PostHandler handler);
+
+      void Register(RestApi::DeleteHandler handler);
+
+      RestApi::GetHandler GetGetHandler() const
+      {
+        return getHandler_;
+      }
+
+      RestApi::PutHandler GetPutHandler() const
+      {
+        return putHandler_;
+      }
+
+      RestApi::PostHandler GetPostHandler() const
+      {
+        return postHandler_;
+      }
+
+      RestApi::DeleteHandler GetDeleteHandler() const
+      {
+        return deleteHandler_;
+      }
+    };
+
+
+    class IVisitor
+    {
+    public:
+      virtual ~IVisitor()
+      {
+      }
+
+      // Returns "true" to stop the lookup
+      virtual bool Visit(const Resource& resource,
+                         const RestApiPath::Components& components,
+                         const UriComponents& trailing) = 0;
+    };
+
+
+  private:
+    typedef std::map<std::string, RestApiHierarchy*>  Children;
+
+    Resource  handlers_;
+    Resource  universalHandlers_;
+    Children  children_;
+    Children  wildcardChildren_;
+
+    static RestApiHierarchy& AddChild(Children& children,
+                                      const std::string& name);
+
+    static void DeleteChildren(Children& children);
+
+    Resource& CreateResource(const UriComponents& path,
+                             size_t level,
+                             bool hasTrailing);
+
+    Resource& CreateResource(const std::string& path);
+
+    bool LookupResource(RestApiPath::Components& components,
+                        const UriComponents& uri,
+                        IVisitor& visitor,
+                        size_t level);
+
+    static void ListResources(std::list<const Resource*>& target,
+                              const Children& children);
+
+  public:
+    RestApiHierarchy()
+    {
+    }
+
+    ~RestApiHierarchy();
+
+    void Register(const std::string& path,
+                  RestApi::GetHandler handler);
+
+    void Register(const std::string& path,
+                  RestApi::PutHandler handler);
+
+    void Register(const std::string& path,
+                  RestApi::PostHandler handler);
+
+    void Register(const std::string& path,
+                  RestApi::DeleteHandler handler);
+
+    /**
+     * Visits the resources matching the URI, until the visitor
+     * returns "true". The constant components have priority over the
+     * free parameters, which have priority over the trailing "*".
+     **/
+    bool LookupResource(const UriComponents& uri,
+                        IVisitor& visitor);
+
+    bool IsServedUri(const UriComponents& uri);
+
+    void GetAcceptedMethods(std::set<HttpMethod>& methods,
+                            const UriComponents& uri);
+
+    // Lists the resources that have at least one handler
+    void ListResources(std::list<const Resource*>& target) const;
+  };
+}
@@ -0,0 +1,228 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "RestApiMetrics.h"
+
+#include <stdio.h>
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+namespace Orthanc
+{
+  const unsigned int RestApiMetrics::BUCKETS[BUCKETS_COUNT - 1] = {
+    1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 5000
+  };
+
+
+  RestApiMetrics::Shard::Shard() :
+    count_(0),
+    bytesIn_(0),
+    bytesOut_(0),
+    totalLatency_(0)
+  {
+    for (unsigned int i = 0; i < BUCKETS_COUNT; i++)
+    {
+      buckets_[i] = 0;
+    }
+  }
+
+
+  void RestApiMetrics::Record(HttpStatus status,
+                              uint64_t bytesIn,
+                              uint64_t bytesOut,
+                              uint64_t latency)
+  {
+    unsigned int bucket = 0;
+    while (bucket < BUCKETS_COUNT - 1 &&
+           latency > static_cast<uint64_t>(BUCKETS[bucket]) * 1000)
+    {
+      bucket++;
+    }
+
+    boost::hash<boost::thread::id> hasher;
+    Shard& shard = shards_[hasher(boost::this_thread::get_id()) % SHARDS_COUNT];
+
+    boost::mutex::scoped_lock lock(shard.mutex_);
+    shard.count_++;
+    shard.bytesIn_ += bytesIn;
+    shard.bytesOut_ += bytesOut;
+    shard.totalLatency_ += latency;
+    shard.buckets_[bucket]++;
+    shard.statuses_[status]++;
+  }
+
+
+  void RestApiMetrics::GetSnapshot(Snapshot& target)
+  {
+    target.count_ = 0;
+    target.bytesIn_ = 0;
+    target.bytesOut_ = 0;
+    target.totalLatency_ = 0;
+    target.statuses_.clear();
+
+    for (unsigned int i = 0; i < BUCKETS_COUNT; i++)
+    {
+      target.buckets_[i] = 0;
+    }
+
+    for (unsigned int s = 0; s < SHARDS_COUNT; s++)
+    {
+      Shard& shard = shards_[s];
+      boost::mutex::scoped_lock lock(shard.mutex_);
+
+      target.count_ += shard.count_;
+      target.bytesIn_ += shard.bytesIn_;
+      target.bytesOut_ += shard.bytesOut_;
+      target.totalLatency_ += shard.totalLatency_;
+
+      for (unsigned int i = 0; i < BUCKETS_COUNT; i++)
+      {
+        target.buckets_[i] += shard.buckets_[i];
+      }
+
+      for (Statuses::const_iterator it = shard.statuses_.begin();
+           it != shard.statuses_.end(); ++it)
+      {
+        target.statuses_[it->first] += it->second;
+      }
+    }
+  }
+
+
+  static std::string ToString(uint64_t value)
+  {
+    return boost::lexical_cast<std::string>(value);
+  }
+
+
+  void RestApiMetrics::Format(Json::Value& target)
+  {
+    Snapshot snapshot;
+    GetSnapshot(snapshot);
+
+    target = Json::objectValue;
+    target["Count"] = ToString(snapshot.count_);
+    target["BytesIn"] = ToString(snapshot.bytesIn_);
+    target["BytesOut"] = ToString(snapshot.bytesOut_);
+
+    if (snapshot.count_ > 0)
+    {
+      target["AverageLatency"] = (static_cast<double>(snapshot.totalLatency_) / 
+                                  static_cast<double>(snapshot.count_) / 1000.0);
+    }
+
+    Json::Value statuses = Json::objectValue;
+    for (Statuses::const_iterator it = snapshot.statuses_.begin();
+         it != snapshot.statuses_.end(); ++it)
+    {
+      statuses[boost::lexical_cast<std::string>(static_cast<int>(it->first))] = ToString(it->second);
+    }
+
+    target["Statuses"] = statuses;
+
+    // Keys are the upper bounds of the buckets, in milliseconds
+    Json::Value histogram = Json::objectValue;
+    for (unsigned int i = 0; i < BUCKETS_COUNT; i++)
+    {
+      std::string bound = (i == BUCKETS_COUNT - 1 ? "+Inf" : boost::lexical_cast<std::string>(BUCKETS[i]));
+      histogram[bound] = ToString(snapshot.buckets_[i]);
+    }
+
+    target["Latencies"] = histogram;
+  }
+
+
+  static std::string FormatSeconds(uint64_t microseconds)
+  {
+    char buffer[64];
+    // Microsecond precision, whatever the magnitude
+    sprintf(buffer, "%.6f", static_cast<double>(microseconds) / 1000000.0);
+    return buffer;
+  }
+
+
+  void RestApiMetrics::FormatPrometheus(std::string& target,
+                                        const LabeledSnapshots& snapshots)
+  {
+    LabeledSnapshots::const_iterator it;
+
+    target += "# HELP orthanc_http_requests_total Number of REST requests, by route and status\n";
+    target += "# TYPE orthanc_http_requests_total counter\n";
+    for (it = snapshots.begin(); it != snapshots.end(); ++it)
+    {
+      for (Statuses::const_iterator status = it->second.statuses_.begin();
+           status != it->second.statuses_.end(); ++status)
+      {
+        target += ("orthanc_http_requests_total{" + it->first + ",status=\"" + 
+                   boost::lexical_cast<std::string>(static_cast<int>(status->first)) + "\"} " + 
+                   ToString(status->second) + "\n");
+      }
+    }
+
+    target += "# HELP orthanc_http_request_bytes_total Bytes received in the body of the REST requests\n";
+    target += "# TYPE orthanc_http_request_bytes_total counter\n";
+    for (it = snapshots.begin(); it != snapshots.end(); ++it)
+    {
+      target += "orthanc_http_request_bytes_total{" + it->first + "} " + ToString(it->second.bytesIn_) + "\n";
+    }
+
+    target += "# HELP orthanc_http_response_bytes_total Bytes sent in the answers to the REST requests\n";
+    target += "# TYPE orthanc_http_response_bytes_total counter\n";
+    for (it = snapshots.begin(); it != snapshots.end(); ++it)
+    {
+      target += "orthanc_http_response_bytes_total{" + it->first + "} " + ToString(it->second.bytesOut_) + "\n";
+    }
+
+    target += "# HELP orthanc_http_request_duration_seconds Latency of the REST requests\n";
+    target += "# TYPE orthanc_http_request_duration_seconds histogram\n";
+    for (it = snapshots.begin(); it != snapshots.end(); ++it)
+    {
+      // The buckets of Prometheus are cumulative
+      uint64_t cumulated = 0;
+      for (unsigned int i = 0; i < BUCKETS_COUNT; i++)
+      {
+        cumulated += it->second.buckets_[i];
+
+        std::string bound = (i == BUCKETS_COUNT - 1 ? "+Inf" : 
+                             FormatSeconds(static_cast<uint64_t>(BUCKETS[i]) * 1000));
+        target += ("orthanc_http_request_duration_seconds_bucket{" + it->first + 
+                   ",le=\"" + bound + "\"} " + ToString(cumulated) + "\n");
+      }
+
+      target += ("orthanc_http_request_duration_seconds_sum{" + it->first + "} " + 
+                 FormatSeconds(it->second.totalLatency_) + "\n");
+      target += ("orthanc_http_request_duration_seconds_count{" + it->first + "} " + 
+                 ToString(it->second.count_) + "\n");
+    }
+  }
+}
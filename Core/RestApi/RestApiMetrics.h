@@ -0,0 +1,113 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../Enumerations.h"
+
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <json/json.h>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Orthanc
+{
+  /**
+   * Metrics about the calls to one route of a REST API (for one HTTP
+   * method): Number of requests, status of the answers, bytes
+   * received and sent, and histogram of the latencies. To avoid the
+   * contention between the threads of the HTTP server, the counters
+   * are sharded according to the identifier of the calling thread:
+   * The shards are only merged when the metrics are read.
+   **/
+  class RestApiMetrics : public boost::noncopyable
+  {
+  public:
+    // Upper bounds of the buckets of the latency histogram, in
+    // milliseconds. The last bucket has no upper bound.
+    static const unsigned int BUCKETS_COUNT = 12;
+    static const unsigned int BUCKETS[BUCKETS_COUNT - 1];
+
+  private:
+    typedef std::map<HttpStatus, uint64_t>  Statuses;
+
+    struct Shard
+    {
+      boost::mutex mutex_;
+      uint64_t count_;
+      uint64_t bytesIn_;
+      uint64_t bytesOut_;
+      uint64_t totalLatency_;   // In microseconds
+      uint64_t buckets_[BUCKETS_COUNT];
+      Statuses statuses_;
+
+      Shard();
+    };
+
+    static const unsigned int SHARDS_COUNT = 8;
+
+    Shard shards_[SHARDS_COUNT];
+
+  public:
+    // Merged view of the shards
+    struct Snapshot
+    {
+      uint64_t count_;
+      uint64_t bytesIn_;
+      uint64_t bytesOut_;
+      uint64_t totalLatency_;
+      uint64_t buckets_[BUCKETS_COUNT];   // Not cumulative
+      Statuses statuses_;
+    };
+
+    void Record(HttpStatus status,
+                uint64_t bytesIn,
+                uint64_t bytesOut,
+                uint64_t latency);   // In microseconds
+
+    void GetSnapshot(Snapshot& target);
+
+    void Format(Json::Value& target);
+
+    // The labels of Prometheus that identify each route, together
+    // with the metrics of this route
+    typedef std::list< std::pair<std::string, Snapshot> >  LabeledSnapshots;
+
+    // Text exposition format of Prometheus, where the samples of each
+    // metric must be grouped together
+    static void FormatPrometheus(std::string& target,
+                                 const LabeledSnapshots& snapshots);
+  };
+}
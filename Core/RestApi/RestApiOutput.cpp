@@ -42,6 +42,7 @@ namespace Orthanc
     output_(output)
   {
     alreadySent_ = false;
+    styledJson_ = false;
   }
 
   RestApiOutput::~RestApiOutput()
@@ -60,6 +61,24 @@ namespace Orthanc
     }
   }
 
+  bool RestApiOutput::CheckETag(const std::string& etag,
+                                const std::string& cacheControl)
+  {
+    CheckStatus();
+
+    output_.SetETag(etag);
+    output_.SetCacheControl(cacheControl);
+
+    if (output_.IsNotModified())
+    {
+      output_.SendNotModified();
+      alreadySent_ = true;
+      return true;
+    }
+
+    return false;
+  }
+
   void RestApiOutput::AnswerFile(HttpFileSender& sender)
   {
     CheckStatus();
@@ -67,15 +86,65 @@ namespace Orthanc
     alreadySent_ = true;
   }
 
+  std::string RestApiOutput::FormatJson(const Json::Value& value) const
+  {
+    if (styledJson_)
+    {
+      Json::StyledWriter writer;
+      return writer.write(value);
+    }
+    else
+    {
+      Json::FastWriter writer;
+      return writer.write(value);
+    }
+  }
+
   void RestApiOutput::AnswerJson(const Json::Value& value)
   {
     CheckStatus();
-    Json::StyledWriter writer;
-    std::string s = writer.write(value);
+    std::string s = FormatJson(value);
     output_.AnswerBufferWithContentType(s, "application/json", cookies_);
     alreadySent_ = true;
   }
 
+  void RestApiOutput::AnswerJson(const Json::Value& value,
+                                 HttpStatus status)
+  {
+    CheckStatus();
+    std::string s = FormatJson(value);
+    output_.AnswerBufferWithStatus(status, s, "application/json", cookies_);
+    alreadySent_ = true;
+  }
+
+  JsonStreamWriter& RestApiOutput::StartJsonStream()
+  {
+    CheckStatus();
+
+    if (!cookies_.empty())
+    {
+      // The header of a streamed answer cannot contain cookies
+      throw OrthancException(ErrorCode_NotImplemented);
+    }
+
+    stream_.reset(new ChunkedHttpOutput(output_, "application/json", ""));
+    jsonWriter_.reset(new JsonStreamWriter(*stream_, styledJson_));
+    alreadySent_ = true;
+
+    return *jsonWriter_;
+  }
+
+  void RestApiOutput::FinishJsonStream()
+  {
+    if (jsonWriter_.get() == NULL ||
+        !jsonWriter_->IsComplete())
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    stream_->Finish();
+  }
+
   void RestApiOutput::AnswerBuffer(const std::string& buffer,
                                    const std::string& contentType)
   {
@@ -103,7 +172,8 @@ namespace Orthanc
   void RestApiOutput::SignalError(HttpStatus status)
   {
     if (status != HttpStatus_403_Forbidden &&
-        status != HttpStatus_415_UnsupportedMediaType)
+        status != HttpStatus_415_UnsupportedMediaType &&
+        status != HttpStatus_503_ServiceUnavailable)
     {
       throw OrthancException("This HTTP status is not allowed in a REST API");
     }
@@ -34,8 +34,11 @@
 
 #include "../HttpServer/HttpOutput.h"
 #include "../HttpServer/HttpFileSender.h"
+#include "../HttpServer/ChunkedHttpOutput.h"
+#include "JsonStreamWriter.h"
 
 #include <json/json.h>
+#include <memory>
 
 namespace Orthanc
 {
@@ -44,7 +47,10 @@ namespace Orthanc
   private:
     HttpOutput& output_;
     bool alreadySent_;
+    bool styledJson_;
     HttpHandler::Arguments cookies_;
+    std::auto_ptr<ChunkedHttpOutput> stream_;
+    std::auto_ptr<JsonStreamWriter> jsonWriter_;
 
     void CheckStatus();
 
@@ -63,10 +69,48 @@ namespace Orthanc
       alreadySent_ = true;
     }
 
+    // The JSON answers are compact by default, the styled format
+    // being meant for humans
+    void SetStyledJson(bool styled)
+    {
+      styledJson_ = styled;
+    }
+
+    bool IsStyledJson() const
+    {
+      return styledJson_;
+    }
+
+    // Formats a JSON answer in the style requested by the client
+    std::string FormatJson(const Json::Value& value) const;
+
+    /**
+     * Sets the entity tag of the answer, and its caching policy. If
+     * the client already has this version of the resource, "304 Not
+     * Modified" is sent and "true" is returned: Nothing else must be
+     * answered in this case.
+     **/
+    bool CheckETag(const std::string& etag,
+                   const std::string& cacheControl);
+
     void AnswerFile(HttpFileSender& sender);
 
     void AnswerJson(const Json::Value& value);
 
+    void AnswerJson(const Json::Value& value,
+                    HttpStatus status);
+
+    /**
+     * Starts a JSON answer that is streamed to the client as it is
+     * written, for the answers that are too large to be built as a
+     * tree in memory. "FinishJsonStream()" must be called once the
+     * top-level value has been written. If the handler fails before,
+     * the answer is left truncated so that the client notices it.
+     **/
+    JsonStreamWriter& StartJsonStream();
+
+    void FinishJsonStream();
+
     void AnswerBuffer(const std::string& buffer,
                       const std::string& contentType);
 
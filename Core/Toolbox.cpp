@@ -469,18 +469,59 @@ namespace Orthanc
                            const void* data,
                            size_t length)
   {
-    md5_state_s state;
-    md5_init(&state);
+    MD5Context context;
+    context.Append(data, length);
+    context.Finish(result);
+  }
 
-    if (length > 0)
+
+  struct Toolbox::MD5Context::PImpl
+  {
+    md5_state_s state_;
+    bool isFinished_;
+  };
+
+
+  Toolbox::MD5Context::MD5Context() : pimpl_(new PImpl)
+  {
+    md5_init(&pimpl_->state_);
+    pimpl_->isFinished_ = false;
+  }
+
+
+  void Toolbox::MD5Context::Append(const void* data,
+                                   size_t length)
+  {
+    if (pimpl_->isFinished_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    const md5_byte_t* p = reinterpret_cast<const md5_byte_t*>(data);
+
+    // "md5_append()" takes an "int" as the length
+    static const size_t MAX_CHUNK = 1024 * 1024 * 1024;
+
+    while (length > 0)
+    {
+      size_t chunk = (length < MAX_CHUNK ? length : MAX_CHUNK);
+      md5_append(&pimpl_->state_, p, static_cast<int>(chunk));
+      p += chunk;
+      length -= chunk;
+    }
+  }
+
+
+  void Toolbox::MD5Context::Finish(std::string& result)
+  {
+    if (pimpl_->isFinished_)
     {
-      md5_append(&state, 
-                 reinterpret_cast<const md5_byte_t*>(data), 
-                 static_cast<int>(length));
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
     }
 
     md5_byte_t actualHash[16];
-    md5_finish(&state, actualHash);
+    md5_finish(&pimpl_->state_, actualHash);
+    pimpl_->isFinished_ = true;
 
     result.resize(32);
     for (unsigned int i = 0; i < 16; i++)
@@ -595,12 +636,27 @@ namespace Orthanc
 
   void Toolbox::ComputeSHA1(std::string& result,
                             const std::string& data)
+  {
+    if (data.size() > 0)
+    {
+      ComputeSHA1(result, &data[0], data.size());
+    }
+    else
+    {
+      ComputeSHA1(result, NULL, 0);
+    }
+  }
+
+
+  void Toolbox::ComputeSHA1(std::string& result,
+                            const void* data,
+                            size_t length)
   {
     boost::uuids::detail::sha1 sha1;
 
-    if (data.size() > 0)
+    if (length > 0)
     {
-      sha1.process_bytes(&data[0], data.size());
+      sha1.process_bytes(data, length);
     }
 
     unsigned int digest[5];
@@ -37,6 +37,7 @@
 #include <stdint.h>
 #include <vector>
 #include <string>
+#include <boost/shared_ptr.hpp>
 
 namespace Orthanc
 {
@@ -90,9 +91,32 @@ namespace Orthanc
                     const void* data,
                     size_t length);
 
+    /**
+     * Incremental computation of a MD5 hash, for the data that is
+     * only available by chunks.
+     **/
+    class MD5Context
+    {
+    private:
+      struct PImpl;
+      boost::shared_ptr<PImpl> pimpl_;
+
+    public:
+      MD5Context();
+
+      void Append(const void* data,
+                  size_t length);
+
+      void Finish(std::string& result);
+    };
+
     void ComputeSHA1(std::string& result,
                      const std::string& data);
 
+    void ComputeSHA1(std::string& result,
+                     const void* data,
+                     size_t length);
+
     bool IsSHA1(const std::string& str);
 
     void DecodeBase64(std::string& result, 
@@ -469,6 +469,15 @@ namespace Orthanc
 
 
 
+  bool DatabaseWrapper::IsAttachedFile(const std::string& uuid)
+  {
+    SQLite::Statement s(db_, SQLITE_FROM_HERE, 
+                        "SELECT id FROM AttachedFiles WHERE uuid=? LIMIT 1");
+    s.BindString(0, uuid);
+    return s.Step();
+  }
+
+
   void DatabaseWrapper::ListAvailableAttachments(std::list<FileContentType>& result,
                                                  int64_t id)
   {
@@ -780,7 +789,9 @@ namespace Orthanc
     
   uint64_t DatabaseWrapper::GetTotalCompressedSize()
   {
-    SQLite::Statement s(db_, SQLITE_FROM_HERE, "SELECT SUM(compressedSize) FROM AttachedFiles");
+    // A file that is shared by several attachments is only counted once
+    SQLite::Statement s(db_, SQLITE_FROM_HERE, 
+                        "SELECT SUM(compressedSize) FROM (SELECT compressedSize FROM AttachedFiles GROUP BY uuid)");
     s.Run();
     return static_cast<uint64_t>(s.ColumnInt64(0));
   }
@@ -807,6 +818,20 @@ namespace Orthanc
   }
 
 
+  void DatabaseWrapper::GetAllPublicIds(std::list<std::string>& target,
+                                        ResourceType resourceType)
+  {
+    SQLite::Statement s(db_, SQLITE_FROM_HERE, "SELECT publicId FROM Resources WHERE resourceType=?");
+    s.BindInt(0, resourceType);
+
+    target.clear();
+    while (s.Step())
+    {
+      target.push_back(s.ColumnString(0));
+    }
+  }
+
+
   DatabaseWrapper::DatabaseWrapper(const std::string& path,
                                    IServerIndexListener& listener) :
     listener_(listener)
@@ -851,11 +876,12 @@ namespace Orthanc
       /**
        * History of the database versions:
        *  - Version 3: from Orthanc 0.3.2 to Orthanc 0.7.2 (inclusive)
-       *  - Version 4: from Orthanc 0.7.3 (inclusive)
+       *  - Version 4: from Orthanc 0.7.3 to Orthanc 0.7.5 (inclusive)
+       *  - Version 5: from the mainline, only if the shared attachments are enabled
        **/
 
-      // This version of Orthanc is only compatible with versions 3 of 4 of the DB schema
-      ok = (v == 3 || v == 4);
+      // This version of Orthanc is only compatible with versions 3, 4 or 5 of the DB schema
+      ok = (v == 3 || v == 4 || v == 5);
 
       if (v == 3)
       {
@@ -865,7 +891,13 @@ namespace Orthanc
         db_.BeginTransaction();
         db_.Execute(upgrade);
         db_.CommitTransaction();
+        v = 4;
       }
+
+      // The upgrade from version 4 to version 5 is only applied once
+      // the shared attachments are needed, so that the database
+      // remains usable by older releases of Orthanc otherwise (cf.
+      // "UpgradeToSharedAttachments()")
     }
     catch (boost::bad_lexical_cast&)
     {
@@ -882,6 +914,24 @@ namespace Orthanc
     db_.Register(new Internals::SignalFileDeleted(listener_));
   }
 
+  void DatabaseWrapper::UpgradeToSharedAttachments()
+  {
+    std::string version = GetGlobalProperty(GlobalProperty_DatabaseSchemaVersion, "Unknown");
+    if (version == "4")
+    {
+      LOG(WARNING) << "Upgrading database version from 4 to 5";
+      std::string upgrade;
+      EmbeddedResources::GetFileResource(upgrade, EmbeddedResources::UPGRADE_DATABASE_4_TO_5);
+      db_.BeginTransaction();
+      db_.Execute(upgrade);
+      db_.CommitTransaction();
+    }
+    else if (version != "5")
+    {
+      throw OrthancException(ErrorCode_IncompatibleDatabaseVersion);
+    }
+  }
+
   uint64_t DatabaseWrapper::GetResourceCount(ResourceType resourceType)
   {
     SQLite::Statement s(db_, SQLITE_FROM_HERE, 
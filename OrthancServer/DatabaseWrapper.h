@@ -73,6 +73,10 @@ namespace Orthanc
                                       unsigned int maxResults);
 
   public:
+    // Upgrades the database to version 5, which allows several
+    // attachments to share the same file (content-addressed storage)
+    void UpgradeToSharedAttachments();
+
     void SetGlobalProperty(GlobalProperty property,
                            const std::string& value);
 
@@ -135,6 +139,9 @@ namespace Orthanc
     void ListAvailableAttachments(std::list<FileContentType>& result,
                                   int64_t id);
 
+    // Tells whether at least one attachment refers to this file
+    bool IsAttachedFile(const std::string& uuid);
+
     bool LookupAttachment(FileInfo& attachment,
                           int64_t id,
                           FileContentType contentType);
@@ -193,6 +200,9 @@ namespace Orthanc
     void GetAllPublicIds(Json::Value& target,
                          ResourceType resourceType);
 
+    void GetAllPublicIds(std::list<std::string>& target,
+                         ResourceType resourceType);
+
     bool SelectPatientToRecycle(int64_t& internalId);
 
     bool SelectPatientToRecycle(int64_t& internalId,
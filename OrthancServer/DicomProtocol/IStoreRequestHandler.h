@@ -47,6 +47,10 @@ namespace Orthanc
     {
     }
 
+    // If this method returns "false", the JSON summary is not
+    // computed and "Handle()" receives a null value as "dicomJson"
+    virtual bool IsDicomAsJsonNeeded() = 0;
+
     virtual void Handle(const std::string& dicomFile,
                         const DicomMap& dicomSummary,
                         const Json::Value& dicomJson,
@@ -89,6 +89,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <list>
 #include <limits>
+#include <string.h>
 
 #include <boost/lexical_cast.hpp>
 
@@ -466,6 +467,24 @@ namespace Orthanc
   }
 
 
+  bool FromDcmtkBridge::ToJson(Json::Value& target, 
+                               DcmDataset& dataset,
+                               const DicomTag& tag,
+                               unsigned int maxStringLength)
+  {
+    DcmElement* element = NULL;
+    if (!dataset.findAndGetElement(DcmTagKey(tag.GetGroup(), tag.GetElement()), element).good() ||
+        element == NULL)
+    {
+      return false;
+    }
+
+    target = Json::objectValue;
+    StoreElement(target, *element, maxStringLength);
+    return true;
+  }
+
+
   static void ExtractPngImageColorPreview(std::string& result,
                                           DicomIntegerPixelAccessor& accessor)
   {
@@ -1002,4 +1021,429 @@ namespace Orthanc
       return false;
     }
   }
+
+
+  namespace
+  {
+    /**
+     * Lightweight scanner over the raw bytes of a DICOM file, whose
+     * only purpose is to locate the top-level pixel data without
+     * decoding the dataset. It gives up on any unexpected construct.
+     **/
+    class PixelDataScanner
+    {
+    private:
+      static const unsigned int MAX_DEPTH = 32;
+      static const uint32_t UNDEFINED_LENGTH = 0xffffffff;
+
+      const uint8_t* buffer_;
+      size_t size_;
+
+      uint16_t ReadUint16(size_t pos) const
+      {
+        return (static_cast<uint16_t>(buffer_[pos]) |
+                static_cast<uint16_t>(buffer_[pos + 1]) << 8);
+      }
+
+      uint32_t ReadUint32(size_t pos) const
+      {
+        return (static_cast<uint32_t>(buffer_[pos]) |
+                static_cast<uint32_t>(buffer_[pos + 1]) << 8 |
+                static_cast<uint32_t>(buffer_[pos + 2]) << 16 |
+                static_cast<uint32_t>(buffer_[pos + 3]) << 24);
+      }
+
+      static bool HasLongLength(char a, char b)
+      {
+        // VRs whose length is encoded on 4 bytes, after 2 reserved
+        // bytes (DICOM PS 3.5, Table 7.1-1)
+        return ((a == 'O' && (b == 'B' || b == 'W' || b == 'F' || b == 'D' || b == 'L')) ||
+                (a == 'S' && b == 'Q') ||
+                (a == 'U' && (b == 'T' || b == 'N' || b == 'C' || b == 'R')));
+      }
+
+      // Reads the header of the element at "pos", and moves "pos" to
+      // its value
+      bool ReadElementHeader(uint16_t& group,
+                             uint16_t& element,
+                             uint32_t& length,
+                             bool& isUnknown,
+                             size_t& pos,
+                             bool isExplicit) const
+      {
+        if (pos + 8 > size_)
+        {
+          return false;
+        }
+
+        group = ReadUint16(pos);
+        element = ReadUint16(pos + 2);
+        isUnknown = false;
+
+        if (group == 0xfffe)
+        {
+          // Item and delimitation tags have no VR
+          length = ReadUint32(pos + 4);
+          pos += 8;
+        }
+        else if (!isExplicit)
+        {
+          length = ReadUint32(pos + 4);
+          pos += 8;
+        }
+        else
+        {
+          char a = static_cast<char>(buffer_[pos + 4]);
+          char b = static_cast<char>(buffer_[pos + 5]);
+
+          if (HasLongLength(a, b))
+          {
+            if (pos + 12 > size_)
+            {
+              return false;
+            }
+
+            isUnknown = (a == 'U' && b == 'N');
+            length = ReadUint32(pos + 8);
+            pos += 12;
+          }
+          else
+          {
+            length = ReadUint16(pos + 6);
+            pos += 8;
+          }
+        }
+
+        return true;
+      }
+
+      bool SkipValue(size_t& pos,
+                     uint32_t length) const
+      {
+        if (length > size_ - pos)
+        {
+          return false;
+        }
+
+        pos += length;
+        return true;
+      }
+
+      // Skips the items of a sequence (or of an encapsulated pixel
+      // data) with undefined length, up to its delimitation
+      bool SkipUndefinedLength(size_t& pos,
+                               bool isExplicit,
+                               unsigned int depth) const
+      {
+        for (;;)
+        {
+          uint16_t group, element;
+          uint32_t length;
+          bool isUnknown;
+
+          if (!ReadElementHeader(group, element, length, isUnknown, pos, isExplicit) ||
+              group != 0xfffe)
+          {
+            return false;
+          }
+
+          if (element == 0xe0dd)
+          {
+            return true;  // Sequence delimitation item
+          }
+          else if (element != 0xe000)
+          {
+            return false;
+          }
+          else if (length == UNDEFINED_LENGTH)
+          {
+            if (!SkipDataset(pos, isExplicit, depth + 1, NULL))
+            {
+              return false;
+            }
+          }
+          else if (!SkipValue(pos, length))
+          {
+            return false;
+          }
+        }
+      }
+
+    public:
+      PixelDataScanner(const char* buffer,
+                       size_t size) :
+        buffer_(reinterpret_cast<const uint8_t*>(buffer)),
+        size_(size)
+      {
+      }
+
+      /**
+       * Skips the elements of a dataset. At the top level
+       * ("pixelData" is not NULL), stops at the pixel data. Otherwise,
+       * stops at the item delimitation.
+       **/
+      bool SkipDataset(size_t& pos,
+                       bool isExplicit,
+                       unsigned int depth,
+                       size_t* pixelData) const
+      {
+        if (depth > MAX_DEPTH)
+        {
+          return false;
+        }
+
+        while (pos < size_)
+        {
+          size_t start = pos;
+          uint16_t group, element;
+          uint32_t length;
+          bool isUnknown;
+
+          if (!ReadElementHeader(group, element, length, isUnknown, pos, isExplicit))
+          {
+            return false;
+          }
+
+          if (pixelData != NULL &&
+              group == 0x7fe0 && element == 0x0010)
+          {
+            *pixelData = start;
+            return true;
+          }
+
+          if (group == 0xfffe)
+          {
+            // Item delimitation
+            return (pixelData == NULL && element == 0xe00d);
+          }
+
+          if (length == UNDEFINED_LENGTH)
+          {
+            // The content of an "UN" element with undefined length is
+            // encoded with the implicit VR (DICOM PS 3.5, 6.2.2)
+            if (!SkipUndefinedLength(pos, isExplicit && !isUnknown, depth))
+            {
+              return false;
+            }
+          }
+          else if (!SkipValue(pos, length))
+          {
+            return false;
+          }
+        }
+
+        return false;  // No pixel data, or no delimitation
+      }
+
+      /**
+       * Locates the top-level pixel data of the dataset starting at
+       * "pos": "start" is the position of its header, "value" the
+       * position of its value, and "end" the position of the element
+       * that follows it (if any).
+       **/
+      bool LocatePixelData(size_t& start,
+                           size_t& value,
+                           uint32_t& length,
+                           size_t& end,
+                           size_t pos,
+                           bool isExplicit) const
+      {
+        uint16_t group, element;
+        bool isUnknown;
+
+        if (!SkipDataset(pos, isExplicit, 0, &start))
+        {
+          return false;
+        }
+
+        value = start;
+        if (!ReadElementHeader(group, element, length, isUnknown, value, isExplicit) ||
+            (isExplicit && value - start != 12))
+        {
+          // In explicit VR, the pixel data must have a 4-byte length
+          return false;
+        }
+
+        end = value;
+        if (length == UNDEFINED_LENGTH)
+        {
+          // Encapsulated pixel data
+          return SkipUndefinedLength(end, isExplicit, 0);
+        }
+        else
+        {
+          return SkipValue(end, length);
+        }
+      }
+
+      // Reads the transfer syntax in the meta-header, and returns the
+      // position of the dataset
+      bool ReadTransferSyntax(std::string& transferSyntax,
+                              size_t& pos) const
+      {
+        if (size_ < 132 ||
+            memcmp(buffer_ + 128, "DICM", 4) != 0)
+        {
+          return false;
+        }
+
+        pos = 132;
+        transferSyntax.clear();
+
+        // The meta-header is always encoded in little endian, with explicit VR
+        while (pos + 8 <= size_ &&
+               ReadUint16(pos) == 0x0002)
+        {
+          uint16_t group, element;
+          uint32_t length;
+          bool isUnknown;
+
+          if (!ReadElementHeader(group, element, length, isUnknown, pos, true) ||
+              length == UNDEFINED_LENGTH ||
+              length > size_ - pos)
+          {
+            return false;
+          }
+
+          if (element == 0x0010)
+          {
+            transferSyntax.assign(reinterpret_cast<const char*>(buffer_ + pos), length);
+
+            // Remove the padding
+            while (!transferSyntax.empty() &&
+                   (transferSyntax[transferSyntax.size() - 1] == '\0' ||
+                    transferSyntax[transferSyntax.size() - 1] == ' '))
+            {
+              transferSyntax.resize(transferSyntax.size() - 1);
+            }
+          }
+
+          pos += length;
+        }
+
+        return !transferSyntax.empty();
+      }
+
+      // Parses the meta-header, and returns the position of the
+      // dataset with its encoding
+      bool ReadMetaHeader(size_t& pos,
+                          bool& isExplicit) const
+      {
+        std::string transferSyntax;
+        if (!ReadTransferSyntax(transferSyntax, pos))
+        {
+          return false;
+        }
+
+        if (transferSyntax == "1.2.840.10008.1.2")
+        {
+          isExplicit = false;   // Implicit VR little endian
+          return true;
+        }
+        else if (transferSyntax == "1.2.840.10008.1.2.2" ||   // Explicit VR big endian
+                 transferSyntax == "1.2.840.10008.1.2.1.99")  // Deflated
+        {
+          return false;
+        }
+        else
+        {
+          // All the other transfer syntaxes (including the
+          // compressed ones) encode the dataset in explicit VR
+          // little endian
+          isExplicit = true;
+          return true;
+        }
+      }
+    };
+  }
+
+
+  bool FromDcmtkBridge::LookupTransferSyntax(std::string& result,
+                                             const char* buffer,
+                                             size_t size)
+  {
+    if (buffer == NULL)
+    {
+      return false;
+    }
+
+    PixelDataScanner scanner(buffer, size);
+
+    size_t pos;
+    return scanner.ReadTransferSyntax(result, pos);
+  }
+
+
+  bool FromDcmtkBridge::LookupPixelData(size_t& offset,
+                                        const char* buffer,
+                                        size_t size)
+  {
+    if (buffer == NULL)
+    {
+      return false;
+    }
+
+    PixelDataScanner scanner(buffer, size);
+
+    size_t pos;
+    bool isExplicit;
+    return (scanner.ReadMetaHeader(pos, isExplicit) &&
+            scanner.SkipDataset(pos, isExplicit, 0, &offset));
+  }
+
+
+  bool FromDcmtkBridge::TruncatePixelData(std::string& target,
+                                          const char* buffer,
+                                          size_t size)
+  {
+    // Only the first bytes of the pixel data are kept: This is more
+    // than enough for the value to be reported as "TooLong" in JSON
+    static const uint32_t MAX_PIXEL_DATA = 65536;
+
+    if (buffer == NULL)
+    {
+      return false;
+    }
+
+    PixelDataScanner scanner(buffer, size);
+
+    size_t pos, start, value, end;
+    uint32_t length;
+    bool isExplicit;
+    if (!scanner.ReadMetaHeader(pos, isExplicit) ||
+        !scanner.LocatePixelData(start, value, length, end, pos, isExplicit) ||
+        end - value <= MAX_PIXEL_DATA)
+    {
+      return false;
+    }
+
+    target.reserve(value + MAX_PIXEL_DATA + (size - end));
+    target.assign(buffer, value);
+
+    if (length == 0xffffffff)
+    {
+      // Encapsulated pixel data: Replace the fragments by an empty
+      // basic offset table, followed by the sequence delimitation
+      static const char EMPTY_FRAGMENTS[] = {
+        '\xfe', '\xff', '\x00', '\xe0', 0, 0, 0, 0,
+        '\xfe', '\xff', '\xdd', '\xe0', 0, 0, 0, 0
+      };
+
+      target.append(EMPTY_FRAGMENTS, sizeof(EMPTY_FRAGMENTS));
+    }
+    else
+    {
+      // Native pixel data: The 4-byte length precedes the value
+      target[value - 4] = static_cast<char>(MAX_PIXEL_DATA & 0xff);
+      target[value - 3] = static_cast<char>((MAX_PIXEL_DATA >> 8) & 0xff);
+      target[value - 2] = static_cast<char>((MAX_PIXEL_DATA >> 16) & 0xff);
+      target[value - 1] = static_cast<char>((MAX_PIXEL_DATA >> 24) & 0xff);
+      target.append(buffer + value, MAX_PIXEL_DATA);
+    }
+
+    // Keep the elements that follow the pixel data
+    target.append(buffer + end, size - end);
+
+    return true;
+  }
 }
@@ -58,6 +58,14 @@ namespace Orthanc
                        const std::string& path,
                        unsigned int maxStringLength = 256);
 
+    // Converts a single top-level element of the dataset, in the same
+    // format as the other "ToJson()" methods. Returns "false" if the
+    // dataset does not contain this tag.
+    static bool ToJson(Json::Value& target, 
+                       DcmDataset& dataset,
+                       const DicomTag& tag,
+                       unsigned int maxStringLength = 256);
+
     static void ExtractPngImage(std::string& result,
                                 DcmDataset& dataset,
                                 unsigned int frame,
@@ -106,5 +114,38 @@ namespace Orthanc
 
     static bool SaveToMemoryBuffer(std::string& buffer,
                                    DcmDataset* dataSet);
+
+    /**
+     * Reads the transfer syntax UID (0002,0010) in the meta-header of
+     * a DICOM file stored in memory. The buffer can be limited to the
+     * first bytes of the file, as long as it contains the whole
+     * meta-header.
+     **/
+    static bool LookupTransferSyntax(std::string& result,
+                                     const char* buffer,
+                                     size_t size);
+
+    /**
+     * Locates the top-level pixel data (7FE0,0010) in a DICOM file
+     * stored in memory, by skipping over the raw elements without
+     * decoding them. Returns "false" if there is no pixel data, or if
+     * the encoding of the file is not supported by this scan (the
+     * file must then be fully parsed).
+     **/
+    static bool LookupPixelData(size_t& offset,
+                                const char* buffer,
+                                size_t size);
+
+    /**
+     * Copies a DICOM file stored in memory, keeping only the first
+     * bytes of its top-level pixel data (or none of its fragments, if
+     * the pixel data is encapsulated). The elements that follow the
+     * pixel data are preserved. Returns "false" if the pixel data is
+     * too small to be worth the truncation, or if the encoding of the
+     * file is not supported by the scan.
+     **/
+    static bool TruncatePixelData(std::string& target,
+                                  const char* buffer,
+                                  size_t size);
   };
 }
@@ -0,0 +1,359 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "IngestQueue.h"
+
+#include "../Core/OrthancException.h"
+#include "../Core/Uuid.h"
+
+#include <memory>
+#include <boost/lexical_cast.hpp>
+#include <glog/logging.h>
+
+namespace Orthanc
+{
+  // Number of finished fire-and-forget jobs whose outcome is kept
+  static const size_t MAX_FINISHED_JOBS = 1000;
+
+  struct IngestQueue::Task
+  {
+    std::auto_ptr<IJob> job_;
+    std::string id_;
+    bool isRunning_;
+    bool isDone_;
+    StoreStatus status_;
+    std::string publicId_;
+    bool hasError_;
+    ErrorCode error_;
+    std::string message_;
+
+    Task(IJob* job) : 
+      job_(job),
+      isRunning_(false),
+      isDone_(false),
+      status_(StoreStatus_Failure),
+      hasError_(false),
+      error_(ErrorCode_Success)
+    {
+    }
+  };
+
+
+  void IngestQueue::Worker(IngestQueue* that)
+  {
+    for (;;)
+    {
+      TaskPtr task;
+
+      {
+        boost::mutex::scoped_lock lock(that->mutex_);
+
+        while (that->queue_.empty() && !that->done_)
+        {
+          that->notEmpty_.wait(lock);
+        }
+
+        if (that->queue_.empty())
+        {
+          return;  // The queue is drained and stopping
+        }
+
+        task = that->queue_.front();
+        that->queue_.pop_front();
+        task->isRunning_ = true;
+        that->running_++;
+        that->notFull_.notify_one();
+      }
+
+      StoreStatus status = StoreStatus_Failure;
+      std::string publicId;
+      bool hasError = true;
+      ErrorCode error = ErrorCode_Custom;
+      std::string message;
+
+      try
+      {
+        status = task->job_->Execute(publicId);
+        hasError = false;
+      }
+      catch (OrthancException& e)
+      {
+        error = e.GetErrorCode();
+        message = e.What();
+      }
+      catch (std::exception& e)
+      {
+        message = e.what();
+      }
+      catch (...)
+      {
+        message = "Unknown error while ingesting an instance";
+      }
+
+      if (hasError && !task->id_.empty())
+      {
+        LOG(ERROR) << "Error in ingest job " << task->id_ << ": " << message;
+      }
+
+      {
+        boost::mutex::scoped_lock lock(that->mutex_);
+
+        task->job_.reset(NULL);  // Release the memory as soon as possible
+        task->isRunning_ = false;
+        task->isDone_ = true;
+        task->status_ = status;
+        task->publicId_ = publicId;
+        task->hasError_ = hasError;
+        task->error_ = error;
+        task->message_ = message;
+
+        that->running_--;
+        that->countProcessed_++;
+
+        if (!task->id_.empty())
+        {
+          that->finishedJobs_.push_back(task->id_);
+          while (that->finishedJobs_.size() > MAX_FINISHED_JOBS)
+          {
+            that->jobs_.erase(that->finishedJobs_.front());
+            that->finishedJobs_.pop_front();
+          }
+        }
+
+        that->processed_.notify_all();
+      }
+    }
+  }
+
+
+  bool IngestQueue::Enqueue(TaskPtr task)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (done_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    if (maxSize_ != 0)
+    {
+      if (!blocking_ &&
+          queue_.size() >= maxSize_)
+      {
+        countRefused_++;
+        return false;
+      }
+
+      // Backpressure: Wait for a worker to make room in the queue
+      while (queue_.size() >= maxSize_)
+      {
+        notFull_.wait(lock);
+
+        if (done_)
+        {
+          // The queue is stopping: The workers might already have
+          // exited, and would never process this task
+          throw OrthancException(ErrorCode_BadSequenceOfCalls);
+        }
+      }
+    }
+
+    queue_.push_back(task);
+
+    if (!task->id_.empty())
+    {
+      jobs_[task->id_] = task;
+    }
+
+    notEmpty_.notify_one();
+    return true;
+  }
+
+
+  IngestQueue::IngestQueue(unsigned int countWorkers,
+                           unsigned int maxSize,
+                           bool blocking) :
+    done_(false),
+    maxSize_(maxSize),
+    blocking_(blocking),
+    running_(0),
+    countProcessed_(0),
+    countRefused_(0)
+  {
+    if (countWorkers == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    for (unsigned int i = 0; i < countWorkers; i++)
+    {
+      workers_.push_back(new boost::thread(Worker, this));
+    }
+  }
+
+
+  IngestQueue::~IngestQueue()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      done_ = true;
+      notEmpty_.notify_all();
+      notFull_.notify_all();  // Release the blocked producers
+    }
+
+    // The workers process the remaining instances before stopping
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+      workers_[i]->join();
+      delete workers_[i];
+    }
+  }
+
+
+  bool IngestQueue::Execute(StoreStatus& status,
+                            std::string& publicId,
+                            IJob* job)
+  {
+    TaskPtr task(new Task(job));
+
+    if (!Enqueue(task))
+    {
+      return false;
+    }
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      while (!task->isDone_)
+      {
+        processed_.wait(lock);
+      }
+    }
+
+    if (task->hasError_)
+    {
+      if (task->error_ == ErrorCode_Custom)
+      {
+        throw OrthancException(task->message_);
+      }
+      else
+      {
+        throw OrthancException(task->error_);
+      }
+    }
+
+    status = task->status_;
+    publicId = task->publicId_;
+    return true;
+  }
+
+
+  bool IngestQueue::Submit(std::string& jobId,
+                           IJob* job)
+  {
+    TaskPtr task(new Task(job));
+    task->id_ = Toolbox::GenerateUuid();
+
+    if (Enqueue(task))
+    {
+      jobId = task->id_;
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+  bool IngestQueue::LookupJob(Json::Value& target,
+                              const std::string& jobId)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    std::map<std::string, TaskPtr>::const_iterator found = jobs_.find(jobId);
+    if (found == jobs_.end())
+    {
+      return false;
+    }
+
+    const Task& task = *found->second;
+
+    target = Json::objectValue;
+    target["ID"] = jobId;
+
+    if (task.isDone_)
+    {
+      target["State"] = "Done";
+
+      if (task.hasError_)
+      {
+        target["Status"] = EnumerationToString(StoreStatus_Failure);
+        target["Error"] = task.message_;
+      }
+      else
+      {
+        target["Status"] = EnumerationToString(task.status_);
+
+        if (task.status_ != StoreStatus_Failure)
+        {
+          target["Instance"] = task.publicId_;
+        }
+      }
+    }
+    else if (task.isRunning_)
+    {
+      target["State"] = "Running";
+    }
+    else
+    {
+      target["State"] = "Pending";
+    }
+
+    return true;
+  }
+
+
+  void IngestQueue::GetStatistics(Json::Value& target)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    target = Json::objectValue;
+    target["Workers"] = static_cast<unsigned int>(workers_.size());
+    target["QueueSize"] = static_cast<unsigned int>(queue_.size());
+    target["MaxQueueSize"] = maxSize_;
+    target["Blocking"] = blocking_;
+    target["Running"] = running_;
+    target["Processed"] = boost::lexical_cast<std::string>(countProcessed_);
+    target["Refused"] = boost::lexical_cast<std::string>(countRefused_);
+  }
+}
@@ -0,0 +1,120 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+ * Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "ServerEnumerations.h"
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <json/value.h>
+
+namespace Orthanc
+{
+  /**
+   * Bounded queue of the incoming DICOM instances, processed by a
+   * pool of worker threads. The REST API and the C-Store SCP submit
+   * their instances to the same queue, which governs the overall
+   * concurrency of the ingest. If the queue is full, the submission
+   * either blocks or is refused, depending on the configuration.
+   **/
+  class IngestQueue : public boost::noncopyable
+  {
+  public:
+    class IJob : public boost::noncopyable
+    {
+    public:
+      virtual ~IJob()
+      {
+      }
+
+      virtual StoreStatus Execute(std::string& publicId) = 0;
+    };
+
+  private:
+    struct Task;
+    typedef boost::shared_ptr<Task>  TaskPtr;
+
+    bool done_;
+    unsigned int maxSize_;
+    bool blocking_;
+
+    boost::mutex mutex_;
+    boost::condition_variable notEmpty_;
+    boost::condition_variable notFull_;
+    boost::condition_variable processed_;
+
+    std::list<TaskPtr>  queue_;
+    std::vector<boost::thread*>  workers_;
+    unsigned int running_;
+
+    // The jobs submitted in the fire-and-forget mode
+    std::map<std::string, TaskPtr>  jobs_;
+    std::list<std::string>  finishedJobs_;
+
+    uint64_t countProcessed_;
+    uint64_t countRefused_;
+
+    static void Worker(IngestQueue* that);
+
+    bool Enqueue(TaskPtr task);
+
+  public:
+    // "maxSize == 0" means no limit on the size of the queue
+    IngestQueue(unsigned int countWorkers,
+                unsigned int maxSize,
+                bool blocking);
+
+    ~IngestQueue();
+
+    // Processes the job, and waits for its completion. Returns
+    // "false" if the queue is full. Takes the ownership of the job.
+    bool Execute(StoreStatus& status,
+                 std::string& publicId,
+                 IJob* job);
+
+    // Fire-and-forget mode. Returns "false" if the queue is full.
+    // Takes the ownership of the job.
+    bool Submit(std::string& jobId,
+                IJob* job);
+
+    bool LookupJob(Json::Value& target,
+                   const std::string& jobId);
+
+    void GetStatistics(Json::Value& target);
+  };
+}
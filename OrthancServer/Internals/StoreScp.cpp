@@ -82,9 +82,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "StoreScp.h"
 
 #include "../FromDcmtkBridge.h"
+#include "../ParsedDicomFile.h"
 #include "../ServerToolbox.h"
 #include "../ToDcmtkBridge.h"
 #include "../../Core/OrthancException.h"
+#include "../../Core/Toolbox.h"
+#include "../../Core/Uuid.h"
 
 #include <dcmtk/dcmdata/dcfilefo.h>
 #include <dcmtk/dcmdata/dcmetinf.h>
@@ -113,7 +116,7 @@ namespace Orthanc
       void *callbackData,
       T_DIMSE_StoreProgress *progress,
       T_DIMSE_C_StoreRQ *req,
-      char * /*imageFileName*/, DcmDataset **imageDataSet,
+      char *imageFileName, DcmDataset ** /*imageDataSet*/,
       T_DIMSE_C_StoreRSP *rsp,
       DcmDataset **statusDetail)
     /*
@@ -154,25 +157,38 @@ namespace Orthanc
         // then the status will reflect this.  The callback function is still called to allow cleanup.
         //rsp->DimseStatus = STATUS_Success;
 
-        // we want to write the received information to a file only if this information
-        // is present and the options opt_bitPreserving and opt_ignore are not set.
-        if ((imageDataSet != NULL) && (*imageDataSet != NULL))
+        // In the bit-preserving mode, the dataset was received by
+        // DCMTK directly into the file "imageFileName", whose bytes
+        // are stored as such: The pixel data is not fully loaded for
+        // the indexing
+        if (imageFileName != NULL &&
+            rsp->DimseStatus == STATUS_Success)
         {
+          std::auto_ptr<ParsedDicomFile> header;
+          DcmDataset* dataset = NULL;
           DicomMap summary;
           Json::Value dicomJson;
           std::string buffer;
 
           try
           {
-            FromDcmtkBridge::Convert(summary, **imageDataSet);
-            FromDcmtkBridge::ToJson(dicomJson, **imageDataSet);       
+            Toolbox::ReadFile(buffer, imageFileName);
 
-            if (!FromDcmtkBridge::SaveToMemoryBuffer(buffer, *imageDataSet))
+            header.reset(ParsedDicomFile::CreateFromHeader(buffer.empty() ? NULL : buffer.c_str(), buffer.size()));
+            dataset = reinterpret_cast<DcmFileFormat*>(header->GetDcmtkObject())->getDataset();
+
+            FromDcmtkBridge::Convert(summary, *dataset);
+
+            if (cbdata->handler->IsDicomAsJsonNeeded())
             {
-              LOG(ERROR) << "cannot write DICOM file to memory";
-              rsp->DimseStatus = STATUS_STORE_Refused_OutOfResources;
+              FromDcmtkBridge::ToJson(dicomJson, *dataset);
             }
           }
+          catch (OrthancException& e)
+          {
+            LOG(ERROR) << "cannot parse the received DICOM file: " << e.What();
+            rsp->DimseStatus = STATUS_STORE_Error_CannotUnderstand;
+          }
           catch (...)
           {
             rsp->DimseStatus = STATUS_STORE_Refused_OutOfResources;
@@ -183,7 +199,7 @@ namespace Orthanc
           if ((rsp->DimseStatus == STATUS_Success))
           {
             // which SOP class and SOP instance ?
-            if (!DU_findSOPClassAndInstanceInDataSet(*imageDataSet, sopClass, sopInstance, /*opt_correctUIDPadding*/ OFFalse))
+            if (!DU_findSOPClassAndInstanceInDataSet(dataset, sopClass, sopInstance, /*opt_correctUIDPadding*/ OFFalse))
             {
               //LOG4CPP_ERROR(Internals::GetLogger(), "bad DICOM file: " << fileName);
               rsp->DimseStatus = STATUS_STORE_Error_CannotUnderstand;
@@ -261,19 +277,13 @@ namespace Orthanc
       callbackData.distantAET = "";
     }
 
-    DcmFileFormat dcmff;
-
-    // store SourceApplicationEntityTitle in metaheader
-    if (assoc && assoc->params)
-    {
-      const char *aet = assoc->params->DULparams.callingAPTitle;
-      if (aet) dcmff.getMetaInfo()->putAndInsertString(DCM_SourceApplicationEntityTitle, aet);
-    }
-
-    // define an address where the information which will be received over the network will be stored
-    DcmDataset *dset = dcmff.getDataset();
+    // Receive the dataset in the bit-preserving mode: The PDV stream
+    // is written as such to a temporary file, preceded by a
+    // meta-header, without being decoded and re-encoded. The file is
+    // removed once the instance is stored.
+    Toolbox::TemporaryFile tmp(".dcm");
 
-    cond = DIMSE_storeProvider(assoc, presID, req, NULL, /*opt_useMetaheader*/OFFalse, &dset,
+    cond = DIMSE_storeProvider(assoc, presID, req, tmp.GetPath().c_str(), /*opt_useMetaheader*/OFTrue, NULL,
                                storeScpCallback, &callbackData, 
                                /*opt_blockMode*/ DIMSE_BLOCKING, 
                                /*opt_dimse_timeout*/ 0);
@@ -34,6 +34,7 @@
 #include <glog/logging.h>
 #include <boost/regex.hpp> 
 
+#include "../Core/DicomFormat/CompactDicomTags.h"
 #include "../Core/DicomFormat/DicomArray.h"
 #include "ServerToolbox.h"
 #include "OrthancInitialization.h"
@@ -163,7 +164,7 @@ namespace Orthanc
   }
 
 
-  static bool Matches(const Json::Value& resource,
+  static bool Matches(const CompactDicomTags& resource,
                       const DicomArray& query)
   {
     for (size_t i = 0; i < query.GetSize(); i++)
@@ -176,12 +177,8 @@ namespace Orthanc
         continue;
       }
 
-      std::string tag = query.GetElement(i).GetTag().Format();
       std::string value;
-      if (resource.isMember(tag))
-      {
-        value = resource.get(tag, Json::arrayValue).get("Value", "").asString();
-      }
+      resource.LookupValue(value, query.GetElement(i).GetTag());
 
       if (!Matches(value, query.GetElement(i).GetValue().AsString()))
       {
@@ -194,7 +191,7 @@ namespace Orthanc
 
 
   static void AddAnswer(DicomFindAnswers& answers,
-                        const Json::Value& resource,
+                        const CompactDicomTags& resource,
                         const DicomArray& query)
   {
     DicomMap result;
@@ -204,11 +201,9 @@ namespace Orthanc
       if (query.GetElement(i).GetTag() != DICOM_TAG_QUERY_RETRIEVE_LEVEL &&
           query.GetElement(i).GetTag() != DICOM_TAG_SPECIFIC_CHARACTER_SET)
       {
-        std::string tag = query.GetElement(i).GetTag().Format();
         std::string value;
-        if (resource.isMember(tag))
+        if (resource.LookupValue(value, query.GetElement(i).GetTag()))
         {
-          value = resource.get(tag, Json::arrayValue).get("Value", "").asString();
           result.SetValue(query.GetElement(i).GetTag(), value);
         }
         else
@@ -412,12 +407,7 @@ namespace Orthanc
         }
         else
         {
-          Json::Value tmp;
-          index_.GetAllUuids(tmp, level_);
-          for (Json::Value::ArrayIndex i = 0; i < tmp.size(); i++)
-          {
-            resources.push_back(tmp[i].asString());
-          }
+          index_.GetAllUuids(resources, level_);
         }
       }
 
@@ -573,9 +563,10 @@ namespace Orthanc
         std::string instance;
         if (LookupOneInstance(instance, context_.GetIndex(), *resource, level))
         {
-          Json::Value info;
-          context_.ReadJson(info, instance);
-        
+          std::string buffer;
+          context_.ReadCompactTags(buffer, instance);
+
+          CompactDicomTags info(buffer);
           if (Matches(info, query))
           {
             AddAnswer(answers, info, query);
@@ -62,18 +62,82 @@ namespace Orthanc
   {
     ServerContext& context = OrthancRestApi::GetContext(call);
 
-    const std::string& postData = call.GetPostBody();
-    if (postData.size() == 0)
+    // The body is not copied: It is either in memory, or in a
+    // temporary file that is mapped in memory
+    HttpRequestBody& body = call.GetBody();
+    if (body.GetSize() == 0)
     {
       return;
     }
 
-    LOG(INFO) << "Receiving a DICOM file of " << postData.size() << " bytes through HTTP";
+    LOG(INFO) << "Receiving a DICOM file of " << body.GetSize() << " bytes through HTTP";
+
+    const char* data = body.GetData();
 
     std::string publicId;
-    StoreStatus status = context.Store(publicId, postData);
+    StoreStatus status;
+    if (context.Ingest(status, publicId, data, static_cast<size_t>(body.GetSize())))
+    {
+      OrthancRestApi::GetApi(call).AnswerStoredInstance(call, publicId, status);
+    }
+    else
+    {
+      LOG(WARNING) << "The ingest queue is full, the DICOM file is refused";
+      call.GetOutput().SignalError(HttpStatus_503_ServiceUnavailable);
+    }
+  }
+
+
+  static void SubmitDicomFile(RestApi::PostCall& call)
+  {
+    ServerContext& context = OrthancRestApi::GetContext(call);
+
+    HttpRequestBody& body = call.GetBody();
+    if (body.GetSize() == 0)
+    {
+      return;
+    }
+
+    LOG(INFO) << "Submitting a DICOM file of " << body.GetSize() << " bytes to the ingest queue";
+
+    const char* data = body.GetData();
 
-    OrthancRestApi::GetApi(call).AnswerStoredInstance(call, publicId, status);
+    std::string jobId;
+    if (context.SubmitIngest(jobId, data, static_cast<size_t>(body.GetSize())))
+    {
+      Json::Value result = Json::objectValue;
+      result["ID"] = jobId;
+      result["Path"] = "/ingest/" + jobId;
+      call.GetOutput().AnswerJson(result, HttpStatus_202_Accepted);
+    }
+    else
+    {
+      LOG(WARNING) << "The ingest queue is full, the DICOM file is refused";
+      call.GetOutput().SignalError(HttpStatus_503_ServiceUnavailable);
+    }
+  }
+
+
+  static void GetIngestJob(RestApi::GetCall& call)
+  {
+    Json::Value result;
+    if (OrthancRestApi::GetContext(call).LookupIngestJob(result, call.GetUriComponent("id", "")))
+    {
+      if (result.isMember("Instance"))
+      {
+        result["Path"] = GetBasePath(ResourceType_Instance, result["Instance"].asString());
+      }
+
+      call.GetOutput().AnswerJson(result);
+    }
+  }
+
+
+  static void GetIngestStatistics(RestApi::GetCall& call)
+  {
+    Json::Value result;
+    OrthancRestApi::GetContext(call).GetIngestStatistics(result);
+    call.GetOutput().AnswerJson(result);
   }
 
 
@@ -81,7 +145,8 @@ namespace Orthanc
   // Registration of the various REST handlers --------------------------------
 
   OrthancRestApi::OrthancRestApi(ServerContext& context) : 
-    context_(context)
+    context_(context),
+    httpServer_(NULL)
   {
     RegisterSystem();
 
@@ -92,5 +157,8 @@ namespace Orthanc
     RegisterArchive();
 
     Register("/instances", UploadDicomFile);
+    Register("/ingest", SubmitDicomFile);
+    Register("/ingest", GetIngestStatistics);
+    Register("/ingest/{id}", GetIngestJob);
   }
 }
@@ -34,6 +34,7 @@
 
 #include "../ServerContext.h"
 #include "../../Core/RestApi/RestApi.h"
+#include "../../Core/HttpServer/MongooseServer.h"
 
 #include <set>
 
@@ -46,6 +47,7 @@ namespace Orthanc
 
   private:
     ServerContext& context_;
+    const MongooseServer* httpServer_;
 
     void RegisterSystem();
 
@@ -77,6 +79,17 @@ namespace Orthanc
       return GetContext(call).GetIndex();
     }
 
+    // The HTTP server that owns this REST API, if any
+    void SetHttpServer(const MongooseServer& server)
+    {
+      httpServer_ = &server;
+    }
+
+    const MongooseServer* GetHttpServer() const
+    {
+      return httpServer_;
+    }
+
     void AnswerStoredInstance(RestApi::PostCall& call,
                               const std::string& publicId,
                               StoreStatus status);
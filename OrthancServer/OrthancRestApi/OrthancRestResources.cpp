@@ -34,6 +34,7 @@
 
 #include "../ServerToolbox.h"
 #include "../FromDcmtkBridge.h"
+#include "../../Core/DicomFormat/CompactDicomTags.h"
 
 #include <glog/logging.h>
 
@@ -44,9 +45,23 @@ namespace Orthanc
   template <enum ResourceType resourceType>
   static void ListResources(RestApi::GetCall& call)
   {
-    Json::Value result;
+    // This list can be very large: It is streamed to the client. The
+    // identifiers are however loaded beforehand, so that the index is
+    // not locked while the answer is written to a slow client.
+    std::list<std::string> result;
     OrthancRestApi::GetIndex(call).GetAllUuids(result, resourceType);
-    call.GetOutput().AnswerJson(result);
+
+    JsonStreamWriter& writer = call.GetOutput().StartJsonStream();
+    writer.StartArray();
+
+    for (std::list<std::string>::const_iterator
+           it = result.begin(); it != result.end(); ++it)
+    {
+      writer.WriteString(*it);
+    }
+
+    writer.EndArray();
+    call.GetOutput().FinishJsonStream();
   }
 
   template <enum ResourceType resourceType>
@@ -105,11 +120,35 @@ namespace Orthanc
 
 
   // Get information about a single instance ----------------------------------
+
+  /**
+   * The answers that derive from the DICOM file of an instance are
+   * revalidated through its entity tag. They cannot be cached without
+   * revalidation: The identifier of an instance derives from its
+   * DICOM UIDs, so that an instance that is deleted, then stored
+   * again with other content, keeps the same URI.
+   **/
+  static const char* INSTANCE_CACHE_CONTROL = "no-cache";
+
+  static bool IsInstanceNotModified(RestApi::GetCall& call)
+  {
+    ServerContext& context = OrthancRestApi::GetContext(call);
+
+    std::string etag;
+    return (context.LookupETag(etag, call.GetUriComponent("id", ""), FileContentType_Dicom) &&
+            call.GetOutput().CheckETag(etag, INSTANCE_CACHE_CONTROL));
+  }
+
  
   static void GetInstanceFile(RestApi::GetCall& call)
   {
     ServerContext& context = OrthancRestApi::GetContext(call);
 
+    if (IsInstanceNotModified(call))
+    {
+      return;
+    }
+
     std::string publicId = call.GetUriComponent("id", "");
     context.AnswerDicomFile(call.GetOutput(), publicId, FileContentType_Dicom);
   }
@@ -135,21 +174,14 @@ namespace Orthanc
   {
     ServerContext& context = OrthancRestApi::GetContext(call);
 
-    std::string publicId = call.GetUriComponent("id", "");
-    
-    Json::Value full;
-    context.ReadJson(full, publicId);
-
-    if (simplify)
+    if (IsInstanceNotModified(call))
     {
-      Json::Value simplified;
-      SimplifyTags(simplified, full);
-      call.GetOutput().AnswerJson(simplified);
-    }
-    else
-    {
-      call.GetOutput().AnswerJson(full);
+      return;
     }
+
+    std::string publicId = call.GetUriComponent("id", "");
+    
+    context.AnswerDicomAsJson(call.GetOutput(), publicId, simplify);
   }
 
   
@@ -197,6 +229,11 @@ namespace Orthanc
       return;
     }
 
+    if (IsInstanceNotModified(call))
+    {
+      return;
+    }
+
     std::string publicId = call.GetUriComponent("id", "");
     std::string dicomContent, png;
     context.ReadFile(dicomContent, publicId, FileContentType_Dicom);
@@ -355,6 +392,25 @@ namespace Orthanc
   }
 
 
+  // The "dicom-as-json" attachment is stored in a compact binary
+  // format, but its public "data", "size" and "md5" refer to its JSON
+  // rendering, as with the former versions of Orthanc
+  static void ReadDicomAsJsonData(std::string& content, RestApi::Call& call)
+  {
+    ServerContext& context = OrthancRestApi::GetContext(call);
+    std::string publicId = call.GetUriComponent("id", "");
+
+    context.ReadFile(content, publicId, FileContentType_DicomAsJson, true);
+
+    if (CompactDicomTags::IsCompact(content))
+    {
+      Json::Value json;
+      CompactDicomTags(content).ToJson(json);
+      content = json.toStyledString();
+    }
+  }
+
+
   static void GetAttachmentOperations(RestApi::GetCall& call)
   {
     FileInfo info;
@@ -400,11 +456,29 @@ namespace Orthanc
     std::string publicId = call.GetUriComponent("id", "");
     std::string name = call.GetUriComponent("name", "");
 
-    std::string content;
-    context.ReadFile(content, publicId, StringToContentType(name),
-                     (uncompress == 1));
+    FileContentType contentType = StringToContentType(name);
+
+    // The attachments can be replaced, so that the clients must
+    // revalidate their cached copy
+    std::string etag;
+    if (context.LookupETag(etag, publicId, contentType) &&
+        call.GetOutput().CheckETag(etag, "no-cache"))
+    {
+      return;
+    }
 
-    call.GetOutput().AnswerBuffer(content, "application/octet-stream");
+    if (uncompress == 1 &&
+        contentType == FileContentType_DicomAsJson)
+    {
+      std::string content;
+      ReadDicomAsJsonData(content, call);
+      call.GetOutput().AnswerBuffer(content, "application/octet-stream");
+    }
+    else
+    {
+      // Stream the attachment, which gives support for HTTP ranges
+      context.AnswerAttachment(call.GetOutput(), publicId, contentType, (uncompress == 1));
+    }
   }
 
 
@@ -413,7 +487,16 @@ namespace Orthanc
     FileInfo info;
     if (GetAttachmentInfo(info, call))
     {
-      call.GetOutput().AnswerBuffer(boost::lexical_cast<std::string>(info.GetUncompressedSize()), "text/plain");
+      uint64_t size = info.GetUncompressedSize();
+
+      if (info.GetContentType() == FileContentType_DicomAsJson)
+      {
+        std::string content;
+        ReadDicomAsJsonData(content, call);
+        size = content.size();
+      }
+
+      call.GetOutput().AnswerBuffer(boost::lexical_cast<std::string>(size), "text/plain");
     }
   }
 
@@ -434,7 +517,16 @@ namespace Orthanc
     if (GetAttachmentInfo(info, call) &&
         info.GetUncompressedMD5() != "")
     {
-      call.GetOutput().AnswerBuffer(boost::lexical_cast<std::string>(info.GetUncompressedMD5()), "text/plain");
+      std::string md5 = info.GetUncompressedMD5();
+
+      if (info.GetContentType() == FileContentType_DicomAsJson)
+      {
+        std::string content;
+        ReadDicomAsJsonData(content, call);
+        Toolbox::ComputeMD5(md5, content);
+      }
+
+      call.GetOutput().AnswerBuffer(md5, "text/plain");
     }
   }
 
@@ -512,12 +604,11 @@ namespace Orthanc
     std::string publicId = call.GetUriComponent("id", "");
     std::string name = call.GetUriComponent("name", "");
 
-    const void* data = call.GetPutBody().size() ? &call.GetPutBody()[0] : NULL;
-
     FileContentType contentType = StringToContentType(name);
     if (contentType >= FileContentType_StartUser &&  // It is forbidden to modify internal attachments
         contentType <= FileContentType_EndUser &&
-        context.AddAttachment(publicId, StringToContentType(name), data, call.GetPutBody().size()))
+        context.AddAttachment(publicId, StringToContentType(name), call.GetBody().GetData(), 
+                              static_cast<size_t>(call.GetBody().GetSize())))
     {
       call.GetOutput().AnswerBuffer("{}", "application/json");
     }
@@ -546,6 +637,11 @@ namespace Orthanc
 
   static void GetRawContent(RestApi::GetCall& call)
   {
+    if (IsInstanceNotModified(call))
+    {
+      return;
+    }
+
     std::string id = call.GetUriComponent("id", "");
 
     ServerContext::DicomCacheLocker locker(OrthancRestApi::GetContext(call), id);
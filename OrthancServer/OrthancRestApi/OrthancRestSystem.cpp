@@ -36,6 +36,7 @@
 #include "../FromDcmtkBridge.h"
 
 #include <glog/logging.h>
+#include <boost/lexical_cast.hpp>
 
 
 namespace Orthanc
@@ -61,9 +62,50 @@ namespace Orthanc
   {
     Json::Value result = Json::objectValue;
     OrthancRestApi::GetIndex(call).ComputeStatistics(result);
+
+    Json::Value tiers;
+    OrthancRestApi::GetContext(call).GetStorageStatistics(tiers);
+    if (tiers.size() > 0)
+    {
+      result["StorageTiers"] = tiers;
+    }
+
     call.GetOutput().AnswerJson(result);
   }
 
+  static void GetHttpStatistics(RestApi::GetCall& call)
+  {
+    Json::Value result = Json::objectValue;
+
+    const MongooseServer* server = OrthancRestApi::GetApi(call).GetHttpServer();
+    if (server != NULL)
+    {
+      unsigned int active, peak;
+      uint64_t total, saturations;
+      server->GetThreadsStatistics(active, peak, total, saturations);
+
+      result["ThreadsCount"] = server->GetThreadsCount();
+      result["ActiveRequests"] = active;
+      result["PeakActiveRequests"] = peak;
+      result["TotalRequests"] = boost::lexical_cast<std::string>(total);
+      result["Saturations"] = boost::lexical_cast<std::string>(saturations);
+      result["KeepAlive"] = server->IsKeepAliveEnabled();
+    }
+
+    Json::Value routes;
+    OrthancRestApi::GetApi(call).GetRoutesMetrics(routes);
+    result["Routes"] = routes;
+
+    call.GetOutput().AnswerJson(result);
+  }
+
+  static void GetPrometheusMetrics(RestApi::GetCall& call)
+  {
+    std::string result;
+    OrthancRestApi::GetApi(call).FormatPrometheus(result);
+    call.GetOutput().AnswerBuffer(result, "text/plain; version=0.0.4");
+  }
+
   static void GenerateUid(RestApi::GetCall& call)
   {
     std::string level = call.GetArgument("level", "");
@@ -89,7 +131,7 @@ namespace Orthanc
   {
     std::string result;
     ServerContext& context = OrthancRestApi::GetContext(call);
-    context.GetLuaContext().Execute(result, call.GetPostBody());
+    context.GetLuaContextPool().Execute(result, call.GetPostBody());
     call.GetOutput().AnswerBuffer(result, "text/plain");
   }
 
@@ -103,6 +145,8 @@ namespace Orthanc
     Register("/", ServeRoot);
     Register("/system", GetSystemInformation);
     Register("/statistics", GetStatistics);
+    Register("/statistics/http", GetHttpStatistics);
+    Register("/tools/metrics-prometheus", GetPrometheusMetrics);
     Register("/tools/generate-uid", GenerateUid);
     Register("/tools/execute-script", ExecuteScript);
     Register("/tools/now", GetNowIsoString);
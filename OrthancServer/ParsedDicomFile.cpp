@@ -1052,6 +1052,24 @@ namespace Orthanc
     Setup(content, size);
   }
 
+  ParsedDicomFile* ParsedDicomFile::CreateFromHeader(const char* content,
+                                                     size_t size)
+  {
+    // The pixel data is truncated rather than removed, so that the
+    // resulting tags (including 7fe0,0010 and the elements after it)
+    // are the same as with a full parsing
+    std::string truncated;
+    if (FromDcmtkBridge::TruncatePixelData(truncated, content, size))
+    {
+      return new ParsedDicomFile(truncated);
+    }
+    else
+    {
+      return new ParsedDicomFile(content, size);
+    }
+  }
+
+
   ParsedDicomFile::ParsedDicomFile(const std::string& content) : pimpl_(new PImpl)
   {
     if (content.size() == 0)
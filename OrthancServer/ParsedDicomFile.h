@@ -58,6 +58,14 @@ namespace Orthanc
 
     ParsedDicomFile(const std::string& content);
 
+    /**
+     * Parses the tags without loading the whole pixel data into
+     * memory: Only its first bytes are kept. The resulting object
+     * must only be used to read the DICOM tags.
+     **/
+    static ParsedDicomFile* CreateFromHeader(const char* content,
+                                             size_t size);
+
     ~ParsedDicomFile();
 
     void* GetDcmtkObject();
@@ -32,12 +32,15 @@
 
 #include "ServerContext.h"
 
+#include "../Core/DicomFormat/CompactDicomTags.h"
 #include "../Core/HttpServer/FilesystemHttpSender.h"
 #include "../Core/Lua/LuaFunctionCall.h"
 #include "FromDcmtkBridge.h"
 #include "ServerToolbox.h"
 #include "OrthancInitialization.h"
 
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
 #include <glog/logging.h>
 #include <EmbeddedResources.h>
 #include <dcmtk/dcmdata/dcfilefo.h>
@@ -48,6 +51,19 @@ static const char* RECEIVED_INSTANCE_FILTER = "ReceivedInstanceFilter";
 
 static const size_t DICOM_CACHE_SIZE = 2;
 
+// Beyond this number of instances waiting for the generation of their
+// "dicom-as-json" attachment by the background thread, the oldest
+// ones are left to be generated on their first access
+static const unsigned int MAX_PENDING_DICOM_AS_JSON = 10000;
+
+// Maximum memory used by the cache of the rendered DICOM tags (in bytes)
+static const size_t TAGS_CACHE_SIZE = 32 * 1024 * 1024;
+
+// Number of bytes that are read at the beginning of a DICOM file to
+// get its transfer syntax, which is more than enough for the
+// meta-header
+static const size_t META_HEADER_PREFIX = 16 * 1024;
+
 /**
  * IMPORTANT: We make the assumption that the same instance of
  * FileStorage can be accessed from multiple threads. This seems OK
@@ -59,6 +75,235 @@ static const size_t DICOM_CACHE_SIZE = 2;
 
 namespace Orthanc
 {
+  namespace
+  {
+    class PendingDicomAsJson : public IDynamicObject
+    {
+    private:
+      std::string instance_;
+
+    public:
+      PendingDicomAsJson(const std::string& instance) : instance_(instance)
+      {
+      }
+
+      const std::string& GetInstance() const
+      {
+        return instance_;
+      }
+    };
+
+
+    // Prevents a file from being removed while it is read, even if
+    // its attachment is deleted or replaced in the meantime
+    class PinnedFile : public boost::noncopyable
+    {
+    private:
+      ServerIndex& index_;
+      std::string uuid_;
+
+    public:
+      PinnedFile(ServerIndex& index,
+                 const std::string& uuid) :
+        index_(index),
+        uuid_(uuid)
+      {
+        index_.PinFile(uuid_);
+      }
+
+      ~PinnedFile()
+      {
+        try
+        {
+          index_.UnpinFile(uuid_);
+        }
+        catch (OrthancException& e)
+        {
+          LOG(ERROR) << "Cannot unpin file " << uuid_ << ": " << e.What();
+        }
+      }
+    };
+
+
+    class BufferIngestJob : public IngestQueue::IJob
+    {
+    private:
+      ServerContext& context_;
+      const char* buffer_;
+      size_t size_;
+      std::string copy_;
+
+    public:
+      // In the synchronous mode, the buffer outlives the job, which
+      // avoids a copy of the DICOM file
+      BufferIngestJob(ServerContext& context,
+                      const char* buffer,
+                      size_t size,
+                      bool copy) :
+        context_(context),
+        buffer_(buffer),
+        size_(size)
+      {
+        if (copy && size > 0)
+        {
+          copy_.assign(buffer, size);
+          buffer_ = copy_.c_str();
+        }
+      }
+
+      virtual StoreStatus Execute(std::string& publicId)
+      {
+        return context_.Store(publicId, buffer_, size_);
+      }
+    };
+
+
+    class ReceivedIngestJob : public IngestQueue::IJob
+    {
+    private:
+      ServerContext& context_;
+      const char* dicomInstance_;
+      size_t dicomSize_;
+      const DicomMap& dicomSummary_;
+      const Json::Value& dicomJson_;
+      const std::string& remoteAet_;
+
+    public:
+      ReceivedIngestJob(ServerContext& context,
+                        const char* dicomInstance,
+                        size_t dicomSize,
+                        const DicomMap& dicomSummary,
+                        const Json::Value& dicomJson,
+                        const std::string& remoteAet) :
+        context_(context),
+        dicomInstance_(dicomInstance),
+        dicomSize_(dicomSize),
+        dicomSummary_(dicomSummary),
+        dicomJson_(dicomJson),
+        remoteAet_(remoteAet)
+      {
+      }
+
+      virtual StoreStatus Execute(std::string& publicId)
+      {
+        return context_.Store(dicomInstance_, dicomSize_, dicomSummary_, dicomJson_, remoteAet_);
+      }
+    };
+
+
+    // Gives the Lua filter access to the tags of an incoming instance,
+    // indexed by their name as in "simplified-tags". A tag is only
+    // converted if the script reads it.
+    class IncomingInstanceTags : public ILuaLazyObject
+    {
+    private:
+      const char* dicomInstance_;
+      size_t dicomSize_;
+      const DicomMap& dicomSummary_;
+      const Json::Value& dicomJson_;
+      std::auto_ptr<ParsedDicomFile> header_;
+
+      DcmDataset& GetDataset()
+      {
+        // The JSON summary was not computed by the caller: Parse the
+        // instance on the first access to a tag that is not a main tag
+        if (header_.get() == NULL)
+        {
+          header_.reset(ParsedDicomFile::CreateFromHeader(dicomInstance_, dicomSize_));
+        }
+
+        return *reinterpret_cast<DcmFileFormat*>(header_->GetDcmtkObject())->getDataset();
+      }
+
+      bool LookupJson(Json::Value& json,
+                      const DicomTag& tag)
+      {
+        if (dicomJson_.type() != Json::nullValue)
+        {
+          std::string key = tag.Format();
+          if (!dicomJson_.isMember(key))
+          {
+            return false;
+          }
+
+          json = Json::objectValue;
+          json[key] = dicomJson_[key];
+          return true;
+        }
+
+        return FromDcmtkBridge::ToJson(json, GetDataset(), tag);
+      }
+
+    public:
+      IncomingInstanceTags(const char* dicomInstance,
+                           size_t dicomSize,
+                           const DicomMap& dicomSummary,
+                           const Json::Value& dicomJson) :
+        dicomInstance_(dicomInstance),
+        dicomSize_(dicomSize),
+        dicomSummary_(dicomSummary),
+        dicomJson_(dicomJson)
+      {
+      }
+
+      virtual bool LookupField(Json::Value& value,
+                               const std::string& name)
+      {
+        DicomTag tag(0, 0);
+
+        try
+        {
+          tag = FromDcmtkBridge::ParseTag(name);
+        }
+        catch (OrthancException&)
+        {
+          return false;  // Unknown tag name
+        }
+
+        if (dicomSummary_.HasTag(tag))
+        {
+          const DicomValue& v = dicomSummary_.GetValue(tag);
+          if (v.IsNull())
+          {
+            value = Json::nullValue;
+          }
+          else
+          {
+            value = v.AsString();
+          }
+
+          return true;
+        }
+
+        Json::Value json, simplified;
+        if (!LookupJson(json, tag))
+        {
+          return false;
+        }
+
+        SimplifyTags(simplified, json);
+        assert(simplified.size() == 1);
+        value = *simplified.begin();
+        return true;
+      }
+
+      virtual void GetAllFields(Json::Value& target)
+      {
+        if (dicomJson_.type() != Json::nullValue)
+        {
+          SimplifyTags(target, dicomJson_);
+        }
+        else
+        {
+          Json::Value json;
+          FromDcmtkBridge::ToJson(json, GetDataset());
+          SimplifyTags(target, json);
+        }
+      }
+    };
+  }
+
+
   ServerContext::ServerContext(const boost::filesystem::path& storagePath,
                                const boost::filesystem::path& indexPath) :
     storage_(storagePath.string()),
@@ -66,12 +311,48 @@ namespace Orthanc
     accessor_(storage_),
     compressionEnabled_(false),
     provider_(*this),
-    dicomCache_(provider_, DICOM_CACHE_SIZE)
+    dicomCache_(provider_, DICOM_CACHE_SIZE),
+    lazyDicomAsJson_(false),
+    pendingDicomAsJson_(MAX_PENDING_DICOM_AS_JSON),
+    tagsCacheSize_(0),
+    tagsCacheHits_(0),
+    tagsCacheMisses_(0),
+    done_(false)
   {
     scu_.SetLocalApplicationEntityTitle(Configuration::GetGlobalStringParameter("DicomAet", "ORTHANC"));
     //scu_.SetMillisecondsBeforeClose(1);  // The connection is always released
 
-    lua_.Execute(Orthanc::EmbeddedResources::LUA_TOOLBOX);
+    lua_.LoadScript(Orthanc::EmbeddedResources::LUA_TOOLBOX);
+  }
+
+  ServerContext::~ServerContext()
+  {
+    // Finish the pending instances before anything else is released
+    ingestQueue_.reset(NULL);
+
+    done_ = true;
+
+    if (rebalancingThread_.joinable())
+    {
+      rebalancingThread_.join();
+    }
+
+    if (migrationThread_.joinable())
+    {
+      migrationThread_.join();
+    }
+
+    if (dicomAsJsonThread_.joinable())
+    {
+      dicomAsJsonThread_.join();
+    }
+
+    while (tagsCache_.GetSize() > 0)
+    {
+      std::string* answer = NULL;
+      tagsCache_.RemoveOldest(answer);
+      delete answer;
+    }
   }
 
   void ServerContext::SetCompressionEnabled(bool enabled)
@@ -84,11 +365,317 @@ namespace Orthanc
     compressionEnabled_ = enabled;
   }
 
+  void ServerContext::SetStorageDeduplication(bool enabled)
+  {
+    if (enabled)
+    {
+      LOG(WARNING) << "Storage deduplication is enabled";
+      index_.EnableSharedFiles();
+    }
+    else
+    {
+      LOG(WARNING) << "Storage deduplication is disabled";
+    }
+
+    storage_.SetContentAddressed(enabled);
+  }
+
+  void ServerContext::SetStorageDurability(bool enabled)
+  {
+    if (enabled)
+      LOG(WARNING) << "The new files of the storage area are flushed to the disk before being indexed";
+    else
+      LOG(WARNING) << "The new files of the storage area are not explicitly flushed to the disk";
+
+    storage_.SetDurable(enabled);
+  }
+
+  void ServerContext::AddStorageVolume(const boost::filesystem::path& path)
+  {
+    LOG(WARNING) << "Adding a storage volume: " << path;
+    storage_.AddVolume(path.string());
+  }
+
+  void ServerContext::RebalancingThread(ServerContext* that,
+                                        std::string volumes)
+  {
+    LOG(WARNING) << "Starting the rebalancing of the storage volumes";
+
+    std::set<std::string> files;
+    that->storage_.ListAllFiles(files);
+
+    unsigned int count = 0;
+    for (std::set<std::string>::const_iterator 
+           it = files.begin(); it != files.end(); ++it)
+    {
+      if (that->done_)
+      {
+        LOG(WARNING) << "The rebalancing of the storage volumes was interrupted, "
+                     << "it will be resumed at the next startup";
+        return;
+      }
+
+      try
+      {
+        if (that->storage_.Relocate(*it))
+        {
+          count++;
+        }
+      }
+      catch (...)
+      {
+        LOG(ERROR) << "Unable to relocate file " << *it;
+        return;
+      }
+    }
+
+    that->index_.SetGlobalProperty(GlobalProperty_StorageVolumes, volumes);
+
+    LOG(WARNING) << "The rebalancing of the storage volumes is done ("
+                 << count << " files were moved)";
+  }
+
+  void ServerContext::StartStorageRebalancing()
+  {
+    std::string volumes;
+    for (size_t i = 0; i < storage_.GetVolumeCount(); i++)
+    {
+      volumes += storage_.GetVolumePath(i) + "\n";
+    }
+
+    std::string previous;
+    if (!index_.LookupGlobalProperty(previous, GlobalProperty_StorageVolumes))
+    {
+      // First execution with this index: No file can be misplaced
+      // if there is a single volume
+      previous = (storage_.GetVolumeCount() == 1 ? volumes : "");
+    }
+
+    if (previous == volumes)
+    {
+      index_.SetGlobalProperty(GlobalProperty_StorageVolumes, volumes);
+    }
+    else if (!rebalancingThread_.joinable())
+    {
+      rebalancingThread_ = boost::thread(RebalancingThread, this, volumes);
+    }
+  }
+
+  void ServerContext::MigrationThread(ServerContext* that,
+                                      uint64_t maxAge)
+  {
+    static const unsigned int SLEEP = 3600;  // Scan the hot tier every hour
+    static const unsigned int TOUCH = 60;    // Refresh the access times every minute
+
+    LOG(INFO) << "Starting the thread for the migration to the cold tier";
+
+    unsigned int count = SLEEP;
+
+    while (!that->done_)
+    {
+      // The reads of the storage area only record the files to be
+      // promoted and the access times to be refreshed, so as not to
+      // slow down the HTTP requests
+      that->storage_.PromoteColdFiles();
+
+      if (count < SLEEP)
+      {
+        if (count % TOUCH == 0)
+        {
+          that->storage_.FlushAccessTimes();
+        }
+
+        boost::this_thread::sleep(boost::posix_time::seconds(1));
+        count++;
+        continue;
+      }
+
+      count = 0;
+      that->storage_.FlushAccessTimes();
+
+      std::set<std::string> files;
+      that->storage_.ListAllFiles(files);
+
+      unsigned int migrated = 0;
+      for (std::set<std::string>::const_iterator 
+             it = files.begin(); it != files.end() && !that->done_; ++it)
+      {
+        try
+        {
+          if (that->storage_.MigrateToColdTier(*it, maxAge))
+          {
+            migrated++;
+          }
+        }
+        catch (...)
+        {
+          LOG(ERROR) << "Unable to migrate file " << *it << " to the cold tier";
+        }
+      }
+
+      if (migrated > 0)
+      {
+        LOG(WARNING) << migrated << " files were migrated to the cold tier";
+      }
+    }
+
+    LOG(INFO) << "Stopping the thread for the migration to the cold tier";
+  }
+
+  void ServerContext::SetColdTier(const boost::filesystem::path& path,
+                                  uint64_t maxAge,
+                                  bool promotion)
+  {
+    LOG(WARNING) << "Cold tier of the storage: " << path;
+    storage_.SetColdTier(path.string());
+    storage_.SetColdTierPromotion(promotion);
+
+    if (!migrationThread_.joinable())
+    {
+      migrationThread_ = boost::thread(MigrationThread, this, maxAge);
+    }
+  }
+
+  void ServerContext::GetStorageStatistics(Json::Value& target)
+  {
+    target = Json::objectValue;
+
+    if (storage_.HasColdTier())
+    {
+      uint64_t hotReads, coldReads, migrations, promotions;
+      storage_.GetTierStatistics(hotReads, coldReads, migrations, promotions);
+
+      target["HotTierReads"] = boost::lexical_cast<std::string>(hotReads);
+      target["ColdTierReads"] = boost::lexical_cast<std::string>(coldReads);
+      target["ColdTierMigrations"] = boost::lexical_cast<std::string>(migrations);
+      target["ColdTierPromotions"] = boost::lexical_cast<std::string>(promotions);
+
+      if (hotReads + coldReads > 0)
+      {
+        target["HotTierHitRate"] = static_cast<double>(hotReads) / static_cast<double>(hotReads + coldReads);
+      }
+    }
+  }
+
+  void ServerContext::DicomAsJsonThread(ServerContext* that)
+  {
+    LOG(INFO) << "Starting the thread for the generation of the JSON summaries";
+
+    while (!that->done_)
+    {
+      std::auto_ptr<IDynamicObject> obj(that->pendingDicomAsJson_.Dequeue(100));
+      if (obj.get() == NULL)
+      {
+        continue;
+      }
+
+      const std::string& instance = dynamic_cast<PendingDicomAsJson&>(*obj).GetInstance();
+
+      try
+      {
+        FileInfo attachment;
+        if (!that->index_.LookupAttachment(attachment, instance, FileContentType_DicomAsJson))
+        {
+          Json::Value json;
+          std::string compact;
+          that->GenerateDicomAsJson(json, compact, instance);
+        }
+      }
+      catch (OrthancException& e)
+      {
+        // The instance has possibly been deleted in the meantime
+        LOG(INFO) << "Cannot generate the JSON summary of instance " << instance << ": " << e.What();
+      }
+
+      // Give way to the threads that serve the requests
+      boost::this_thread::yield();
+    }
+
+    LOG(INFO) << "Stopping the thread for the generation of the JSON summaries";
+  }
+
+  void ServerContext::SetLazyDicomAsJson(bool lazy,
+                                         bool background)
+  {
+    if (lazy)
+      LOG(WARNING) << "The JSON summary of the incoming instances is generated on demand";
+
+    lazyDicomAsJson_ = lazy;
+
+    if (lazy && background && !dicomAsJsonThread_.joinable())
+    {
+      dicomAsJsonThread_ = boost::thread(DicomAsJsonThread, this);
+    }
+  }
+
+  bool ServerContext::IsDicomAsJsonNeededAtIngest()
+  {
+    return !lazyDicomAsJson_;
+  }
+
   void ServerContext::RemoveFile(const std::string& fileUuid)
   {
+    // The answers rendered from a "dicom-as-json" attachment are
+    // released as soon as the attachment is deleted or replaced
+    InvalidateTagsCache(fileUuid);
     storage_.Remove(fileUuid);
   }
 
+
+  FileInfo ServerContext::WriteAttachment(const void* data,
+                                          size_t size,
+                                          FileContentType type)
+  {
+    FileInfo info = accessor_.Write(data, size, type);
+
+    if (storage_.IsContentAddressed())
+    {
+      // The file might be shared with other attachments: Prevent it
+      // from being reclaimed by a concurrent deletion until it is
+      // attached by the index
+      index_.PinSharedFile(info.GetUuid());
+
+      if (!storage_.Exists(info.GetUuid()))
+      {
+        // The file was reclaimed between its creation and its
+        // pinning: Write it again
+        accessor_.Write(data, size, type);
+      }
+    }
+
+    return info;
+  }
+
+
+  void ServerContext::ReleaseAttachment(const FileInfo& attachment,
+                                        bool isStored)
+  {
+    if (storage_.IsContentAddressed())
+    {
+      // This removes the file if no attachment refers to it
+      index_.UnpinSharedFile(attachment.GetUuid());
+    }
+    else if (!isStored)
+    {
+      storage_.Remove(attachment.GetUuid());
+    }
+  }
+
+  void ServerContext::SynchronizeAttachments(const ServerIndex::Attachments& attachments)
+  {
+    if (storage_.IsDurable())
+    {
+      std::list<std::string> uuids;
+      for (ServerIndex::Attachments::const_iterator
+             it = attachments.begin(); it != attachments.end(); ++it)
+      {
+        uuids.push_back(it->GetUuid());
+      }
+
+      storage_.Synchronize(uuids);
+    }
+  }
+
   StoreStatus ServerContext::Store(const char* dicomInstance,
                                    size_t dicomSize,
                                    const DicomMap& dicomSummary,
@@ -96,19 +683,21 @@ namespace Orthanc
                                    const std::string& remoteAet)
   {
     // Test if the instance must be filtered out
-    if (lua_.IsExistingFunction(RECEIVED_INSTANCE_FILTER))
     {
-      Json::Value simplified;
-      SimplifyTags(simplified, dicomJson);
+      LuaContextPool::Locker locker(lua_);
+      if (locker.GetContext().IsExistingFunction(RECEIVED_INSTANCE_FILTER))
+      {
+        IncomingInstanceTags tags(dicomInstance, dicomSize, dicomSummary, dicomJson);
 
-      LuaFunctionCall call(lua_, RECEIVED_INSTANCE_FILTER);
-      call.PushJSON(simplified);
-      call.PushString(remoteAet);
+        LuaFunctionCall call(locker.GetContext(), RECEIVED_INSTANCE_FILTER);
+        call.PushLazyObject(tags);
+        call.PushString(remoteAet);
 
-      if (!call.ExecutePredicate())
-      {
-        LOG(INFO) << "An incoming instance has been discarded by the filter";
-        return StoreStatus_FilteredOut;
+        if (!call.ExecutePredicate())
+        {
+          LOG(INFO) << "An incoming instance has been discarded by the filter";
+          return StoreStatus_FilteredOut;
+        }
       }
     }
 
@@ -121,25 +710,73 @@ namespace Orthanc
       accessor_.SetCompressionForNextOperations(CompressionType_None);
     }      
 
-    FileInfo dicomInfo = accessor_.Write(dicomInstance, dicomSize, FileContentType_Dicom);
-    FileInfo jsonInfo = accessor_.Write(dicomJson.toStyledString(), FileContentType_DicomAsJson);
+    // In the lazy mode, the JSON summary is only written if the
+    // caller has computed it anyway
+    bool hasJson = (!lazyDicomAsJson_ || dicomJson.type() != Json::nullValue);
+
+    FileInfo dicomInfo = WriteAttachment(dicomInstance, dicomSize, FileContentType_Dicom);
+    FileInfo jsonInfo;
+
+    if (hasJson)
+    {
+      try
+      {
+        std::string compact;
+        CompactDicomTags::Serialize(compact, dicomJson);
+        jsonInfo = WriteAttachment(compact.c_str(), compact.size(), FileContentType_DicomAsJson);
+      }
+      catch (...)
+      {
+        ReleaseAttachment(dicomInfo, false);
+        throw;
+      }
+    }
 
     ServerIndex::Attachments attachments;
     attachments.push_back(dicomInfo);
-    attachments.push_back(jsonInfo);
 
-    StoreStatus status = index_.Store(dicomSummary, attachments, remoteAet);
+    if (hasJson)
+    {
+      attachments.push_back(jsonInfo);
+    }
+
+    StoreStatus status = StoreStatus_Failure;
+
+    try
+    {
+      // The index must only refer to durable files
+      SynchronizeAttachments(attachments);
+      status = index_.Store(dicomSummary, attachments, remoteAet);
+    }
+    catch (...)
+    {
+      ReleaseAttachment(dicomInfo, false);
+
+      if (hasJson)
+      {
+        ReleaseAttachment(jsonInfo, false);
+      }
+
+      throw;
+    }
+
+    ReleaseAttachment(dicomInfo, status == StoreStatus_Success);
 
-    if (status != StoreStatus_Success)
+    if (hasJson)
     {
-      storage_.Remove(dicomInfo.GetUuid());
-      storage_.Remove(jsonInfo.GetUuid());
+      ReleaseAttachment(jsonInfo, status == StoreStatus_Success);
     }
 
     switch (status)
     {
       case StoreStatus_Success:
         LOG(INFO) << "New instance stored";
+
+        if (!hasJson && dicomAsJsonThread_.joinable())
+        {
+          DicomInstanceHasher hasher(dicomSummary);
+          pendingDicomAsJson_.Enqueue(new PendingDicomAsJson(hasher.HashInstance()));
+        }
         break;
 
       case StoreStatus_AlreadyStored:
@@ -159,6 +796,14 @@ namespace Orthanc
   }
 
   
+  static bool IsUncompressedTransferSyntax(const std::string& transferSyntax)
+  {
+    return (transferSyntax == "1.2.840.10008.1.2" ||      // Implicit VR little endian
+            transferSyntax == "1.2.840.10008.1.2.1" ||    // Explicit VR little endian
+            transferSyntax == "1.2.840.10008.1.2.2");     // Explicit VR big endian
+  }
+
+
   void ServerContext::AnswerDicomFile(RestApiOutput& output,
                                       const std::string& instancePublicId,
                                       FileContentType content)
@@ -171,9 +816,79 @@ namespace Orthanc
 
     accessor_.SetCompressionForNextOperations(attachment.GetCompressionType());
 
+    PinnedFile pinned(index_, attachment.GetUuid());
+
     std::auto_ptr<HttpFileSender> sender(accessor_.ConstructHttpFileSender(attachment.GetUuid()));
     sender->SetContentType("application/dicom");
     sender->SetDownloadFilename(instancePublicId + ".dcm");
+
+    const HttpOutput& lowLevel = output.GetLowLevelOutput();
+    if (content == FileContentType_Dicom &&
+        lowLevel.GetRange().empty() &&
+        lowLevel.IsCompressionApplicable(attachment.GetUncompressedSize()))
+    {
+      // Only the DICOM files whose pixel data is not compressed are
+      // worth the HTTP compression: Look at their transfer syntax
+      std::string header, transferSyntax;
+      if (sender->ReadPrefix(header, META_HEADER_PREFIX) &&
+          FromDcmtkBridge::LookupTransferSyntax(transferSyntax, header.c_str(), header.size()) &&
+          IsUncompressedTransferSyntax(transferSyntax))
+      {
+        sender->SetCompressible(true);
+      }
+    }
+
+    output.AnswerFile(*sender);
+  }
+
+
+  bool ServerContext::LookupETag(std::string& etag,
+                                 const std::string& publicId,
+                                 FileContentType content)
+  {
+    FileInfo attachment;
+    if (!index_.LookupAttachment(attachment, publicId, content))
+    {
+      return false;
+    }
+
+    if (attachment.GetUncompressedMD5().empty())
+    {
+      etag = attachment.GetUuid();
+    }
+    else
+    {
+      etag = attachment.GetUncompressedMD5();
+    }
+
+    return true;
+  }
+
+
+  void ServerContext::AnswerAttachment(RestApiOutput& output,
+                                       const std::string& instancePublicId,
+                                       FileContentType content,
+                                       bool uncompressIfNeeded)
+  {
+    FileInfo attachment;
+    if (!index_.LookupAttachment(attachment, instancePublicId, content))
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
+
+    if (uncompressIfNeeded)
+    {
+      accessor_.SetCompressionForNextOperations(attachment.GetCompressionType());
+    }
+    else
+    {
+      accessor_.SetCompressionForNextOperations(CompressionType_None);
+    }
+
+    PinnedFile pinned(index_, attachment.GetUuid());
+
+    std::auto_ptr<HttpFileSender> sender(accessor_.ConstructHttpFileSender(attachment.GetUuid()));
+    sender->SetContentType("application/octet-stream");
     output.AnswerFile(*sender);
   }
 
@@ -181,13 +896,219 @@ namespace Orthanc
   void ServerContext::ReadJson(Json::Value& result,
                                const std::string& instancePublicId)
   {
+    FileInfo attachment;
+    if (!index_.LookupAttachment(attachment, instancePublicId, FileContentType_DicomAsJson))
+    {
+      // The instance was received in the lazy mode
+      std::string compact;
+      GenerateDicomAsJson(result, compact, instancePublicId);
+      return;
+    }
+
     std::string s;
-    ReadFile(s, instancePublicId, FileContentType_DicomAsJson);
+    ReadAttachment(s, attachment, true);
+
+    if (CompactDicomTags::IsCompact(s))
+    {
+      CompactDicomTags(s).ToJson(result);
+    }
+    else
+    {
+      // Attachment written by a former version of Orthanc
+      Json::Reader reader;
+      if (!reader.parse(s, result))
+      {
+        throw OrthancException("Corrupted JSON file");
+      }
+    }
+  }
+
 
-    Json::Reader reader;
-    if (!reader.parse(s, result))
+  bool ServerContext::LookupTagsCache(std::string& result,
+                                      const std::string& key)
+  {
+    boost::mutex::scoped_lock lock(tagsCacheMutex_);
+
+    std::string* answer = NULL;
+    if (tagsCache_.Contains(key, answer))
+    {
+      tagsCache_.MakeMostRecent(key);
+      result = *answer;
+      tagsCacheHits_++;
+      return true;
+    }
+    else
     {
-      throw OrthancException("Corrupted JSON file");
+      tagsCacheMisses_++;
+      return false;
+    }
+  }
+
+
+  void ServerContext::InvalidateTagsCache(const std::string& fileUuid)
+  {
+    static const char* SUFFIXES[] = { "-full", "-simplified", "-full-styled", "-simplified-styled" };
+
+    boost::mutex::scoped_lock lock(tagsCacheMutex_);
+
+    for (size_t i = 0; i < sizeof(SUFFIXES) / sizeof(SUFFIXES[0]); i++)
+    {
+      const std::string key = fileUuid + SUFFIXES[i];
+      if (tagsCache_.Contains(key))
+      {
+        std::string* answer = tagsCache_.Invalidate(key);
+        tagsCacheSize_ -= answer->size();
+        delete answer;
+      }
+    }
+  }
+
+
+  void ServerContext::GetTagsCacheStatistics(size_t& count,
+                                             uint64_t& hits,
+                                             uint64_t& misses)
+  {
+    boost::mutex::scoped_lock lock(tagsCacheMutex_);
+    count = tagsCache_.GetSize();
+    hits = tagsCacheHits_;
+    misses = tagsCacheMisses_;
+  }
+
+
+  void ServerContext::StoreTagsCache(const std::string& key,
+                                     const std::string& answer)
+  {
+    if (answer.size() > TAGS_CACHE_SIZE / 16)
+    {
+      return;  // Too large to be cached
+    }
+
+    boost::mutex::scoped_lock lock(tagsCacheMutex_);
+
+    if (tagsCache_.Contains(key))
+    {
+      return;  // Concurrently added by another thread
+    }
+
+    while (tagsCache_.GetSize() > 0 &&
+           tagsCacheSize_ + answer.size() > TAGS_CACHE_SIZE)
+    {
+      std::string* oldest = NULL;
+      tagsCache_.RemoveOldest(oldest);
+      tagsCacheSize_ -= oldest->size();
+      delete oldest;
+    }
+
+    tagsCache_.Add(key, new std::string(answer));
+    tagsCacheSize_ += answer.size();
+  }
+
+
+  void ServerContext::AnswerDicomAsJson(RestApiOutput& output,
+                                        const std::string& instancePublicId,
+                                        bool simplify)
+  {
+    FileInfo attachment;
+    if (!index_.LookupAttachment(attachment, instancePublicId, FileContentType_DicomAsJson))
+    {
+      // The instance was received in the lazy mode: Generate the
+      // attachment, whose answer will be cached by the next request
+      Json::Value full;
+      ReadJson(full, instancePublicId);
+
+      if (simplify)
+      {
+        Json::Value simplified;
+        SimplifyTags(simplified, full);
+        output.AnswerJson(simplified);
+      }
+      else
+      {
+        output.AnswerJson(full);
+      }
+
+      return;
+    }
+
+    // The attachments are never modified: Their UUID and the style
+    // of the JSON identify the answer
+    const std::string key = (attachment.GetUuid() + 
+                             (simplify ? "-simplified" : "-full") +
+                             (output.IsStyledJson() ? "-styled" : ""));
+
+    std::string answer;
+    if (!LookupTagsCache(answer, key))
+    {
+      std::string content;
+      ReadAttachment(content, attachment, true);
+
+      bool isCompact = CompactDicomTags::IsCompact(content);
+
+      if (!simplify && !isCompact && output.IsStyledJson())
+      {
+        // Attachment written by a former version of Orthanc: It
+        // already contains the styled answer
+        answer.swap(content);
+      }
+      else
+      {
+        Json::Value full;
+        if (isCompact)
+        {
+          CompactDicomTags(content).ToJson(full);
+        }
+        else
+        {
+          Json::Reader reader;
+          if (!reader.parse(content, full))
+          {
+            throw OrthancException("Corrupted JSON file");
+          }
+        }
+
+        if (simplify)
+        {
+          Json::Value simplified;
+          SimplifyTags(simplified, full);
+          answer = output.FormatJson(simplified);
+        }
+        else
+        {
+          answer = output.FormatJson(full);
+        }
+      }
+
+      StoreTagsCache(key, answer);
+    }
+
+    output.AnswerBuffer(answer, "application/json");
+  }
+
+
+  void ServerContext::ReadCompactTags(std::string& result,
+                                      const std::string& instancePublicId)
+  {
+    FileInfo attachment;
+    if (!index_.LookupAttachment(attachment, instancePublicId, FileContentType_DicomAsJson))
+    {
+      Json::Value json;
+      GenerateDicomAsJson(json, result, instancePublicId);
+      return;
+    }
+
+    ReadAttachment(result, attachment, true);
+
+    if (!CompactDicomTags::IsCompact(result))
+    {
+      // Attachment written by a former version of Orthanc
+      Json::Value json;
+      Json::Reader reader;
+      if (!reader.parse(result, json))
+      {
+        throw OrthancException("Corrupted JSON file");
+      }
+
+      CompactDicomTags::Serialize(result, json);
     }
   }
 
@@ -203,6 +1124,14 @@ namespace Orthanc
       throw OrthancException(ErrorCode_InternalError);
     }
 
+    ReadAttachment(result, attachment, uncompressIfNeeded);
+  }
+
+
+  void ServerContext::ReadAttachment(std::string& result,
+                                     const FileInfo& attachment,
+                                     bool uncompressIfNeeded)
+  {
     if (uncompressIfNeeded)
     {
       accessor_.SetCompressionForNextOperations(attachment.GetCompressionType());
@@ -212,6 +1141,7 @@ namespace Orthanc
       accessor_.SetCompressionForNextOperations(CompressionType_None);
     }
 
+    PinnedFile pinned(index_, attachment.GetUuid());
     accessor_.Read(result, attachment.GetUuid());
   }
 
@@ -234,7 +1164,17 @@ namespace Orthanc
     dicom_ = dynamic_cast<ParsedDicomFile*>(p.get());
 #else
     that_.dicomCacheMutex_.lock();
-    dicom_ = &dynamic_cast<ParsedDicomFile&>(that_.dicomCache_.Access(instancePublicId));
+
+    try
+    {
+      dicom_ = &dynamic_cast<ParsedDicomFile&>(that_.dicomCache_.Access(instancePublicId));
+    }
+    catch (...)
+    {
+      // The destructor will not be called
+      that_.dicomCacheMutex_.unlock();
+      throw;
+    }
 #endif
   }
 
@@ -254,6 +1194,83 @@ namespace Orthanc
   }
 
 
+  class ServerContext::GenerationLock : public boost::noncopyable
+  {
+  private:
+    ServerContext& that_;
+    std::string instance_;
+
+  public:
+    GenerationLock(ServerContext& that,
+                   const std::string& instance) :
+      that_(that),
+      instance_(instance)
+    {
+      boost::mutex::scoped_lock lock(that_.generationMutex_);
+
+      while (that_.generatingInstances_.find(instance_) != that_.generatingInstances_.end())
+      {
+        that_.generationDone_.wait(lock);
+      }
+
+      that_.generatingInstances_.insert(instance_);
+    }
+
+    ~GenerationLock()
+    {
+      boost::mutex::scoped_lock lock(that_.generationMutex_);
+      that_.generatingInstances_.erase(instance_);
+      that_.generationDone_.notify_all();
+    }
+  };
+
+
+  void ServerContext::GenerateDicomAsJson(Json::Value& json,
+                                          std::string& compact,
+                                          const std::string& instancePublicId)
+  {
+    // Only one thread at a time generates the summary of a given
+    // instance, the other ones reuse its result
+    GenerationLock generation(*this, instancePublicId);
+
+    FileInfo attachment;
+    if (index_.LookupAttachment(attachment, instancePublicId, FileContentType_DicomAsJson))
+    {
+      // Concurrently generated by another thread
+      ReadAttachment(compact, attachment, true);
+
+      if (!CompactDicomTags::IsCompact(compact))
+      {
+        Json::Reader reader;
+        if (!reader.parse(compact, json))
+        {
+          throw OrthancException("Corrupted JSON file");
+        }
+
+        CompactDicomTags::Serialize(compact, json);
+      }
+      else
+      {
+        CompactDicomTags(compact).ToJson(json);
+      }
+
+      return;
+    }
+
+    {
+      DicomCacheLocker locker(*this, instancePublicId);
+      FromDcmtkBridge::ToJson(json, *GetDicom(locker.GetDicom()).getDataset());
+    }
+
+    // Store the JSON summary for the next accesses
+    CompactDicomTags::Serialize(compact, json);
+    if (!AddAttachment(instancePublicId, FileContentType_DicomAsJson, compact.c_str(), compact.size()))
+    {
+      LOG(WARNING) << "Cannot store the JSON summary of instance " << instancePublicId;
+    }
+  }
+
+
   StoreStatus ServerContext::Store(std::string& resultPublicId,
                                    ParsedDicomFile& dicomInstance,
                                    const char* dicomBuffer,
@@ -268,7 +1285,10 @@ namespace Orthanc
       resultPublicId = hasher.HashInstance();
 
       Json::Value dicomJson;
-      FromDcmtkBridge::ToJson(dicomJson, *GetDicom(dicomInstance).getDataset());
+      if (IsDicomAsJsonNeededAtIngest())
+      {
+        FromDcmtkBridge::ToJson(dicomJson, *GetDicom(dicomInstance).getDataset());
+      }
       
       StoreStatus status = StoreStatus_Failure;
       if (dicomSize > 0)
@@ -310,8 +1330,10 @@ namespace Orthanc
                                    const char* dicomBuffer,
                                    size_t dicomSize)
   {
-    ParsedDicomFile dicom(dicomBuffer, dicomSize);
-    return Store(resultPublicId, dicom, dicomBuffer, dicomSize);
+    // The pixel data is not needed for the indexing: The raw bytes are
+    // stored untouched
+    std::auto_ptr<ParsedDicomFile> header(ParsedDicomFile::CreateFromHeader(dicomBuffer, dicomSize));
+    return Store(resultPublicId, *header, dicomBuffer, dicomSize);
   }
 
 
@@ -329,6 +1351,97 @@ namespace Orthanc
   }
 
 
+  void ServerContext::SetupIngestQueue(unsigned int countThreads,
+                                       unsigned int maxSize,
+                                       bool blocking)
+  {
+    if (countThreads == 0)
+    {
+      countThreads = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    LOG(WARNING) << "Ingest queue with " << countThreads << " thread(s)";
+
+    ingestQueue_.reset(NULL);
+    ingestQueue_.reset(new IngestQueue(countThreads, maxSize, blocking));
+  }
+
+
+  bool ServerContext::Ingest(StoreStatus& status,
+                             std::string& resultPublicId,
+                             const char* dicomInstance,
+                             size_t dicomSize)
+  {
+    if (ingestQueue_.get() == NULL)
+    {
+      status = Store(resultPublicId, dicomInstance, dicomSize);
+      return true;
+    }
+    else
+    {
+      return ingestQueue_->Execute(status, resultPublicId,
+                                   new BufferIngestJob(*this, dicomInstance, dicomSize, false));
+    }
+  }
+
+
+  bool ServerContext::Ingest(StoreStatus& status,
+                             const char* dicomInstance,
+                             size_t dicomSize,
+                             const DicomMap& dicomSummary,
+                             const Json::Value& dicomJson,
+                             const std::string& remoteAet)
+  {
+    if (ingestQueue_.get() == NULL)
+    {
+      status = Store(dicomInstance, dicomSize, dicomSummary, dicomJson, remoteAet);
+      return true;
+    }
+    else
+    {
+      std::string publicId;  // Unused
+      return ingestQueue_->Execute(status, publicId,
+                                   new ReceivedIngestJob(*this, dicomInstance, dicomSize, 
+                                                         dicomSummary, dicomJson, remoteAet));
+    }
+  }
+
+
+  bool ServerContext::SubmitIngest(std::string& jobId,
+                                   const char* dicomInstance,
+                                   size_t dicomSize)
+  {
+    if (ingestQueue_.get() == NULL)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    return ingestQueue_->Submit(jobId, new BufferIngestJob(*this, dicomInstance, dicomSize, true));
+  }
+
+
+  bool ServerContext::LookupIngestJob(Json::Value& target,
+                                      const std::string& jobId)
+  {
+    return (ingestQueue_.get() != NULL &&
+            ingestQueue_->LookupJob(target, jobId));
+  }
+
+
+  void ServerContext::GetIngestStatistics(Json::Value& target)
+  {
+    if (ingestQueue_.get() == NULL)
+    {
+      target = Json::objectValue;
+      target["Workers"] = 0;
+    }
+    else
+    {
+      ingestQueue_->GetStatistics(target);
+    }
+  }
+
+
   void ServerContext::SetStoreMD5ForAttachments(bool storeMD5)
   {
     LOG(INFO) << "Storing MD5 for attachments: " << (storeMD5 ? "yes" : "no");
@@ -352,17 +1465,26 @@ namespace Orthanc
       accessor_.SetCompressionForNextOperations(CompressionType_None);
     }      
 
-    FileInfo info = accessor_.Write(data, size, attachmentType);
-    StoreStatus status = index_.AddAttachment(info, resourceId);
+    FileInfo info = WriteAttachment(data, size, attachmentType);
+
+    StoreStatus status = StoreStatus_Failure;
 
-    if (status != StoreStatus_Success)
+    try
     {
-      storage_.Remove(info.GetUuid());
-      return false;
+      ServerIndex::Attachments attachments;
+      attachments.push_back(info);
+      SynchronizeAttachments(attachments);
+
+      status = index_.AddAttachment(info, resourceId);
     }
-    else
+    catch (...)
     {
-      return true;
+      ReleaseAttachment(info, false);
+      throw;
     }
+
+    ReleaseAttachment(info, status == StoreStatus_Success);
+
+    return (status == StoreStatus_Success);
   }
 }
@@ -36,8 +36,10 @@
 #include "../Core/FileStorage/CompressedFileStorageAccessor.h"
 #include "../Core/FileStorage/FileStorage.h"
 #include "../Core/RestApi/RestApiOutput.h"
-#include "../Core/Lua/LuaContext.h"
+#include "../Core/Lua/LuaContextPool.h"
+#include "../Core/MultiThreading/SharedMessageQueue.h"
 #include "ServerIndex.h"
+#include "IngestQueue.h"
 #include "ParsedDicomFile.h"
 #include "DicomProtocol/ReusableDicomUserConnection.h"
 
@@ -74,7 +76,65 @@ namespace Orthanc
     MemoryCache dicomCache_;
     ReusableDicomUserConnection scu_;
 
-    LuaContext lua_;
+    LuaContextPool lua_;
+
+    bool lazyDicomAsJson_;
+    SharedMessageQueue pendingDicomAsJson_;
+
+    // The instances whose "dicom-as-json" attachment is being
+    // generated, either by the background thread or on demand
+    class GenerationLock;
+    boost::mutex generationMutex_;
+    boost::condition_variable generationDone_;
+    std::set<std::string> generatingInstances_;
+
+    // Cache of the answers to "/tags" and "/simplified-tags", indexed
+    // by the UUID of the "dicom-as-json" attachment
+    boost::mutex tagsCacheMutex_;
+    LeastRecentlyUsedIndex<std::string, std::string*> tagsCache_;
+    size_t tagsCacheSize_;
+    uint64_t tagsCacheHits_;
+    uint64_t tagsCacheMisses_;
+
+    std::auto_ptr<IngestQueue> ingestQueue_;
+
+    bool done_;
+    boost::thread rebalancingThread_;
+    boost::thread migrationThread_;
+    boost::thread dicomAsJsonThread_;
+
+    static void RebalancingThread(ServerContext* that,
+                                  std::string volumes);
+
+    static void MigrationThread(ServerContext* that,
+                                uint64_t maxAge);
+
+    static void DicomAsJsonThread(ServerContext* that);
+
+    void GenerateDicomAsJson(Json::Value& json,
+                             std::string& compact,
+                             const std::string& instancePublicId);
+
+    void ReadAttachment(std::string& result,
+                        const FileInfo& attachment,
+                        bool uncompressIfNeeded);
+
+    bool LookupTagsCache(std::string& result,
+                         const std::string& key);
+
+    void StoreTagsCache(const std::string& key,
+                        const std::string& answer);
+
+    void InvalidateTagsCache(const std::string& fileUuid);
+
+    FileInfo WriteAttachment(const void* data,
+                             size_t size,
+                             FileContentType type);
+
+    void ReleaseAttachment(const FileInfo& attachment,
+                           bool isStored);
+
+    void SynchronizeAttachments(const ServerIndex::Attachments& attachments);
 
   public:
     class DicomCacheLocker
@@ -98,6 +158,8 @@ namespace Orthanc
     ServerContext(const boost::filesystem::path& storagePath,
                   const boost::filesystem::path& indexPath);
 
+    ~ServerContext();
+
     ServerIndex& GetIndex()
     {
       return index_;
@@ -110,6 +172,52 @@ namespace Orthanc
       return compressionEnabled_;
     }
 
+    void SetStorageDeduplication(bool enabled);
+
+    bool IsStorageDeduplication() const
+    {
+      return storage_.IsContentAddressed();
+    }
+
+    void SetStorageDurability(bool enabled);
+
+    bool IsStorageDurability() const
+    {
+      return storage_.IsDurable();
+    }
+
+    void AddStorageVolume(const boost::filesystem::path& path);
+
+    // Starts moving the files to their placement volume in the
+    // background, if the set of volumes has changed since the last
+    // complete rebalancing. Must be called after all the other
+    // options of the storage area are set.
+    void StartStorageRebalancing();
+
+    // "maxAge" is the number of seconds after which a file that has
+    // not been accessed is migrated from the hot to the cold tier
+    void SetColdTier(const boost::filesystem::path& path,
+                     uint64_t maxAge,
+                     bool promotion);
+
+    void GetStorageStatistics(Json::Value& target);
+
+    // In the lazy mode, the "dicom-as-json" attachment of the incoming
+    // instances is not generated at the time they are received, but
+    // on their first access. If "background" is true, a low-priority
+    // thread also generates the pending attachments.
+    void SetLazyDicomAsJson(bool lazy,
+                            bool background);
+
+    bool IsLazyDicomAsJson() const
+    {
+      return lazyDicomAsJson_;
+    }
+
+    // Tells whether the JSON summary of the incoming instances must
+    // be computed before calling "Store()"
+    bool IsDicomAsJsonNeededAtIngest();
+
     void RemoveFile(const std::string& fileUuid);
 
     bool AddAttachment(const std::string& resourceId,
@@ -117,6 +225,8 @@ namespace Orthanc
                        const void* data,
                        size_t size);
 
+    // "dicomJson" can be a null value if the JSON summary of the
+    // instance was not computed (cf. "IsDicomAsJsonNeededAtIngest()")
     StoreStatus Store(const char* dicomInstance,
                       size_t dicomSize,
                       const DicomMap& dicomSummary,
@@ -138,20 +248,86 @@ namespace Orthanc
     StoreStatus Store(std::string& resultPublicId,
                       const std::string& dicomContent);
 
+    // Creates the pool of threads that store the instances received
+    // through the REST API and through the C-Store SCP. "countThreads
+    // == 0" means one thread per CPU, and "maxSize == 0" means no
+    // limit on the number of waiting instances. If "blocking" is
+    // false, the instances are refused when the queue is full.
+    void SetupIngestQueue(unsigned int countThreads,
+                          unsigned int maxSize,
+                          bool blocking);
+
+    // Stores an instance through the ingest queue, and waits for the
+    // result. Returns "false" if the instance was refused because the
+    // queue is full. Without ingest queue, the instance is stored by
+    // the calling thread.
+    bool Ingest(StoreStatus& status,
+                std::string& resultPublicId,
+                const char* dicomInstance,
+                size_t dicomSize);
+
+    bool Ingest(StoreStatus& status,
+                const char* dicomInstance,
+                size_t dicomSize,
+                const DicomMap& dicomSummary,
+                const Json::Value& dicomJson,
+                const std::string& remoteAet);
+
+    // Fire-and-forget mode: The outcome of the job can be retrieved
+    // later on by "LookupIngestJob()"
+    bool SubmitIngest(std::string& jobId,
+                      const char* dicomInstance,
+                      size_t dicomSize);
+
+    bool LookupIngestJob(Json::Value& target,
+                         const std::string& jobId);
+
+    void GetIngestStatistics(Json::Value& target);
+
     void AnswerDicomFile(RestApiOutput& output,
                          const std::string& instancePublicId,
                          FileContentType content);
 
+    // Strong entity tag of an attachment, derived from its MD5 hash
+    // (or from the UUID of its file if MD5 is disabled). Returns
+    // "false" if the attachment does not exist.
+    bool LookupETag(std::string& etag,
+                    const std::string& publicId,
+                    FileContentType content);
+
+    // Answers with the raw content of an attachment, which is streamed
+    // from the storage area (this notably allows partial downloads)
+    void AnswerAttachment(RestApiOutput& output,
+                          const std::string& instancePublicId,
+                          FileContentType content,
+                          bool uncompressIfNeeded);
+
     void ReadJson(Json::Value& result,
                   const std::string& instancePublicId);
 
+    // Answers with the DICOM tags of an instance, as stored in the
+    // "dicom-as-json" attachment. The rendered JSON is cached.
+    void AnswerDicomAsJson(RestApiOutput& output,
+                           const std::string& instancePublicId,
+                           bool simplify);
+
+    void GetTagsCacheStatistics(size_t& count,
+                                uint64_t& hits,
+                                uint64_t& misses);
+
+    // Reads the tags of an instance in the format of
+    // "CompactDicomTags", which is cheaper than "ReadJson()" if only a
+    // few tags are needed
+    void ReadCompactTags(std::string& result,
+                         const std::string& instancePublicId);
+
     // TODO CACHING MECHANISM AT THIS POINT
     void ReadFile(std::string& result,
                   const std::string& instancePublicId,
                   FileContentType content,
                   bool uncompressIfNeeded = true);
 
-    LuaContext& GetLuaContext()
+    LuaContextPool& GetLuaContextPool()
     {
       return lua_;
     }
@@ -88,7 +88,8 @@ namespace Orthanc
   {
     GlobalProperty_DatabaseSchemaVersion = 1,
     GlobalProperty_FlushSleep = 2,
-    GlobalProperty_AnonymizationSequence = 3
+    GlobalProperty_AnonymizationSequence = 3,
+    GlobalProperty_StorageVolumes = 4
   };
 
   enum MetadataType
@@ -64,6 +64,8 @@ namespace Orthanc
       std::string remainingPublicId_;
       std::list<std::string> pendingFilesToRemove_;
       uint64_t sizeOfFilesToRemove_;
+      std::map<std::string, unsigned int> pinnedFiles_;
+      std::set<std::string> deferredRemovals_;
 
     public:
       ServerIndexListener(ServerContext& context) : 
@@ -93,7 +95,54 @@ namespace Orthanc
                it = pendingFilesToRemove_.begin();
              it != pendingFilesToRemove_.end(); ++it)
         {
-          context_.RemoveFile(*it);
+          if (pinnedFiles_.find(*it) == pinnedFiles_.end())
+          {
+            context_.RemoveFile(*it);
+          }
+          else
+          {
+            // This file is being read, or is about to be referenced
+            // by an attachment that is being stored: Keep it on the
+            // disk until it is unpinned
+            LOG(INFO) << "Keeping the pinned file " << *it;
+            deferredRemovals_.insert(*it);
+          }
+        }
+      }
+
+      void PinFile(const std::string& uuid)
+      {
+        pinnedFiles_[uuid] += 1;
+      }
+
+      void RemoveUnpinnedFile(const std::string& uuid)
+      {
+        assert(pinnedFiles_.find(uuid) == pinnedFiles_.end());
+        context_.RemoveFile(uuid);
+      }
+
+      void DeferRemoval(const std::string& uuid)
+      {
+        deferredRemovals_.insert(uuid);
+      }
+
+      // Returns "true" iff the file is not pinned anymore, and its
+      // removal has been deferred: The caller must then check whether
+      // it is still attached, and remove it otherwise
+      bool UnpinFile(const std::string& uuid)
+      {
+        std::map<std::string, unsigned int>::iterator pinned = pinnedFiles_.find(uuid);
+        assert(pinned != pinnedFiles_.end() && pinned->second > 0);
+
+        pinned->second -= 1;
+        if (pinned->second == 0)
+        {
+          pinnedFiles_.erase(pinned);
+          return (deferredRemovals_.erase(uuid) > 0);
+        }
+        else
+        {
+          return false;
         }
       }
 
@@ -381,6 +430,77 @@ namespace Orthanc
   }
 
 
+  uint64_t ServerIndex::GetSizeOfNewFiles(const Attachments& attachments)
+  {
+    // The files that are already shared with other attachments
+    // (content-addressed storage) do not use additional disk space
+    std::set<std::string> files;
+    uint64_t size = 0;
+
+    for (Attachments::const_iterator it = attachments.begin();
+         it != attachments.end(); ++it)
+    {
+      if (files.find(it->GetUuid()) == files.end() &&
+          !db_->IsAttachedFile(it->GetUuid()))
+      {
+        files.insert(it->GetUuid());
+        size += it->GetCompressedSize();
+      }
+    }
+
+    return size;
+  }
+
+
+  void ServerIndex::EnableSharedFiles()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    db_->UpgradeToSharedAttachments();
+  }
+
+
+  void ServerIndex::PinSharedFile(const std::string& fileUuid)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    listener_->PinFile(fileUuid);
+  }
+
+
+  void ServerIndex::UnpinSharedFile(const std::string& fileUuid)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // The file might not be attached (e.g. because the instance was
+    // already stored): Check this once the last pin is released
+    listener_->DeferRemoval(fileUuid);
+    UnpinFileInternal(fileUuid);
+  }
+
+
+  void ServerIndex::UnpinFileInternal(const std::string& fileUuid)
+  {
+    if (listener_->UnpinFile(fileUuid) &&
+        !db_->IsAttachedFile(fileUuid))
+    {
+      listener_->RemoveUnpinnedFile(fileUuid);
+    }
+  }
+
+
+  void ServerIndex::PinFile(const std::string& fileUuid)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    listener_->PinFile(fileUuid);
+  }
+
+
+  void ServerIndex::UnpinFile(const std::string& fileUuid)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    UnpinFileInternal(fileUuid);
+  }
+
+
   StoreStatus ServerIndex::Store(const DicomMap& dicomSummary,
                                  const Attachments& attachments,
                                  const std::string& remoteAet)
@@ -406,15 +526,14 @@ namespace Orthanc
       }
 
       // Ensure there is enough room in the storage for the new instance
-      uint64_t instanceSize = 0;
-      for (Attachments::const_iterator it = attachments.begin();
-           it != attachments.end(); ++it)
-      {
-        instanceSize += it->GetCompressedSize();
-      }
+      uint64_t instanceSize = GetSizeOfNewFiles(attachments);
 
       Recycle(instanceSize, hasher.HashPatient());
 
+      // Recycling might have reclaimed files that are shared with
+      // the new instance: Update the size to be committed
+      instanceSize = GetSizeOfNewFiles(attachments);
+
       // Create the instance
       int64_t instance = db_->CreateResource(hasher.HashInstance(), ResourceType_Instance);
 
@@ -846,6 +965,14 @@ namespace Orthanc
   }
 
 
+  void ServerIndex::GetAllUuids(std::list<std::string>& target,
+                                ResourceType resourceType)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    db_->GetAllPublicIds(target, resourceType);
+  }
+
+
   bool ServerIndex::GetChanges(Json::Value& target,
                                int64_t since,                               
                                unsigned int maxResults)
@@ -1312,6 +1439,22 @@ namespace Orthanc
   }
 
 
+  bool ServerIndex::LookupGlobalProperty(std::string& target,
+                                         GlobalProperty property)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return db_->LookupGlobalProperty(target, property);
+  }
+
+
+  void ServerIndex::SetGlobalProperty(GlobalProperty property,
+                                      const std::string& value)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    db_->SetGlobalProperty(property, value);
+  }
+
+
 
   void ServerIndex::LogChange(ChangeType changeType,
                               const std::string& publicId)
@@ -1662,11 +1805,15 @@ namespace Orthanc
 
     // Possibly apply the recycling mechanism while preserving this patient
     assert(db_->GetResourceType(patientId) == ResourceType_Patient);
-    Recycle(attachment.GetCompressedSize(), db_->GetPublicId(patientId));
+    Attachments attachments;
+    attachments.push_back(attachment);
+    uint64_t attachmentSize = GetSizeOfNewFiles(attachments);
+    Recycle(attachmentSize, db_->GetPublicId(patientId));
+    attachmentSize = GetSizeOfNewFiles(attachments);
 
     db_->AddAttachment(resourceId, attachment);
 
-    t.Commit(attachment.GetCompressedSize());
+    t.Commit(attachmentSize);
 
     return StoreStatus_Success;
   }
@@ -87,9 +87,13 @@ namespace Orthanc
 
     void StandaloneRecycling();
 
+    uint64_t GetSizeOfNewFiles(const std::list<FileInfo>& attachments);
+
     void MarkAsUnstable(int64_t id,
                         Orthanc::ResourceType type);
 
+    void UnpinFileInternal(const std::string& fileUuid);
+
     void GetStatisticsInternal(/* out */ uint64_t& compressedSize, 
                                /* out */ uint64_t& uncompressedSize, 
                                /* out */ unsigned int& countStudies, 
@@ -139,6 +143,9 @@ namespace Orthanc
     void GetAllUuids(Json::Value& target,
                      ResourceType resourceType);
 
+    void GetAllUuids(std::list<std::string>& target,
+                     ResourceType resourceType);
+
     bool DeleteResource(Json::Value& target,
                         const std::string& uuid,
                         ResourceType expectedType);
@@ -192,6 +199,12 @@ namespace Orthanc
 
     uint64_t IncrementGlobalSequence(GlobalProperty sequence);
 
+    bool LookupGlobalProperty(std::string& target,
+                              GlobalProperty property);
+
+    void SetGlobalProperty(GlobalProperty property,
+                           const std::string& value);
+
     void LogChange(ChangeType changeType,
                    const std::string& publicId);
 
@@ -224,6 +237,27 @@ namespace Orthanc
     StoreStatus AddAttachment(const FileInfo& attachment,
                               const std::string& publicId);
 
+    // Must be called before any file is shared by several attachments
+    void EnableSharedFiles();
+
+    /**
+     * With the content-addressed storage, a file can be shared by
+     * several attachments. Pinning a file prevents it from being
+     * reclaimed by a concurrent deletion until it is unpinned, which
+     * gives time to attach it. Unpinning a file that is not attached
+     * anymore removes it from the storage.
+     **/
+    void PinSharedFile(const std::string& fileUuid);
+
+    void UnpinSharedFile(const std::string& fileUuid);
+
+    // Pins a file while it is being read: If its attachment is
+    // deleted or replaced in the meantime, the removal of the file is
+    // deferred until it is unpinned
+    void PinFile(const std::string& fileUuid);
+
+    void UnpinFile(const std::string& fileUuid);
+
     void DeleteAttachment(const std::string& publicId,
                           FileContentType type);
   };
@@ -0,0 +1,25 @@
+-- This SQLite script updates the version of the Orthanc database from 4 to 5.
+
+-- Index the UUID of the attached files, as they can now be shared
+-- between several attachments (content-addressed storage)
+
+CREATE INDEX AttachedFilesIndex ON AttachedFiles(uuid);
+
+-- Update the "AttachedFileDeleted" trigger, so that a shared file is
+-- only reclaimed when its last reference is removed
+
+DROP TRIGGER AttachedFileDeleted;
+
+CREATE TRIGGER AttachedFileDeleted
+AFTER DELETE ON AttachedFiles
+FOR EACH ROW WHEN (SELECT COUNT(*) FROM AttachedFiles WHERE uuid = old.uuid) = 0
+BEGIN
+  SELECT SignalFileDeleted(old.uuid, old.fileType, old.uncompressedSize, 
+                           old.compressionType, old.compressedSize,
+                           old.uncompressedMD5, old.compressedMD5);
+END;
+
+-- Change the database version
+-- The "1" corresponds to the "GlobalProperty_DatabaseSchemaVersion" enumeration
+
+UPDATE GlobalProperties SET value="5" WHERE property=1;
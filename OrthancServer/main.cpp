@@ -32,10 +32,12 @@
 
 #include "OrthancRestApi/OrthancRestApi.h"
 
+#include <algorithm>
 #include <fstream>
 #include <glog/logging.h>
 #include <boost/algorithm/string/predicate.hpp>
 
+#include "../Core/HttpServer/ChunkStore.h"
 #include "../Core/HttpServer/EmbeddedResourceHttpHandler.h"
 #include "../Core/HttpServer/FilesystemHttpHandler.h"
 #include "../Core/Lua/LuaFunctionCall.h"
@@ -63,6 +65,11 @@ public:
   {
   }
 
+  virtual bool IsDicomAsJsonNeeded()
+  {
+    return server_.IsDicomAsJsonNeededAtIngest();
+  }
+
   virtual void Handle(const std::string& dicomFile,
                       const DicomMap& dicomSummary,
                       const Json::Value& dicomJson,
@@ -70,7 +77,11 @@ public:
   {
     if (dicomFile.size() > 0)
     {
-      server_.Store(&dicomFile[0], dicomFile.size(), dicomSummary, dicomJson, remoteAet);
+      StoreStatus status;
+      if (!server_.Ingest(status, &dicomFile[0], dicomFile.size(), dicomSummary, dicomJson, remoteAet))
+      {
+        throw OrthancException("The ingest queue is full");
+      }
     }
   }
 };
@@ -161,9 +172,10 @@ public:
     static const char* HTTP_FILTER = "IncomingHttpRequestFilter";
 
     // Test if the instance must be filtered out
-    if (context_.GetLuaContext().IsExistingFunction(HTTP_FILTER))
+    LuaContextPool::Locker locker(context_.GetLuaContextPool());
+    if (locker.GetContext().IsExistingFunction(HTTP_FILTER))
     {
-      LuaFunctionCall call(context_.GetLuaContext(), HTTP_FILTER);
+      LuaFunctionCall call(locker.GetContext(), HTTP_FILTER);
 
       switch (method)
       {
@@ -243,6 +255,24 @@ void PrintVersion(char* path)
 }
 
 
+static unsigned int GetIntegerParameterInRange(const std::string& parameter,
+                                               unsigned int defaultValue,
+                                               unsigned int minValue,
+                                               unsigned int maxValue)
+{
+  int value = Configuration::GetGlobalIntegerParameter(parameter, defaultValue);
+  if (value < static_cast<int>(minValue) ||
+      static_cast<unsigned int>(value) > maxValue)
+  {
+    LOG(ERROR) << "The configuration option \"" << parameter << "\" must be between "
+               << minValue << " and " << maxValue;
+    throw OrthancException(ErrorCode_ParameterOutOfRange);
+  }
+
+  return static_cast<unsigned int>(value);
+}
+
+
 int main(int argc, char* argv[]) 
 {
   // Initialize Google's logging library.
@@ -333,8 +363,52 @@ int main(int argc, char* argv[])
     LOG(WARNING) << "Storage directory: " << storageDirectory;
     LOG(WARNING) << "Index directory: " << indexDirectory;
 
+    std::list<std::string> storageVolumes;
+    Configuration::GetGlobalListOfStringsParameter(storageVolumes, "StorageVolumes");
+    for (std::list<std::string>::const_iterator
+           it = storageVolumes.begin(); it != storageVolumes.end(); ++it)
+    {
+      context.AddStorageVolume(Configuration::InterpretStringParameterAsPath(*it));
+    }
+
     context.SetCompressionEnabled(Configuration::GetGlobalBoolParameter("StorageCompression", false));
     context.SetStoreMD5ForAttachments(Configuration::GetGlobalBoolParameter("StoreMD5ForAttachments", true));
+    context.SetStorageDeduplication(Configuration::GetGlobalBoolParameter("StorageDeduplication", false));
+    context.SetStorageDurability(Configuration::GetGlobalBoolParameter("SyncStorageArea", false));
+
+    // This starts the thread for the migration to the cold tier,
+    // which must see the other options of the storage area
+    std::string coldTier = Configuration::GetGlobalStringParameter("StorageColdTierDirectory", "");
+    if (!coldTier.empty())
+    {
+      int maxAge = Configuration::GetGlobalIntegerParameter("StorageHotTierMaxAge", 30);
+      if (maxAge < 0)
+      {
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+      }
+
+      context.SetColdTier(Configuration::InterpretStringParameterAsPath(coldTier),
+                          static_cast<uint64_t>(maxAge) * 24 * 3600,
+                          Configuration::GetGlobalBoolParameter("StorageColdTierPromotion", false));
+    }
+
+    context.SetLazyDicomAsJson(Configuration::GetGlobalBoolParameter("LazyDicomAsJson", false),
+                               Configuration::GetGlobalBoolParameter("LazyDicomAsJsonInBackground", true));
+    context.SetupIngestQueue(GetIntegerParameterInRange("IngestThreads", 0, 0, 256),
+                             GetIntegerParameterInRange("IngestQueueSize", 100, 0, 100000),
+                             Configuration::GetGlobalBoolParameter("IngestQueueBlocking", true));
+
+    // The files are only moved once all the options of the storage
+    // area are known, as the rebalancing thread reads them unlocked
+    context.StartStorageRebalancing();
+
+    unsigned int luaContexts = GetIntegerParameterInRange("LuaContexts", 1, 0, 256);
+    if (luaContexts == 0)
+    {
+      luaContexts = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    context.GetLuaContextPool().SetMaxSize(luaContexts);
 
     std::list<std::string> luaScripts;
     Configuration::GetGlobalListOfStringsParameter(luaScripts, "LuaScripts");
@@ -345,7 +419,7 @@ int main(int argc, char* argv[])
       LOG(WARNING) << "Installing the Lua scripts from: " << path;
       std::string script;
       Toolbox::ReadFile(script, path);
-      context.GetLuaContext().Execute(script);
+      context.GetLuaContextPool().LoadScript(script);
     }
 
 
@@ -388,6 +462,15 @@ int main(int argc, char* argv[])
       httpServer.SetPortNumber(Configuration::GetGlobalIntegerParameter("HttpPort", 8042));
       httpServer.SetRemoteAccessAllowed(Configuration::GetGlobalBoolParameter("RemoteAccessAllowed", false));
       httpServer.SetIncomingHttpRequestFilter(httpFilter);
+      httpServer.SetHttpCompressionEnabled(Configuration::GetGlobalBoolParameter("HttpCompressionEnabled", true));
+      httpServer.SetHttpCompressionLevel(GetIntegerParameterInRange("HttpCompressionLevel", 6, 0, 9));
+      httpServer.SetHttpCompressionThreshold(GetIntegerParameterInRange("HttpCompressionThreshold", 1024, 0, 1024 * 1024 * 1024));
+      httpServer.SetThreadsCount(GetIntegerParameterInRange("HttpThreadsCount", 50, 1, 1000));
+      httpServer.SetKeepAliveEnabled(Configuration::GetGlobalBoolParameter("KeepAlive", false));
+
+      httpServer.GetChunkStore().SetMaxFiles(GetIntegerParameterInRange("ChunkedUploadMaxFiles", 10, 1, 1000));
+      httpServer.GetChunkStore().SetMaxTotalSize(static_cast<uint64_t>(GetIntegerParameterInRange("ChunkedUploadMaxSize", 2048, 1, 1024 * 1024)) * 1024 * 1024);
+      httpServer.GetChunkStore().SetExpiration(GetIntegerParameterInRange("ChunkedUploadExpiration", 3600, 0, 7 * 24 * 3600));
 
       httpServer.SetAuthenticationEnabled(Configuration::GetGlobalBoolParameter("AuthenticationEnabled", false));
       Configuration::SetupRegisteredUsers(httpServer);
@@ -410,7 +493,9 @@ int main(int argc, char* argv[])
       httpServer.RegisterHandler(new FilesystemHttpHandler("/app", ORTHANC_PATH "/OrthancExplorer"));
 #endif
 
-      httpServer.RegisterHandler(new OrthancRestApi(context));
+      OrthancRestApi* restApi = new OrthancRestApi(context);
+      restApi->SetHttpServer(httpServer);
+      httpServer.RegisterHandler(restApi);
 
       // GO !!! Start the requested servers
       if (Configuration::GetGlobalBoolParameter("HttpServerEnabled", true))
@@ -33,6 +33,7 @@ import os
 import os.path
 import pprint
 import re
+import zlib
 
 UPCASE_CHECK = True
 ARGS = []
@@ -182,6 +183,11 @@ header.write("""
     void GetDirectoryResource(std::string& result, DirectoryResourceId id, const char* path);
 
     void ListResources(std::list<std::string>& result, DirectoryResourceId id);
+
+    // Version of a directory resource that was compressed with gzip at
+    // build time. Returns "false" if no such version is available.
+    bool LookupGzipDirectoryResource(const void*& buffer, size_t& size,
+                                     DirectoryResourceId id, const char* path);
   }
 }
 """)
@@ -195,12 +201,36 @@ header.close()
 
 PYTHON_MAJOR_VERSION = sys.version_info[0]
 
-def WriteResource(cpp, item):
-    cpp.write('    static const uint8_t resource%dBuffer[] = {' % item['Index'])
+# The text files of the directory resources are also embedded in a
+# version compressed with gzip, that can be sent as such to the HTTP
+# clients that accept this content encoding
+GZIP_EXTENSIONS = [ '.css', '.html', '.js', '.json', '.svg', '.txt', '.xml' ]
 
+def CompressGzip(content):
+    # The window size of 31 produces a gzip header, whose timestamp is
+    # set to zero, which makes the build reproducible
+    compressor = zlib.compressobj(9, zlib.DEFLATED, 31)
+    return compressor.compress(content) + compressor.flush()
+
+def ReadResource(item):
     f = open(item['Filename'], "rb")
     content = f.read()
     f.close()
+    return content
+
+def WriteResource(cpp, item):
+    WriteBuffer(cpp, 'resource%d' % item['Index'], ReadResource(item))
+
+def WriteGzipResource(cpp, item):
+    if os.path.splitext(item['Filename'])[1].lower() in GZIP_EXTENSIONS:
+        content = ReadResource(item)
+        compressed = CompressGzip(content)
+        if len(compressed) < len(content):
+            WriteBuffer(cpp, 'gzip%d' % item['Index'], compressed)
+            item['Gzip'] = True
+
+def WriteBuffer(cpp, name, content):
+    cpp.write('    static const uint8_t %sBuffer[] = {' % name)
 
     # http://stackoverflow.com/a/1035360
     pos = 0
@@ -223,7 +253,7 @@ def WriteResource(cpp, item):
         pos += 1
 
     cpp.write('  };\n')
-    cpp.write('    static const size_t resource%dSize = %d;\n' % (item['Index'], pos))
+    cpp.write('    static const size_t %sSize = %d;\n' % (name, pos))
 
 
 cpp = open(TARGET_BASE_FILENAME + '.cpp', 'w')
@@ -249,6 +279,7 @@ for name in resources:
     else:
         for f in resources[name]['Files']:
             WriteResource(cpp, resources[name]['Files'][f])
+            WriteGzipResource(cpp, resources[name]['Files'][f])
 
 
 
@@ -371,6 +402,41 @@ cpp.write("""      default:
 
 
 
+#####################################################################
+## Write the accessor to the compressed directory resources in .cpp
+#####################################################################
+
+cpp.write("""
+    bool LookupGzipDirectoryResource(const void*& buffer, size_t& size,
+                                     DirectoryResourceId id, const char* path)
+    {
+      switch (id)
+      {
+""")
+
+for name in resources:
+    if resources[name]['Type'] == 'Directory':
+        cpp.write('      case %s:\n' % name)
+        for path in resources[name]['Files']:
+            item = resources[name]['Files'][path]
+            if 'Gzip' in item:
+                cpp.write('        if (!strcmp(path, "%s"))\n' % path)
+                cpp.write('        {\n')
+                cpp.write('          buffer = gzip%dBuffer;\n' % item['Index'])
+                cpp.write('          size = gzip%dSize;\n' % item['Index'])
+                cpp.write('          return true;\n')
+                cpp.write('        }\n')
+        cpp.write('        return false;\n\n')
+
+cpp.write("""      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+      }
+    }
+""")
+
+
+
+
 #####################################################################
 ## Write the convenience wrappers in .cpp
 #####################################################################
@@ -0,0 +1,43 @@
+-- Orthanc - A Lightweight, RESTful DICOM Store
+-- Copyright (C) 2012-2014 Medical Physics Department, CHU of Liege,
+-- Belgium
+--
+-- This program is free software: you can redistribute it and/or
+-- modify it under the terms of the GNU General Public License as
+-- published by the Free Software Foundation, either version 3 of the
+-- License, or (at your option) any later version.
+-- 
+-- This program is distributed in the hope that it will be useful, but
+-- WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+-- General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+
+-- Sample filter of the incoming instances, to be listed in the
+-- "LuaScripts" option of the configuration file. The "tags" argument
+-- is not a table: Each tag is only converted when the script reads
+-- it, by its name (as in "simplified-tags") or by its identifier
+-- (e.g. "0008-0060"). The function must return "true" to accept the
+-- instance.
+
+function ReceivedInstanceFilter(tags, remoteAet)
+   -- Only accept the CT and MR instances
+   if (tags.Modality ~= 'CT' and tags.Modality ~= 'MR') then
+      print('Discarding an instance with modality: ' .. tostring(tags.Modality))
+      return false
+   end
+
+   -- The tags cannot be iterated directly with "pairs()": Convert them
+   -- to a table first (this converts all the tags of the instance)
+   if (remoteAet == 'DEBUG') then
+      for name, value in pairs(tags:ToTable()) do
+         print(name .. ': ' .. tostring(value))
+      end
+   end
+
+   return true
+end
@@ -9,6 +9,12 @@ function PrintRecursive(s, l, i) -- recursive Print (structure, limit, indent)
    l = (l) or 100; i = i or "";	-- default item limit, indent string
    if (l<1) then print "ERROR: Item limit reached."; return l-1 end;
    local ts = type(s);
+   if (ts == "userdata") then
+      -- The lazy objects of Orthanc (such as the tags given to
+      -- "ReceivedInstanceFilter") can be converted to a table
+      local success, t = pcall(function() return s:ToTable() end);
+      if (success) then s = t; ts = type(s) end
+   end
    if (ts ~= "table") then print (i,ts,s); return l-1 end
    print (i,ts);           -- print "table"
    for k,v in pairs(s) do  -- print "[KEY] VALUE"
@@ -2,6 +2,7 @@
 
 #include "../Core/Uuid.h"
 #include "../Core/OrthancException.h"
+#include "../Core/DicomFormat/CompactDicomTags.h"
 #include "../Core/DicomFormat/DicomMap.h"
 #include "../Core/DicomFormat/DicomNullValue.h"
 
@@ -95,3 +96,71 @@ TEST(DicomMap, FindTemplates)
   DicomMap::SetupFindInstanceTemplate(m);
   ASSERT_TRUE(m.HasTag(DICOM_TAG_SOP_INSTANCE_UID));
 }
+
+
+TEST(CompactDicomTags, Basic)
+{
+  Json::Value item = Json::objectValue;
+  item["0008,1150"]["Name"] = "ReferencedSOPClassUID";
+  item["0008,1150"]["Type"] = "String";
+  item["0008,1150"]["Value"] = "1.2.840.10008.5.1.4.1.1.4";
+
+  Json::Value tags = Json::objectValue;
+  tags["0010,0020"]["Name"] = "PatientID";
+  tags["0010,0020"]["Type"] = "String";
+  tags["0010,0020"]["Value"] = "Hello";
+  tags["0010,0010"]["Name"] = "PatientName";
+  tags["0010,0010"]["Type"] = "Null";
+  tags["0010,0010"]["Value"] = Json::nullValue;
+  tags["7fe0,0010"]["Name"] = "PixelData";
+  tags["7fe0,0010"]["Type"] = "TooLong";
+  tags["7fe0,0010"]["Value"] = Json::nullValue;
+  tags["0009,1001"]["Name"] = "Unknown Tag & Data";
+  tags["0009,1001"]["PrivateCreator"] = "Orthanc";
+  tags["0009,1001"]["Type"] = "String";
+  tags["0009,1001"]["Value"] = "";
+  tags["0008,1140"]["Name"] = "ReferencedImageSequence";
+  tags["0008,1140"]["Type"] = "Sequence";
+  tags["0008,1140"]["Value"] = Json::arrayValue;
+  tags["0008,1140"]["Value"].append(item);
+  tags["0008,1140"]["Value"].append(Json::objectValue);
+
+  std::string s;
+  CompactDicomTags::Serialize(s, tags);
+  ASSERT_TRUE(CompactDicomTags::IsCompact(s));
+  ASSERT_FALSE(CompactDicomTags::IsCompact(tags.toStyledString()));
+
+  CompactDicomTags compact(s);
+  ASSERT_EQ(5u, compact.GetSize());
+  ASSERT_EQ(DicomTag(0x0008, 0x1140), compact.GetTag(0));
+  ASSERT_EQ(DicomTag(0x7fe0, 0x0010), compact.GetTag(4));
+  ASSERT_EQ(CompactDicomTags::ValueType_Sequence, compact.GetValueType(0));
+  ASSERT_EQ(CompactDicomTags::ValueType_TooLong, compact.GetValueType(4));
+
+  std::string value = "nope";
+  ASSERT_TRUE(compact.LookupValue(value, DICOM_TAG_PATIENT_ID));
+  ASSERT_EQ("Hello", value);
+  ASSERT_TRUE(compact.LookupValue(value, DICOM_TAG_PATIENT_NAME));
+  ASSERT_EQ("", value);
+  ASSERT_TRUE(compact.HasTag(DICOM_TAG_PIXEL_DATA));
+  ASSERT_FALSE(compact.HasTag(DICOM_TAG_STUDY_INSTANCE_UID));
+  ASSERT_FALSE(compact.LookupValue(value, DICOM_TAG_STUDY_INSTANCE_UID));
+
+  Json::Value json;
+  compact.ToJson(json);
+  ASSERT_EQ(tags, json);
+
+  ASSERT_THROW(CompactDicomTags(s.substr(0, 20)), OrthancException);
+  ASSERT_THROW(CompactDicomTags(tags.toStyledString()), OrthancException);
+
+  std::string truncated = s.substr(0, s.size() - 10);
+  CompactDicomTags corrupted(truncated);
+  ASSERT_THROW(corrupted.ToJson(json), OrthancException);
+
+  // Unknown version of the format
+  std::string future = s;
+  ASSERT_EQ(1, future[4]);
+  future[4] = 2;
+  ASSERT_TRUE(CompactDicomTags::IsCompact(future));
+  ASSERT_THROW(CompactDicomTags c(future), OrthancException);
+}
@@ -10,8 +10,14 @@
 #include "../Core/Uuid.h"
 #include "../Core/HttpServer/FilesystemHttpSender.h"
 #include "../Core/HttpServer/BufferHttpSender.h"
+#include "../Core/HttpServer/StringHttpOutput.h"
+#include "../Core/HttpServer/ZlibFileHttpSender.h"
 #include "../Core/FileStorage/FileStorageAccessor.h"
 #include "../Core/FileStorage/CompressedFileStorageAccessor.h"
+#include "../Core/FileStorage/GroupSynchronizer.h"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
 using namespace Orthanc;
 
@@ -85,6 +91,287 @@ TEST(FileStorage, EndToEnd)
 }
 
 
+TEST(FileStorage, ContentAddressed)
+{
+  FileStorage s("UnitTestsStorage");
+  s.Clear();
+  s.SetContentAddressed(true);
+
+  std::string a = s.Create("Hello");
+  std::string b = s.Create("World");
+  std::string c = s.Create("Hello");
+  ASSERT_TRUE(Toolbox::IsUuid(a));
+  ASSERT_NE(a, b);
+  ASSERT_EQ(a, c);
+
+  std::set<std::string> ss;
+  s.ListAllFiles(ss);
+  ASSERT_EQ(2u, ss.size());
+
+  std::string d;
+  s.ReadFile(d, c);
+  ASSERT_EQ("Hello", d);
+
+  s.Remove(a);
+  ASSERT_FALSE(s.Exists(c));
+  ASSERT_TRUE(s.Exists(b));
+
+  s.SetContentAddressed(false);
+  ASSERT_NE(s.Create("World"), b);
+
+  s.Clear();
+}
+
+
+TEST(FileStorage, ContentAddressedCollision)
+{
+  FileStorage s("UnitTestsStorage");
+  s.Clear();
+  s.SetContentAddressed(true);
+
+  std::string a = s.Create("Hello");
+
+  // Simulate a hash collision by altering the stored file
+  std::string path = ("UnitTestsStorage/" + a.substr(0, 2) + "/" + 
+                      a.substr(2, 2) + "/" + a);
+  Toolbox::WriteFile(std::string("Hullo"), path);
+
+  std::string b = s.Create("Hello");
+  ASSERT_NE(a, b);
+
+  std::string c;
+  s.ReadFile(c, b);
+  ASSERT_EQ("Hello", c);
+
+  s.Clear();
+}
+
+
+TEST(FileStorage, RemovedDirectory)
+{
+  FileStorage s("UnitTestsStorage");
+  s.SetContentAddressed(true);
+
+  std::string data = "Hello world";
+  std::string uuid = s.Create(data);
+
+  // Removing the single file of a subdirectory removes the latter,
+  // which must be created again by the next write
+  s.Remove(uuid);
+  ASSERT_FALSE(s.Exists(uuid));
+
+  ASSERT_EQ(uuid, s.Create(data));
+  ASSERT_TRUE(s.Exists(uuid));
+  s.Remove(uuid);
+}
+
+
+TEST(FileStorage, Volumes)
+{
+  FileStorage s("UnitTestsStorage");
+  s.Clear();
+
+  std::map<std::string, std::string> files;
+  for (unsigned int i = 0; i < 20; i++)
+  {
+    std::string data = Toolbox::GenerateUuid();
+    files[s.Create(data)] = data;
+  }
+
+  s.AddVolume("UnitTestsStorage2");
+  s.AddVolume("UnitTestsStorage3");
+  s.AddVolume("UnitTestsStorage2");
+  ASSERT_EQ(3u, s.GetVolumeCount());
+  ASSERT_EQ("UnitTestsStorage2", s.GetVolumePath(1));
+
+  std::set<std::string> l;
+  s.ListAllFiles(l);
+  ASSERT_EQ(20u, l.size());
+
+  unsigned int moved = 0;
+  for (std::map<std::string, std::string>::const_iterator 
+         it = files.begin(); it != files.end(); ++it)
+  {
+    // Files that have not been relocated yet can be read
+    std::string d;
+    s.ReadFile(d, it->first);
+    ASSERT_EQ(it->second, d);
+
+    if (s.Relocate(it->first))
+    {
+      moved++;
+    }
+
+    ASSERT_FALSE(s.Relocate(it->first));
+    s.ReadFile(d, it->first);
+    ASSERT_EQ(it->second, d);
+  }
+
+  ASSERT_LT(0u, moved);
+  ASSERT_GT(20u, moved);
+
+  s.ListAllFiles(l);
+  ASSERT_EQ(20u, l.size());
+
+  // New files are spread over the volumes
+  for (unsigned int i = 0; i < 10; i++)
+  {
+    std::string data = Toolbox::GenerateUuid();
+    std::string uuid = s.Create(data);
+    ASSERT_FALSE(s.Relocate(uuid));
+  }
+
+  s.Clear();
+  s.ListAllFiles(l);
+  ASSERT_EQ(0u, l.size());
+}
+
+
+TEST(FileStorage, ColdTier)
+{
+  FileStorage s("UnitTestsStorage");
+  s.Clear();
+
+  std::string data = Toolbox::GenerateUuid();
+  std::string uuid = s.Create(data);
+  ASSERT_FALSE(s.MigrateToColdTier(uuid, 0));  // No cold tier
+
+  s.SetColdTier("UnitTestsStorageCold");
+  ASSERT_TRUE(s.HasColdTier());
+  ASSERT_FALSE(s.IsInColdTier(uuid));
+  ASSERT_FALSE(s.MigrateToColdTier(uuid, 3600));  // Too recent
+  ASSERT_TRUE(s.MigrateToColdTier(uuid, 0));
+  ASSERT_TRUE(s.IsInColdTier(uuid));
+  ASSERT_FALSE(s.MigrateToColdTier(uuid, 0));
+
+  std::set<std::string> l;
+  s.ListAllFiles(l);
+  ASSERT_EQ(1u, l.size());
+
+  std::string d;
+  s.ReadFile(d, uuid);
+  ASSERT_EQ(data, d);
+  ASSERT_TRUE(s.IsInColdTier(uuid));
+
+  s.SetColdTierPromotion(true);
+  s.ReadFile(d, uuid);
+  ASSERT_EQ(data, d);
+  ASSERT_TRUE(s.IsInColdTier(uuid));  // The promotion is deferred
+  ASSERT_EQ(1u, s.PromoteColdFiles());
+  ASSERT_FALSE(s.IsInColdTier(uuid));
+  ASSERT_EQ(0u, s.PromoteColdFiles());
+  s.ReadFile(d, uuid);
+  ASSERT_EQ(data, d);
+
+  uint64_t hotReads, coldReads, migrations, promotions;
+  s.GetTierStatistics(hotReads, coldReads, migrations, promotions);
+  ASSERT_EQ(1u, hotReads);
+  ASSERT_EQ(2u, coldReads);
+  ASSERT_EQ(1u, migrations);
+  ASSERT_EQ(1u, promotions);
+
+  s.FlushAccessTimes();
+  ASSERT_FALSE(s.MigrateToColdTier(uuid, 3600));
+  ASSERT_TRUE(s.MigrateToColdTier(uuid, 0));
+  s.Remove(uuid);
+  ASSERT_FALSE(s.Exists(uuid));
+  s.ListAllFiles(l);
+  ASSERT_EQ(0u, l.size());
+}
+
+
+TEST(FileStorage, MovedWhileReading)
+{
+  FileStorage s("UnitTestsStorage");
+  s.Clear();
+  s.SetColdTier("UnitTestsStorageCold");
+
+  std::string data = "Hello World";
+  std::string compressed;
+  ZlibCompressor zlib;
+  zlib.Compress(compressed, data);
+
+  std::string uuid = s.Create(data);
+  std::string compressedUuid = s.Create(compressed);
+
+  // The senders resolve the hot path of the files, that are then
+  // migrated to the cold tier before being sent
+  FilesystemHttpSender sender(s, uuid);
+  ZlibFileHttpSender compressedSender(s, compressedUuid);
+  ASSERT_TRUE(s.MigrateToColdTier(uuid, 0));
+  ASSERT_TRUE(s.MigrateToColdTier(compressedUuid, 0));
+
+  {
+    StringHttpOutput output;
+    sender.Send(output);
+    ASSERT_EQ(data, output.GetContent().substr(output.GetContent().size() - data.size()));
+  }
+
+  {
+    StringHttpOutput output;
+    compressedSender.Send(output);
+    ASSERT_EQ(data, output.GetContent().substr(output.GetContent().size() - data.size()));
+  }
+
+  s.Remove(uuid);
+  s.Remove(compressedUuid);
+}
+
+
+static void SynchronizeThread(FileStorage* storage,
+                              std::string* uuid)
+{
+  *uuid = storage->Create(Toolbox::GenerateUuid());
+
+  std::list<std::string> uuids;
+  uuids.push_back(*uuid);
+  storage->Synchronize(uuids);
+}
+
+
+TEST(FileStorage, Durable)
+{
+  FileStorage s("UnitTestsStorage");
+  s.SetDurable(true);
+
+  std::vector<std::string> uuids(10);
+  std::vector<boost::thread*> threads;
+  for (size_t i = 0; i < uuids.size(); i++)
+  {
+    threads.push_back(new boost::thread(SynchronizeThread, &s, &uuids[i]));
+  }
+
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i]->join();
+    delete threads[i];
+  }
+
+  uint64_t countBatches, countFiles;
+  s.GetSynchronizationStatistics(countBatches, countFiles);
+  ASSERT_EQ(10u, countFiles);
+  ASSERT_LE(1u, countBatches);
+  ASSERT_GE(10u, countBatches);
+
+  // A single batch that is flushed by several threads
+  std::list<std::string> all(uuids.begin(), uuids.end());
+  s.Synchronize(all);
+
+  all.push_back(Toolbox::GenerateUuid());
+  ASSERT_THROW(s.Synchronize(all), OrthancException);
+
+  for (size_t i = 0; i < uuids.size(); i++)
+  {
+    s.Remove(uuids[i]);
+  }
+
+  GroupSynchronizer synchronizer;
+  std::list<std::string> missing;
+  missing.push_back("UnitTestsStorage/nope");
+  ASSERT_THROW(synchronizer.Synchronize(missing), OrthancException);
+}
+
+
 TEST(FileStorageAccessor, Simple)
 {
   FileStorage s("UnitTestsStorage");
@@ -164,6 +451,42 @@ TEST(FileStorageAccessor, Compression)
 }
 
 
+TEST(FileStorageAccessor, MD5)
+{
+  FileStorage s("UnitTestsStorage");
+  CompressedFileStorageAccessor accessor(s);
+  accessor.SetStoreMD5(true);
+
+  std::string data;
+  for (unsigned int i = 0; i < 30000; i++)
+  {
+    data += Toolbox::GenerateUuid();
+  }
+
+  std::string md5;
+  Toolbox::ComputeMD5(md5, data);
+
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    accessor.SetCompressionForNextOperations(i == 0 ? CompressionType_None : CompressionType_Zlib);
+    FileInfo info = accessor.Write(data, FileContentType_Dicom);
+    ASSERT_EQ(md5, info.GetUncompressedMD5());
+
+    std::string compressed, compressedMD5;
+    s.ReadFile(compressed, info.GetUuid());
+    Toolbox::ComputeMD5(compressedMD5, compressed);
+    ASSERT_EQ(compressedMD5, info.GetCompressedMD5());
+    ASSERT_EQ(compressed.size(), info.GetCompressedSize());
+
+    std::string r;
+    accessor.Read(r, info.GetUuid());
+    ASSERT_EQ(data, r);
+
+    s.Remove(info.GetUuid());
+  }
+}
+
+
 TEST(FileStorageAccessor, Mix)
 {
   FileStorage s("UnitTestsStorage");
@@ -193,3 +516,138 @@ TEST(FileStorageAccessor, Mix)
   ASSERT_THROW(accessor.Read(r, uncompressedInfo.GetUuid()), OrthancException);
   */
 }
+
+
+TEST(FilesystemHttpSender, Content)
+{
+  FileStorage s("UnitTestsStorage");
+
+  std::string small = "Hello";
+  std::string large(3 * 1024 * 1024 + 17, '\0');
+  for (size_t i = 0; i < large.size(); i++)
+  {
+    large[i] = static_cast<char>(i % 251);
+  }
+
+  std::string data[2] = { small, large };
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    std::string uuid = s.Create(data[i]);
+
+    StringHttpOutput output;
+    FilesystemHttpSender sender(s, uuid);
+    sender.Send(output);
+
+    ASSERT_LT(data[i].size(), output.GetContent().size());
+    ASSERT_TRUE(output.GetContent().substr(output.GetContent().size() - data[i].size()) == data[i]);
+
+    s.Remove(uuid);
+  }
+}
+
+
+TEST(FilesystemHttpSender, Range)
+{
+  FileStorage s("UnitTestsStorage");
+
+  std::string large(3 * 1024 * 1024 + 17, '\0');
+  for (size_t i = 0; i < large.size(); i++)
+  {
+    large[i] = static_cast<char>(i % 251);
+  }
+
+  std::string compressed;
+  ZlibCompressor zlib;
+  zlib.Compress(compressed, large);
+
+  std::string uuid = s.Create(large);
+  std::string compressedUuid = s.Create(compressed);
+  std::string size = boost::lexical_cast<std::string>(large.size());
+
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    std::auto_ptr<HttpFileSender> sender;
+
+    switch (i)
+    {
+      case 0:
+        sender.reset(new FilesystemHttpSender(s, uuid));
+        break;
+
+      case 1:
+        sender.reset(new ZlibFileHttpSender(s, compressedUuid));
+        break;
+
+      default:
+      {
+        std::auto_ptr<BufferHttpSender> buffer(new BufferHttpSender);
+        buffer->GetBuffer() = large;
+        sender.reset(buffer.release());
+      }
+    }
+
+    {
+      StringHttpOutput output;
+      sender->Send(output);
+      ASSERT_EQ(0u, output.GetContent().find("HTTP/1.1 200 "));
+      ASSERT_NE(std::string::npos, output.GetContent().find("Accept-Ranges: bytes\r\n"));
+      ASSERT_TRUE(output.GetContent().substr(output.GetContent().size() - large.size()) == large);
+    }
+
+    {
+      StringHttpOutput output;
+      output.SetRange("bytes=1000-2000000");
+      sender->Send(output);
+      ASSERT_EQ(0u, output.GetContent().find("HTTP/1.1 206 "));
+      ASSERT_NE(std::string::npos, output.GetContent().find("Content-Range: bytes 1000-2000000/" + size + "\r\n"));
+      ASSERT_NE(std::string::npos, output.GetContent().find("Content-Length: 1999001\r\n"));
+      ASSERT_TRUE(output.GetContent().substr(output.GetContent().size() - 1999001) == large.substr(1000, 1999001));
+    }
+
+    {
+      StringHttpOutput output;
+      output.SetRange("bytes=-10");
+      sender->Send(output);
+      ASSERT_EQ(0u, output.GetContent().find("HTTP/1.1 206 "));
+      ASSERT_TRUE(output.GetContent().substr(output.GetContent().size() - 10) == large.substr(large.size() - 10));
+    }
+
+    {
+      StringHttpOutput output;
+      output.SetRange("bytes=" + size + "-");
+      sender->Send(output);
+      ASSERT_EQ(0u, output.GetContent().find("HTTP/1.1 416 "));
+      ASSERT_NE(std::string::npos, output.GetContent().find("Content-Range: bytes */" + size + "\r\n"));
+    }
+
+    {
+      std::string prefix;
+      ASSERT_TRUE(sender->ReadPrefix(prefix, 100));
+      ASSERT_TRUE(prefix == large.substr(0, 100));
+    }
+
+    // The DICOM files are only compressed if they are marked as such
+    sender->SetContentType("application/dicom");
+
+    {
+      StringHttpOutput output;
+      output.SetCompression(HttpCompression_Gzip);
+      sender->Send(output);
+      ASSERT_EQ(std::string::npos, output.GetContent().find("Content-Encoding"));
+      ASSERT_NE(std::string::npos, output.GetContent().find("Content-Length: " + size + "\r\n"));
+    }
+
+    {
+      StringHttpOutput output;
+      output.SetCompression(HttpCompression_Gzip);
+      output.SetChunkedTransferAllowed(true);
+      sender->SetCompressible(true);
+      sender->Send(output);
+      ASSERT_NE(std::string::npos, output.GetContent().find("Content-Encoding: gzip\r\n"));
+      ASSERT_NE(std::string::npos, output.GetContent().find("Transfer-Encoding: chunked\r\n"));
+    }
+  }
+
+  s.Remove(uuid);
+  s.Remove(compressedUuid);
+}
@@ -53,6 +53,7 @@ TEST(DicomModification, Basic)
 
 
 #include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
 
 TEST(DicomModification, Png)
 {
@@ -112,3 +113,93 @@ TEST(DicomModification, Png)
     o.SaveToFile("UnitTestsResults/png4.dcm");
   }
 }
+
+
+TEST(FromDcmtkBridge, LookupPixelData)
+{
+  ParsedDicomFile o;
+  o.Replace(DICOM_TAG_PATIENT_NAME, "Hello");
+  o.EmbedImage("data:image/png;base64,iVBORw0KGgoAAAANSUhEUgAAAAUAAAAFCAYAAACNbyblAAAAHElEQVQI12P4//8/w38GIAXDIBKE0DHxgljNBAAO9TXL0Y4OHwAAAABJRU5ErkJggg==");
+
+  std::string s;
+  o.SaveToMemoryBuffer(s);
+
+  size_t offset;
+  ASSERT_TRUE(FromDcmtkBridge::LookupPixelData(offset, s.c_str(), s.size()));
+  ASSERT_LT(offset, s.size());
+  ASSERT_EQ(0, memcmp(s.c_str() + offset, "\xe0\x7f\x10\x00", 4));
+
+  ASSERT_FALSE(FromDcmtkBridge::LookupPixelData(offset, s.c_str(), 100));
+  ASSERT_FALSE(FromDcmtkBridge::LookupPixelData(offset, s.c_str(), offset));
+
+  std::auto_ptr<ParsedDicomFile> header(ParsedDicomFile::CreateFromHeader(s.c_str(), s.size()));
+
+  std::string value;
+  ASSERT_TRUE(header->GetTagValue(value, DICOM_TAG_PATIENT_NAME));
+  ASSERT_EQ("Hello", value);
+  ASSERT_TRUE(header->GetTagValue(value, DICOM_TAG_COLUMNS));
+
+  // This pixel data is too small to be truncated
+  std::string truncated;
+  ASSERT_FALSE(FromDcmtkBridge::TruncatePixelData(truncated, s.c_str(), s.size()));
+}
+
+
+TEST(FromDcmtkBridge, TruncatePixelData)
+{
+  ImageBuffer img;
+  img.SetWidth(256);
+  img.SetHeight(256);
+  img.SetFormat(PixelFormat_Grayscale16);
+  for (unsigned int y = 0; y < img.GetHeight(); y++)
+  {
+    memset(img.GetAccessor().GetRow(y), 0, img.GetWidth() * 2);
+  }
+
+  ParsedDicomFile o;
+  o.Replace(DICOM_TAG_PATIENT_NAME, "Hello");
+  o.EmbedImage(img.GetAccessor());
+
+  std::string s;
+  o.SaveToMemoryBuffer(s);
+
+  // Append a private creator (7fe1,0010) after the pixel data, in
+  // explicit VR little endian
+  s.append("\xe1\x7f\x10\x00" "LO" "\x08\x00" "Trailing", 16);
+
+  std::string truncated;
+  ASSERT_TRUE(FromDcmtkBridge::TruncatePixelData(truncated, s.c_str(), s.size()));
+  ASSERT_LT(truncated.size(), s.size());
+
+  ParsedDicomFile full(s);
+  std::auto_ptr<ParsedDicomFile> header(ParsedDicomFile::CreateFromHeader(s.c_str(), s.size()));
+
+  Json::Value eager, lazy;
+  FromDcmtkBridge::ToJson(eager, *reinterpret_cast<DcmFileFormat*>(full.GetDcmtkObject())->getDataset());
+  FromDcmtkBridge::ToJson(lazy, *reinterpret_cast<DcmFileFormat*>(header->GetDcmtkObject())->getDataset());
+
+  ASSERT_TRUE(eager.isMember("7fe0,0010"));
+  ASSERT_TRUE(eager.isMember("7fe1,0010"));
+  ASSERT_EQ("Trailing", eager["7fe1,0010"]["Value"].asString());
+  ASSERT_EQ(eager.toStyledString(), lazy.toStyledString());
+}
+
+
+TEST(FromDcmtkBridge, LookupTransferSyntax)
+{
+  ParsedDicomFile o;
+  o.Replace(DICOM_TAG_PATIENT_NAME, "Hello");
+
+  std::string s;
+  o.SaveToMemoryBuffer(s);
+
+  // The meta-header is enough to get the transfer syntax
+  std::string transferSyntax;
+  ASSERT_TRUE(FromDcmtkBridge::LookupTransferSyntax(transferSyntax, s.c_str(), s.size()));
+  ASSERT_EQ("1.2.840.10008.1.2.1", transferSyntax);
+  std::string prefix = s.substr(0, 1024);
+  ASSERT_TRUE(FromDcmtkBridge::LookupTransferSyntax(transferSyntax, prefix.c_str(), prefix.size()));
+  ASSERT_EQ("1.2.840.10008.1.2.1", transferSyntax);
+  ASSERT_FALSE(FromDcmtkBridge::LookupTransferSyntax(transferSyntax, s.c_str(), 100));
+  ASSERT_FALSE(FromDcmtkBridge::LookupTransferSyntax(transferSyntax, NULL, 0));
+}
@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 
 #include "../Core/Lua/LuaFunctionCall.h"
+#include "../Core/Lua/LuaContextPool.h"
 
 
 TEST(Lua, Json)
@@ -101,3 +102,137 @@ TEST(Lua, Simple)
     f.Execute();
   }
 }
+
+
+TEST(Lua, ContextPool)
+{
+  Orthanc::LuaContextPool pool(2);
+  pool.LoadScript("function f() end");
+  pool.LoadScript("counter = 0");
+
+  {
+    Orthanc::LuaContextPool::Locker locker1(pool);
+    Orthanc::LuaContextPool::Locker locker2(pool);
+    ASSERT_NE(&locker1.GetContext(), &locker2.GetContext());
+
+    // The second context is created by replaying the scripts
+    ASSERT_TRUE(locker1.GetContext().IsExistingFunction("f"));
+    ASSERT_TRUE(locker2.GetContext().IsExistingFunction("f"));
+
+    locker1.GetContext().Execute("counter = counter + 1");
+  }
+
+  // The startup scripts are available in all the contexts
+  pool.LoadScript("function g() end");
+
+  {
+    Orthanc::LuaContextPool::Locker locker1(pool);
+    Orthanc::LuaContextPool::Locker locker2(pool);
+    ASSERT_TRUE(locker1.GetContext().IsExistingFunction("g"));
+    ASSERT_TRUE(locker2.GetContext().IsExistingFunction("g"));
+
+    // The global variables are not shared between the contexts
+    std::string s1, s2;
+    locker1.GetContext().Execute(s1, "print(counter)");
+    locker2.GetContext().Execute(s2, "print(counter)");
+    ASSERT_NE(s1, s2);
+  }
+
+  ASSERT_THROW(pool.LoadScript("!!"), Orthanc::LuaException);
+  ASSERT_TRUE(pool.IsExistingFunction("f"));
+  ASSERT_FALSE(pool.IsExistingFunction("counter"));
+
+  // The ad-hoc scripts are refused if there are several contexts
+  std::string s;
+  ASSERT_THROW(pool.Execute(s, "print(42)"), Orthanc::OrthancException);
+
+  // The ad-hoc scripts are not replayed in the new contexts
+  pool.SetMaxSize(1);
+  pool.Execute(s, "function h() end");
+  ASSERT_TRUE(pool.IsExistingFunction("h"));
+  pool.SetMaxSize(2);
+
+  {
+    Orthanc::LuaContextPool::Locker locker1(pool);
+    Orthanc::LuaContextPool::Locker locker2(pool);
+    ASSERT_TRUE(locker1.GetContext().IsExistingFunction("h") !=
+                locker2.GetContext().IsExistingFunction("h"));
+  }
+}
+
+
+namespace
+{
+  class DummyLazyObject : public Orthanc::ILuaLazyObject
+  {
+  private:
+    unsigned int count_;
+
+  public:
+    DummyLazyObject() : count_(0)
+    {
+    }
+
+    unsigned int GetCount() const
+    {
+      return count_;
+    }
+
+    virtual bool LookupField(Json::Value& value,
+                             const std::string& name)
+    {
+      count_++;
+
+      if (name == "Modality")
+      {
+        value = "CT";
+        return true;
+      }
+
+      return false;
+    }
+
+    virtual void GetAllFields(Json::Value& target)
+    {
+      target = Json::objectValue;
+      target["Modality"] = "CT";
+    }
+  };
+}
+
+
+TEST(Lua, LazyObject)
+{
+  Orthanc::LuaContext lua;
+  lua.Execute("function f(tags) return tags['Modality'] == 'CT' and tags['Nope'] == nil end");
+  lua.Execute("function g(tags) saved = tags return true end");
+
+  DummyLazyObject object;
+
+  {
+    Orthanc::LuaFunctionCall f(lua, "f");
+    f.PushLazyObject(object);
+    ASSERT_TRUE(f.ExecutePredicate());
+  }
+
+  ASSERT_EQ(2u, object.GetCount());
+
+  // Iteration over the fields, through a table
+  lua.Execute("function h(tags) local n = 0 for k, v in pairs(tags:ToTable()) do n = n + 1 end return n == 1 end");
+
+  {
+    Orthanc::LuaFunctionCall f(lua, "h");
+    f.PushLazyObject(object);
+    ASSERT_TRUE(f.ExecutePredicate());
+  }
+
+  {
+    Orthanc::LuaFunctionCall f(lua, "g");
+    f.PushLazyObject(object);
+    ASSERT_TRUE(f.ExecutePredicate());
+  }
+
+  // The object cannot be accessed once the call is over
+  ASSERT_THROW(lua.Execute("print(saved['Modality'])"), Orthanc::LuaException);
+  ASSERT_EQ(2u, object.GetCount());
+}
@@ -216,6 +216,114 @@ TEST(MultiThreading, ReaderWriterLock)
 
 
 
+#include "../OrthancServer/IngestQueue.h"
+
+namespace
+{
+  class DummyIngestJob : public IngestQueue::IJob
+  {
+  private:
+    boost::mutex* gate_;
+    bool failure_;
+
+  public:
+    DummyIngestJob(boost::mutex* gate = NULL,
+                   bool failure = false) : 
+      gate_(gate),
+      failure_(failure)
+    {
+    }
+
+    virtual StoreStatus Execute(std::string& publicId)
+    {
+      if (gate_ != NULL)
+      {
+        boost::mutex::scoped_lock lock(*gate_);
+      }
+
+      if (failure_)
+      {
+        throw OrthancException(ErrorCode_BadFileFormat);
+      }
+
+      publicId = "instance";
+      return StoreStatus_Success;
+    }
+  };
+}
+
+
+TEST(MultiThreading, IngestQueue)
+{
+  IngestQueue queue(2, 10, true);
+
+  StoreStatus status;
+  std::string id;
+  ASSERT_TRUE(queue.Execute(status, id, new DummyIngestJob));
+  ASSERT_EQ(StoreStatus_Success, status);
+  ASSERT_EQ("instance", id);
+
+  ASSERT_THROW(queue.Execute(status, id, new DummyIngestJob(NULL, true)), OrthancException);
+
+  std::string job;
+  Json::Value v;
+  ASSERT_TRUE(queue.Submit(job, new DummyIngestJob));
+  ASSERT_FALSE(queue.LookupJob(v, "nope"));
+
+  for (;;)
+  {
+    ASSERT_TRUE(queue.LookupJob(v, job));
+    if (v["State"] == "Done")
+      break;
+    Toolbox::USleep(1000);
+  }
+
+  ASSERT_EQ(job, v["ID"].asString());
+  ASSERT_EQ("Success", v["Status"].asString());
+  ASSERT_EQ("instance", v["Instance"].asString());
+
+  queue.GetStatistics(v);
+  ASSERT_EQ(2u, v["Workers"].asUInt());
+  ASSERT_EQ("3", v["Processed"].asString());
+}
+
+
+TEST(MultiThreading, IngestQueueFull)
+{
+  boost::mutex gate;
+  std::string job1, job2, job3;
+
+  {
+    IngestQueue queue(1, 1, false);
+
+    {
+      boost::mutex::scoped_lock lock(gate);
+
+      ASSERT_TRUE(queue.Submit(job1, new DummyIngestJob(&gate)));
+
+      Json::Value v;
+      do
+      {
+        Toolbox::USleep(1000);
+        queue.GetStatistics(v);
+      }
+      while (v["Running"].asUInt() == 0);
+
+      ASSERT_TRUE(queue.Submit(job2, new DummyIngestJob(&gate)));
+      ASSERT_FALSE(queue.Submit(job3, new DummyIngestJob(&gate)));
+
+      queue.GetStatistics(v);
+      ASSERT_EQ(1u, v["QueueSize"].asUInt());
+      ASSERT_EQ("1", v["Refused"].asString());
+    }
+
+    // The destructor waits for the pending jobs
+  }
+}
+
+
+
+
 
 #include "../OrthancServer/DicomProtocol/ReusableDicomUserConnection.h"
 
@@ -2,10 +2,19 @@
 
 #include <ctype.h>
 #include <glog/logging.h>
+#include <zlib.h>
+#include <boost/lexical_cast.hpp>
 
 #include "../Core/ChunkedBuffer.h"
 #include "../Core/HttpClient.h"
+#include "../Core/HttpServer/ChunkStore.h"
+#include "../Core/HttpServer/ChunkedHttpOutput.h"
+#include "../Core/HttpServer/CompressedHttpOutput.h"
+#include "../Core/HttpServer/StringHttpOutput.h"
 #include "../Core/RestApi/RestApi.h"
+#include "../Core/RestApi/RestApiHierarchy.h"
+#include "../Core/RestApi/JsonStreamWriter.h"
+#include "../Core/RestApi/RestApiMetrics.h"
 #include "../Core/Uuid.h"
 #include "../Core/OrthancException.h"
 #include "../Core/Compression/ZlibCompressor.h"
@@ -126,3 +135,887 @@ TEST(RestApi, RestApiPath)
     ASSERT_EQ("c", trail[2]);
   }
 }
+
+
+namespace
+{
+  class StringReader : public HttpRequestBody::IReader
+  {
+  private:
+    std::string content_;
+    size_t position_;
+    size_t maxChunk_;
+
+  public:
+    StringReader(const std::string& content,
+                 size_t maxChunk) :
+      content_(content),
+      position_(0),
+      maxChunk_(maxChunk)
+    {
+    }
+
+    size_t GetPosition() const
+    {
+      return position_;
+    }
+
+    virtual size_t Read(void* buffer, size_t size)
+    {
+      size_t n = std::min(std::min(size, maxChunk_), content_.size() - position_);
+      if (n > 0)
+      {
+        memcpy(buffer, &content_[position_], n);
+        position_ += n;
+      }
+
+      return n;
+    }
+  };
+}
+
+
+TEST(HttpRequestBody, Basic)
+{
+  std::string s;
+  for (size_t i = 0; i < 100000; i++)
+  {
+    s.push_back(static_cast<char>(i % 251));
+  }
+
+  {
+    // Streaming read
+    StringReader reader(s, 1000);
+    HttpRequestBody body(reader, s.size(), 1024);
+
+    char buffer[1500];
+    std::string t;
+    for (;;)
+    {
+      size_t n = body.Read(buffer, sizeof(buffer));
+      if (n == 0)
+        break;
+      t.append(buffer, n);
+    }
+
+    ASSERT_EQ(s, t);
+    ASSERT_FALSE(body.IsSpilledToDisk());
+  }
+
+  {
+    // Small body, buffered in memory
+    StringReader reader(s, 1000);
+    HttpRequestBody body(reader, s.size(), s.size());
+    ASSERT_EQ(0, memcmp(body.GetData(), s.c_str(), s.size()));
+    ASSERT_FALSE(body.IsSpilledToDisk());
+    ASSERT_EQ(s, body.GetContent());
+  }
+
+  {
+    // Large body, spilled to a temporary file
+    StringReader reader(s, 1000);
+    HttpRequestBody body(reader, s.size(), 1024);
+    ASSERT_EQ(0, memcmp(body.GetData(), s.c_str(), s.size()));
+    ASSERT_TRUE(body.IsSpilledToDisk());
+
+    char buffer[10];
+    ASSERT_EQ(10u, body.Read(buffer, 10));
+    ASSERT_EQ(0, memcmp(buffer, s.c_str(), 10));
+
+    ASSERT_EQ(s, body.GetContent());
+    ASSERT_FALSE(body.IsSpilledToDisk());
+  }
+
+  {
+    // The body cannot be accessed as a whole once partially read
+    StringReader reader(s, 1000);
+    HttpRequestBody body(reader, s.size(), 1024);
+
+    char buffer[10];
+    ASSERT_EQ(10u, body.Read(buffer, 10));
+    ASSERT_THROW(body.GetData(), OrthancException);
+
+    body.Discard();
+    ASSERT_EQ(s.size(), reader.GetPosition());
+  }
+
+  {
+    // The connection is closed before the end of the body
+    StringReader reader(s, 1000);
+    HttpRequestBody body(reader, s.size() + 10, 1024);
+    ASSERT_THROW(body.GetData(), OrthancException);
+  }
+
+  {
+    HttpRequestBody body;
+    ASSERT_EQ(0u, body.GetSize());
+    ASSERT_TRUE(body.GetContent().empty());
+
+    std::string t = "hello";
+    body.SetContent(t);
+    ASSERT_EQ(5u, body.GetSize());
+    ASSERT_EQ("hello", body.GetContent());
+  }
+}
+
+
+TEST(ChunkStore, Basic)
+{
+  ChunkStore store;
+  std::auto_ptr<Toolbox::TemporaryFile> completed;
+
+  // Reassembly of a file uploaded in 3 chunks
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "hello", 5, "a", 11));
+  ASSERT_EQ(5u, store.GetTotalSize());
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, " ", 1, "a", 11));
+  ASSERT_TRUE(completed.get() == NULL);
+  ASSERT_EQ(ChunkStore::Status_Completed, store.Store(completed, "world", 5, "a", 11));
+  ASSERT_TRUE(completed.get() != NULL);
+  ASSERT_EQ(0u, store.GetTotalSize());
+
+  std::string s;
+  Toolbox::ReadFile(s, completed->GetPath());
+  ASSERT_EQ("hello world", s);
+
+  // The completed file can be given to the body of a request
+  HttpRequestBody body;
+  body.SetFile(completed.release(), 11);
+  ASSERT_TRUE(body.IsSpilledToDisk());
+  ASSERT_EQ("hello world", std::string(body.GetData(), 11));
+
+  // A file that is larger than announced is refused
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "hello", 5, "b", 6));
+  ASSERT_EQ(ChunkStore::Status_Failure, store.Store(completed, "world", 5, "b", 6));
+  ASSERT_EQ(0u, store.GetTotalSize());
+}
+
+
+TEST(ChunkStore, Eviction)
+{
+  ChunkStore store;
+  store.SetMaxFiles(2);
+  std::auto_ptr<Toolbox::TemporaryFile> completed;
+
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "a", 1, "a", 2));
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "b", 1, "b", 2));
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "a", 0, "a", 2));
+
+  // "b" is the least recently used file, and is discarded
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "c", 1, "c", 2));
+  ASSERT_EQ(ChunkStore::Status_Failure, store.Store(completed, "b", 1, "b", 2));
+  ASSERT_EQ(ChunkStore::Status_Completed, store.Store(completed, "a", 1, "a", 2));
+
+  // Budget on the total size of the pending files
+  store.SetMaxTotalSize(4);
+  ASSERT_EQ(ChunkStore::Status_Failure, store.Store(completed, "d", 1, "d", 5));
+  ASSERT_EQ(1u, store.GetTotalSize());
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "eee", 3, "e", 4));
+  ASSERT_EQ(4u, store.GetTotalSize());
+  ASSERT_EQ(ChunkStore::Status_Pending, store.Store(completed, "f", 1, "f", 2));
+  ASSERT_EQ(ChunkStore::Status_Failure, store.Store(completed, "c", 1, "c", 2));
+
+  // "f" is discarded to make room for the last chunk of "e"
+  ASSERT_EQ(ChunkStore::Status_Completed, store.Store(completed, "e", 1, "e", 4));
+  ASSERT_EQ(0u, store.GetTotalSize());
+  ASSERT_EQ(ChunkStore::Status_Failure, store.Store(completed, "f", 1, "f", 2));
+}
+
+
+namespace
+{
+  void Inflate(std::string& target,
+               const std::string& source)
+  {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    ASSERT_EQ(Z_OK, inflateInit2(&stream, MAX_WBITS + 32));  // Detect zlib or gzip
+
+    std::vector<char> buffer(1024);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(source.c_str()));
+    stream.avail_in = source.size();
+
+    int result;
+    target.clear();
+
+    do
+    {
+      stream.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+      stream.avail_out = buffer.size();
+      result = inflate(&stream, Z_NO_FLUSH);
+      ASSERT_TRUE(result == Z_OK || result == Z_STREAM_END);
+      target.append(&buffer[0], buffer.size() - stream.avail_out);
+    }
+    while (result != Z_STREAM_END);
+
+    inflateEnd(&stream);
+  }
+}
+
+
+TEST(HttpOutput, NegotiateCompression)
+{
+  ASSERT_EQ(HttpCompression_None, HttpOutput::NegotiateCompression(""));
+  ASSERT_EQ(HttpCompression_None, HttpOutput::NegotiateCompression("identity"));
+  ASSERT_EQ(HttpCompression_Gzip, HttpOutput::NegotiateCompression("gzip, deflate"));
+  ASSERT_EQ(HttpCompression_Gzip, HttpOutput::NegotiateCompression("deflate, GZIP"));
+  ASSERT_EQ(HttpCompression_Deflate, HttpOutput::NegotiateCompression("deflate"));
+  ASSERT_EQ(HttpCompression_Deflate, HttpOutput::NegotiateCompression("gzip;q=0.5, deflate"));
+  ASSERT_EQ(HttpCompression_None, HttpOutput::NegotiateCompression("gzip;q=0"));
+  ASSERT_EQ(HttpCompression_Gzip, HttpOutput::NegotiateCompression("*"));
+  ASSERT_EQ(HttpCompression_Deflate, HttpOutput::NegotiateCompression("gzip;q=0, *"));
+}
+
+
+TEST(HttpOutput, Compression)
+{
+  std::string s;
+  for (unsigned int i = 0; i < 10000; i++)
+  {
+    s += "{ \"Hello\" : \"World\" }\n";
+  }
+
+  for (int i = 0; i < 2; i++)
+  {
+    HttpCompression compression = (i == 0 ? HttpCompression_Gzip : HttpCompression_Deflate);
+
+    std::string compressed, uncompressed;
+    CompressedHttpOutput::Compress(compressed, s.c_str(), s.size(), compression, 6);
+    ASSERT_LT(compressed.size(), s.size() / 10);
+    Inflate(uncompressed, compressed);
+    ASSERT_EQ(s, uncompressed);
+
+    StringHttpOutput output;
+    output.SetCompression(compression);
+    ASSERT_TRUE(output.IsCompressionApplicable("application/json; charset=utf-8", s.size()));
+    ASSERT_FALSE(output.IsCompressionApplicable("application/json", 10));
+    ASSERT_FALSE(output.IsCompressionApplicable("image/png", s.size()));
+
+    output.AnswerBufferWithContentType(s, "application/json");
+    ASSERT_NE(std::string::npos, output.GetContent().find(i == 0 ? "Content-Encoding: gzip\r\n" : "Content-Encoding: deflate\r\n"));
+
+    size_t body = output.GetContent().find("\r\n\r\n") + 4;
+    ASSERT_NE(std::string::npos, output.GetContent().find("Content-Length: " + boost::lexical_cast<std::string>(output.GetContent().size() - body)));
+    Inflate(uncompressed, output.GetContent().substr(body));
+    ASSERT_EQ(s, uncompressed);
+  }
+
+  // No compression if the client does not accept it
+  StringHttpOutput output;
+  output.AnswerBufferWithContentType(s, "application/json");
+  ASSERT_EQ(std::string::npos, output.GetContent().find("Content-Encoding"));
+  ASSERT_EQ(s, output.GetContent().substr(output.GetContent().size() - s.size()));
+}
+
+
+TEST(HttpOutput, ParseRange)
+{
+  uint64_t start, end;
+
+  ASSERT_EQ(HttpOutput::RangeStatus_Satisfiable, HttpOutput::ParseRange(start, end, "bytes=0-99", 1000));
+  ASSERT_EQ(0u, start);
+  ASSERT_EQ(99u, end);
+
+  ASSERT_EQ(HttpOutput::RangeStatus_Satisfiable, HttpOutput::ParseRange(start, end, "bytes=500-", 1000));
+  ASSERT_EQ(500u, start);
+  ASSERT_EQ(999u, end);
+
+  ASSERT_EQ(HttpOutput::RangeStatus_Satisfiable, HttpOutput::ParseRange(start, end, "bytes=900-5000", 1000));
+  ASSERT_EQ(900u, start);
+  ASSERT_EQ(999u, end);
+
+  ASSERT_EQ(HttpOutput::RangeStatus_Satisfiable, HttpOutput::ParseRange(start, end, "bytes=-100", 1000));
+  ASSERT_EQ(900u, start);
+  ASSERT_EQ(999u, end);
+
+  ASSERT_EQ(HttpOutput::RangeStatus_Satisfiable, HttpOutput::ParseRange(start, end, "bytes=-5000", 1000));
+  ASSERT_EQ(0u, start);
+  ASSERT_EQ(999u, end);
+
+  ASSERT_EQ(HttpOutput::RangeStatus_Unsatisfiable, HttpOutput::ParseRange(start, end, "bytes=1000-", 1000));
+  ASSERT_EQ(HttpOutput::RangeStatus_Unsatisfiable, HttpOutput::ParseRange(start, end, "bytes=-0", 1000));
+  ASSERT_EQ(HttpOutput::RangeStatus_Unsatisfiable, HttpOutput::ParseRange(start, end, "bytes=0-", 0));
+
+  ASSERT_EQ(HttpOutput::RangeStatus_None, HttpOutput::ParseRange(start, end, "", 1000));
+  ASSERT_EQ(HttpOutput::RangeStatus_None, HttpOutput::ParseRange(start, end, "items=0-10", 1000));
+  ASSERT_EQ(HttpOutput::RangeStatus_None, HttpOutput::ParseRange(start, end, "bytes=0-10,20-30", 1000));
+  ASSERT_EQ(HttpOutput::RangeStatus_None, HttpOutput::ParseRange(start, end, "bytes=10-5", 1000));
+  ASSERT_EQ(HttpOutput::RangeStatus_None, HttpOutput::ParseRange(start, end, "bytes=a-b", 1000));
+  ASSERT_EQ(HttpOutput::RangeStatus_None, HttpOutput::ParseRange(start, end, "bytes=-", 1000));
+}
+
+
+TEST(HttpOutput, ETag)
+{
+  std::string s(2000, 'a');
+
+  {
+    StringHttpOutput output;
+    output.SetETag("1234");
+    output.SetCacheControl("max-age=60");
+    ASSERT_FALSE(output.IsNotModified());
+    output.AnswerBufferWithContentType(s, "text/plain");
+    ASSERT_NE(std::string::npos, output.GetContent().find("ETag: \"1234\"\r\n"));
+    ASSERT_NE(std::string::npos, output.GetContent().find("Cache-Control: max-age=60\r\n"));
+  }
+
+  {
+    // The compressed representation has its own entity tag
+    StringHttpOutput output;
+    output.SetCompression(HttpCompression_Gzip);
+    output.SetETag("1234");
+    output.AnswerBufferWithContentType(s, "text/plain");
+    ASSERT_NE(std::string::npos, output.GetContent().find("ETag: \"1234-gzip\"\r\n"));
+  }
+
+  {
+    StringHttpOutput output;
+    output.SetETag("1234");
+    output.SetIfNoneMatch("\"abcd\", W/\"1234-gzip\"");
+    ASSERT_TRUE(output.IsNotModified());
+    output.SendNotModified();
+    ASSERT_EQ(0u, output.GetContent().find("HTTP/1.1 304 "));
+    ASSERT_NE(std::string::npos, output.GetContent().find("ETag: \"1234\"\r\n"));
+  }
+
+  {
+    StringHttpOutput output;
+    output.SetIfNoneMatch("*");
+    ASSERT_FALSE(output.IsNotModified());  // No entity tag
+    output.SetETag("1234");
+    ASSERT_TRUE(output.IsNotModified());
+    output.SetIfNoneMatch("\"12345\"");
+    ASSERT_FALSE(output.IsNotModified());
+  }
+
+  {
+    StringHttpOutput output;
+    ASSERT_TRUE(output.IsRangeAllowed());
+    output.SetIfRange("\"1234\"");
+    ASSERT_FALSE(output.IsRangeAllowed());
+    output.SetETag("1234");
+    ASSERT_TRUE(output.IsRangeAllowed());
+    output.SetIfRange("W/\"1234\"");
+    ASSERT_FALSE(output.IsRangeAllowed());
+
+    // The ranges are never compressed
+    output.SetIfRange("\"1234-gzip\"");
+    ASSERT_FALSE(output.IsRangeAllowed());
+  }
+}
+
+
+namespace
+{
+  // Decodes an answer sent with the chunked transfer encoding
+  void Unchunk(std::string& target,
+               const std::string& source)
+  {
+    target.clear();
+
+    size_t pos = 0;
+    for (;;)
+    {
+      size_t eol = source.find("\r\n", pos);
+      ASSERT_NE(std::string::npos, eol);
+
+      size_t size = strtoul(source.substr(pos, eol - pos).c_str(), NULL, 16);
+      pos = eol + 2;
+
+      if (size == 0)
+      {
+        ASSERT_EQ("\r\n", source.substr(pos));
+        return;
+      }
+
+      target += source.substr(pos, size);
+      pos += size;
+      ASSERT_EQ("\r\n", source.substr(pos, 2));
+      pos += 2;
+    }
+  }
+}
+
+
+TEST(HttpOutput, Chunked)
+{
+  std::string s;
+  for (unsigned int i = 0; i < 10000; i++)
+  {
+    s += "{ \"Hello\" : \"World\" }\n";
+  }
+
+  {
+    StringHttpOutput output;
+    output.SetChunkedTransferAllowed(true);
+
+    {
+      ChunkedHttpOutput stream(output, "application/json", "");
+      for (size_t i = 0; i < s.size(); i += 1000)
+      {
+        stream.SendString(s.substr(i, 1000));
+      }
+
+      stream.Finish();
+      ASSERT_THROW(stream.SendString("Hello"), OrthancException);
+    }
+
+    size_t body = output.GetContent().find("\r\n\r\n") + 4;
+    std::string header = output.GetContent().substr(0, body);
+    ASSERT_EQ(0u, header.find("HTTP/1.1 200 OK\r\n"));
+    ASSERT_NE(std::string::npos, header.find("Transfer-Encoding: chunked\r\n"));
+    ASSERT_EQ(std::string::npos, header.find("Content-Length"));
+    ASSERT_EQ(std::string::npos, header.find("Content-Encoding"));
+    ASSERT_GE(strtoul(output.GetContent().c_str() + body, NULL, 16), 65536u);  // Chunks of 64KB
+
+    std::string decoded;
+    Unchunk(decoded, output.GetContent().substr(body));
+    ASSERT_EQ(s, decoded);
+    ASSERT_FALSE(output.IsCloseConnectionRequired());
+  }
+
+  {
+    // HTTP/1.0 client: The end of the answer is marked by the closing
+    // of the connection
+    StringHttpOutput output;
+    ASSERT_FALSE(output.IsChunkedTransferAllowed());
+
+    {
+      ChunkedHttpOutput stream(output, "text/plain", "");
+      stream.SendString("Hello");
+      stream.Flush();
+      stream.SendString(" World");
+      stream.Finish();
+    }
+
+    size_t body = output.GetContent().find("\r\n\r\n") + 4;
+    ASSERT_NE(std::string::npos, output.GetContent().substr(0, body).find("Connection: close\r\n"));
+    ASSERT_EQ(std::string::npos, output.GetContent().find("Transfer-Encoding"));
+    ASSERT_EQ("Hello World", output.GetContent().substr(body));
+    ASSERT_TRUE(output.IsCloseConnectionRequired());
+  }
+
+  {
+    StringHttpOutput output;
+    output.SetChunkedTransferAllowed(true);
+    output.SetCompression(HttpCompression_Gzip);
+
+    {
+      ChunkedHttpOutput stream(output, "application/json", "");
+      stream.SendString(s);
+      stream.Finish();
+    }
+
+    size_t body = output.GetContent().find("\r\n\r\n") + 4;
+    ASSERT_NE(std::string::npos, output.GetContent().substr(0, body).find("Content-Encoding: gzip\r\n"));
+
+    std::string compressed, uncompressed;
+    Unchunk(compressed, output.GetContent().substr(body));
+    ASSERT_LT(compressed.size(), s.size() / 10);
+    Inflate(uncompressed, compressed);
+    ASSERT_EQ(s, uncompressed);
+  }
+}
+
+
+namespace
+{
+  std::string lastHandler_;
+
+  void GetInstance(RestApi::GetCall& call)
+  {
+    lastHandler_ = "instance " + call.GetUriComponent("id", "");
+  }
+
+  void GetAttachment(RestApi::GetCall& call)
+  {
+    lastHandler_ = ("attachment " + call.GetUriComponent("resourceType", "") + " " + 
+                    call.GetUriComponent("id", "") + " " + call.GetUriComponent("name", ""));
+  }
+
+  void GetContent(RestApi::GetCall& call)
+  {
+    lastHandler_ = "content " + call.GetUriComponent("id", "") + " " + Toolbox::FlattenUri(call.GetTrailingUri());
+  }
+
+  void DeleteInstance(RestApi::DeleteCall& call)
+  {
+    lastHandler_ = "delete " + call.GetUriComponent("id", "");
+  }
+
+  class LookupVisitor : public RestApiHierarchy::IVisitor
+  {
+  public:
+    HttpMethod method_;
+    RestApiPath::Components components_;
+    UriComponents trailing_;
+
+    LookupVisitor(HttpMethod method) : method_(method)
+    {
+    }
+
+    virtual bool Visit(const RestApiHierarchy::Resource& resource,
+                       const RestApiPath::Components& components,
+                       const UriComponents& trailing)
+    {
+      if (resource.HasHandler(method_))
+      {
+        components_ = components;
+        trailing_ = trailing;
+        return true;
+      }
+
+      return false;
+    }
+  };
+
+  bool Lookup(RestApiHierarchy& hierarchy,
+              LookupVisitor& visitor,
+              const std::string& uri)
+  {
+    UriComponents c;
+    Toolbox::SplitUriComponents(c, uri);
+    return hierarchy.LookupResource(c, visitor);
+  }
+}
+
+
+TEST(RestApi, RestApiHierarchy)
+{
+  RestApiHierarchy root;
+  root.Register("/instances/{id}", GetInstance);
+  root.Register("/instances/{id}", DeleteInstance);
+  root.Register("/instances/{id}/content/*", GetContent);
+  root.Register("/{resourceType}/{id}/attachments/{name}", GetAttachment);
+  ASSERT_THROW(root.Register("/instances/{id}", GetInstance), OrthancException);
+
+  {
+    LookupVisitor visitor(HttpMethod_Get);
+    ASSERT_TRUE(Lookup(root, visitor, "/instances/abc"));
+    ASSERT_EQ(1u, visitor.components_.size());
+    ASSERT_EQ("abc", visitor.components_["id"]);
+    ASSERT_EQ(0u, visitor.trailing_.size());
+  }
+
+  {
+    // The constant "instances" does not hide the free parameter
+    LookupVisitor visitor(HttpMethod_Get);
+    ASSERT_TRUE(Lookup(root, visitor, "/instances/abc/attachments/dicom"));
+    ASSERT_EQ(3u, visitor.components_.size());
+    ASSERT_EQ("instances", visitor.components_["resourceType"]);
+    ASSERT_EQ("abc", visitor.components_["id"]);
+    ASSERT_EQ("dicom", visitor.components_["name"]);
+  }
+
+  {
+    LookupVisitor visitor(HttpMethod_Get);
+    ASSERT_TRUE(Lookup(root, visitor, "/instances/abc/content/0010-0010/0"));
+    ASSERT_EQ(1u, visitor.components_.size());
+    ASSERT_EQ("abc", visitor.components_["id"]);
+    ASSERT_EQ(2u, visitor.trailing_.size());
+    ASSERT_EQ("0010-0010", visitor.trailing_[0]);
+    ASSERT_EQ("0", visitor.trailing_[1]);
+
+    ASSERT_TRUE(Lookup(root, visitor, "/instances/abc/content"));
+    ASSERT_EQ(0u, visitor.trailing_.size());
+  }
+
+  {
+    LookupVisitor visitor(HttpMethod_Post);
+    ASSERT_FALSE(Lookup(root, visitor, "/instances/abc"));
+    ASSERT_FALSE(Lookup(root, visitor, "/instances"));
+    ASSERT_FALSE(Lookup(root, visitor, "/instances/abc/attachments"));
+  }
+
+  UriComponents uri;
+  std::set<HttpMethod> methods;
+  Toolbox::SplitUriComponents(uri, "/instances/abc");
+  ASSERT_TRUE(root.IsServedUri(uri));
+  root.GetAcceptedMethods(methods, uri);
+  ASSERT_EQ(2u, methods.size());
+  ASSERT_TRUE(methods.find(HttpMethod_Get) != methods.end());
+  ASSERT_TRUE(methods.find(HttpMethod_Delete) != methods.end());
+
+  Toolbox::SplitUriComponents(uri, "/patients");
+  ASSERT_FALSE(root.IsServedUri(uri));
+  root.GetAcceptedMethods(methods, uri);
+  ASSERT_EQ(0u, methods.size());
+}
+
+
+TEST(RestApi, Dispatch)
+{
+  RestApi api;
+  api.Register("/instances/{id}", GetInstance);
+  api.Register("/instances/{id}", DeleteInstance);
+  api.Register("/instances/{id}/content/*", GetContent);
+  api.Register("/{resourceType}/{id}/attachments/{name}", GetAttachment);
+
+  HttpHandler::Arguments headers, getArguments;
+  HttpRequestBody body;
+  UriComponents uri;
+
+  {
+    StringHttpOutput output;
+    Toolbox::SplitUriComponents(uri, "/instances/abc/content/0010-0010");
+    api.Handle(output, HttpMethod_Get, uri, headers, getArguments, body);
+    ASSERT_EQ("content abc /0010-0010", lastHandler_);
+  }
+
+  {
+    StringHttpOutput output;
+    Toolbox::SplitUriComponents(uri, "/studies/abc/attachments/42");
+    api.Handle(output, HttpMethod_Get, uri, headers, getArguments, body);
+    ASSERT_EQ("attachment studies abc 42", lastHandler_);
+  }
+
+  {
+    StringHttpOutput output;
+    Toolbox::SplitUriComponents(uri, "/instances/abc");
+    api.Handle(output, HttpMethod_Delete, uri, headers, getArguments, body);
+    ASSERT_EQ("delete abc", lastHandler_);
+  }
+
+  {
+    StringHttpOutput output;
+    Toolbox::SplitUriComponents(uri, "/instances/abc");
+    api.Handle(output, HttpMethod_Post, uri, headers, getArguments, body);
+    ASSERT_EQ(0u, output.GetContent().find("HTTP/1.1 405 "));
+    ASSERT_NE(std::string::npos, output.GetContent().find("Allow: GET,DELETE\r\n"));
+  }
+}
+
+
+TEST(RestApi, JsonStreamWriter)
+{
+  Json::Value value = Json::objectValue;
+  value["Name"] = "Hello \"World\"\n";
+  value["Count"] = 42;
+  value["Size"] = Json::UInt(4000000000u);
+  value["Negative"] = -5;
+  value["Ratio"] = 0.5;
+  value["Valid"] = true;
+  value["Empty"] = Json::arrayValue;
+  value["Nothing"] = Json::nullValue;
+  value["Children"] = Json::arrayValue;
+  value["Children"].append("a");
+  value["Children"].append(Json::objectValue);
+  value["Children"][1]["b"] = "c";
+
+  for (int styled = 0; styled < 2; styled++)
+  {
+    StringHttpOutput output;
+
+    {
+      JsonStreamWriter writer(output, styled != 0);
+      ASSERT_FALSE(writer.IsComplete());
+      writer.WriteValue(value);
+      ASSERT_TRUE(writer.IsComplete());
+      ASSERT_THROW(writer.WriteNull(), OrthancException);
+    }
+
+    if (!styled)
+    {
+      Json::FastWriter fast;
+      ASSERT_EQ(fast.write(value), output.GetContent() + "\n");
+    }
+
+    Json::Value parsed;
+    Json::Reader reader;
+    ASSERT_TRUE(reader.parse(output.GetContent(), parsed));
+    ASSERT_EQ(value, parsed);
+  }
+
+  {
+    StringHttpOutput output;
+    JsonStreamWriter writer(output);
+    ASSERT_THROW(writer.WriteKey("a"), OrthancException);
+    writer.StartObject();
+    ASSERT_THROW(writer.WriteString("a"), OrthancException);  // Missing key
+    ASSERT_THROW(writer.EndArray(), OrthancException);
+    writer.WriteKey("a");
+    ASSERT_THROW(writer.WriteKey("b"), OrthancException);
+    ASSERT_THROW(writer.EndObject(), OrthancException);
+    writer.StartArray();
+    writer.WriteInteger(-1);
+    writer.WriteUnsignedInteger(2);
+    writer.EndArray();
+    writer.EndObject();
+    ASSERT_TRUE(writer.IsComplete());
+    ASSERT_EQ("{\"a\":[-1,2]}", output.GetContent());
+  }
+}
+
+
+TEST(RestApi, StreamedJsonAnswer)
+{
+  StringHttpOutput output;
+  output.SetChunkedTransferAllowed(true);
+
+  {
+    RestApiOutput answer(output);
+    ASSERT_THROW(answer.FinishJsonStream(), OrthancException);
+
+    JsonStreamWriter& writer = answer.StartJsonStream();
+    ASSERT_THROW(answer.AnswerBuffer("", "text/plain"), OrthancException);
+    writer.StartArray();
+    ASSERT_THROW(answer.FinishJsonStream(), OrthancException);
+    writer.WriteString("a");
+    writer.WriteString("b");
+    writer.EndArray();
+    answer.FinishJsonStream();
+  }
+
+  size_t body = output.GetContent().find("\r\n\r\n") + 4;
+  ASSERT_EQ(0u, output.GetContent().find("HTTP/1.1 200 OK\r\n"));
+  ASSERT_NE(std::string::npos, output.GetContent().substr(0, body).find("Content-Type: application/json\r\n"));
+  ASSERT_EQ("9\r\n[\"a\",\"b\"]\r\n0\r\n\r\n", output.GetContent().substr(body));
+}
+
+
+TEST(HttpOutput, EmptyBody)
+{
+  // The answers without a body must be delimited for the keep-alive
+  {
+    StringHttpOutput output;
+    output.SendHeader(HttpStatus_404_NotFound);
+    ASSERT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", output.GetContent());
+  }
+
+  {
+    StringHttpOutput output;
+    output.SendMethodNotAllowedError("GET");
+    ASSERT_NE(std::string::npos, output.GetContent().find("\r\nContent-Length: 0\r\n"));
+  }
+
+  {
+    StringHttpOutput output;
+    output.Redirect("app/explorer.html");
+    ASSERT_NE(std::string::npos, output.GetContent().find("\r\nContent-Length: 0\r\n"));
+  }
+
+  {
+    StringHttpOutput output;
+    output.SendRangeNotSatisfiable(100);
+    ASSERT_NE(std::string::npos, output.GetContent().find("\r\nContent-Length: 0\r\n"));
+  }
+}
+
+
+namespace
+{
+  void GetHello(RestApi::GetCall& call)
+  {
+    call.GetOutput().AnswerBuffer("Hello", "text/plain");
+  }
+
+  void GetNothing(RestApi::GetCall& call)
+  {
+    // No answer: "400 Bad Request"
+  }
+
+  void GetFailure(RestApi::GetCall& call)
+  {
+    throw OrthancException(ErrorCode_InternalError);
+  }
+}
+
+
+TEST(RestApi, Metrics)
+{
+  {
+    RestApiMetrics metrics;
+    metrics.Record(HttpStatus_200_Ok, 10, 100, 500);       // 0.5ms
+    metrics.Record(HttpStatus_200_Ok, 0, 50, 3000);        // 3ms
+    metrics.Record(HttpStatus_404_NotFound, 0, 0, 60000000);  // 1 minute
+
+    RestApiMetrics::Snapshot snapshot;
+    metrics.GetSnapshot(snapshot);
+    ASSERT_EQ(3u, snapshot.count_);
+    ASSERT_EQ(10u, snapshot.bytesIn_);
+    ASSERT_EQ(150u, snapshot.bytesOut_);
+    ASSERT_EQ(60003500u, snapshot.totalLatency_);
+    ASSERT_EQ(1u, snapshot.buckets_[0]);
+    ASSERT_EQ(1u, snapshot.buckets_[2]);
+    ASSERT_EQ(1u, snapshot.buckets_[RestApiMetrics::BUCKETS_COUNT - 1]);
+    ASSERT_EQ(2u, snapshot.statuses_[HttpStatus_200_Ok]);
+    ASSERT_EQ(1u, snapshot.statuses_[HttpStatus_404_NotFound]);
+  }
+
+  RestApi api;
+  api.Register("/hello/{id}", GetHello);
+  api.Register("/nothing", GetNothing);
+  api.Register("/nothing", DeleteInstance);
+  api.Register("/failure", GetFailure);
+
+  HttpHandler::Arguments headers, getArguments;
+  HttpRequestBody body;
+  UriComponents uri;
+  uint64_t sent = 0;
+
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    StringHttpOutput output;
+    Toolbox::SplitUriComponents(uri, "/hello/" + boost::lexical_cast<std::string>(i));
+    api.Handle(output, HttpMethod_Get, uri, headers, getArguments, body);
+    ASSERT_EQ(output.GetContent().size(), output.GetSentBytes());
+    ASSERT_EQ(HttpStatus_200_Ok, output.GetStatus());
+    sent += output.GetSentBytes();
+  }
+
+  {
+    StringHttpOutput output;
+    Toolbox::SplitUriComponents(uri, "/nothing");
+    api.Handle(output, HttpMethod_Get, uri, headers, getArguments, body);
+    ASSERT_EQ(HttpStatus_400_BadRequest, output.GetStatus());
+  }
+
+  {
+    // The status of a failed request is the one of the error answer
+    // that is sent by the HTTP server, once the handler has failed
+    StringHttpOutput output;
+    Toolbox::SplitUriComponents(uri, "/failure");
+    ASSERT_THROW(api.Handle(output, HttpMethod_Get, uri, headers, getArguments, body), OrthancException);
+    output.SendHeader(HttpStatus_503_ServiceUnavailable);
+    output.SignalAnswerCompleted();
+  }
+
+  Json::Value routes;
+  api.GetRoutesMetrics(routes);
+  ASSERT_EQ(4u, routes.size());
+
+  for (Json::Value::ArrayIndex i = 0; i < routes.size(); i++)
+  {
+    const Json::Value& route = routes[i];
+    if (route["Route"] == "/hello/{id}")
+    {
+      ASSERT_EQ("GET", route["Method"].asString());
+      ASSERT_EQ("3", route["Count"].asString());
+      ASSERT_EQ(boost::lexical_cast<std::string>(sent), route["BytesOut"].asString());
+      ASSERT_EQ("3", route["Statuses"]["200"].asString());
+    }
+    else if (route["Route"] == "/failure")
+    {
+      ASSERT_EQ("1", route["Count"].asString());
+      ASSERT_EQ("1", route["Statuses"]["503"].asString());
+      ASSERT_FALSE(route["Statuses"].isMember("500"));
+    }
+    else if (route["Method"] == "GET")
+    {
+      ASSERT_EQ("/nothing", route["Route"].asString());
+      ASSERT_EQ("1", route["Statuses"]["400"].asString());
+    }
+    else
+    {
+      ASSERT_EQ("DELETE", route["Method"].asString());
+      ASSERT_EQ("0", route["Count"].asString());
+    }
+  }
+
+  std::string prometheus;
+  api.FormatPrometheus(prometheus);
+  ASSERT_NE(std::string::npos, prometheus.find("# TYPE orthanc_http_request_duration_seconds histogram\n"));
+  ASSERT_NE(std::string::npos, prometheus.find("orthanc_http_requests_total{method=\"GET\",route=\"/hello/{id}\",status=\"200\"} 3\n"));
+  ASSERT_NE(std::string::npos, prometheus.find("orthanc_http_request_duration_seconds_bucket{method=\"GET\",route=\"/hello/{id}\",le=\"+Inf\"} 3\n"));
+  ASSERT_NE(std::string::npos, prometheus.find("orthanc_http_request_duration_seconds_count{method=\"GET\",route=\"/nothing\"} 1\n"));
+  ASSERT_EQ(std::string::npos, prometheus.find("DELETE"));  // Never called
+}
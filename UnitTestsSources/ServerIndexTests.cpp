@@ -5,6 +5,8 @@
 #include "../OrthancServer/ServerIndex.h"
 #include "../Core/Uuid.h"
 #include "../Core/DicomFormat/DicomNullValue.h"
+#include "../Core/DicomFormat/CompactDicomTags.h"
+#include "../Core/HttpServer/StringHttpOutput.h"
 
 #include <ctype.h>
 #include <glog/logging.h>
@@ -123,6 +125,11 @@ TEST_P(DatabaseWrapperTest, Simple)
 
     index_->GetAllPublicIds(t, ResourceType_Instance);
     ASSERT_EQ(3u, t.size());
+
+    std::list<std::string> l;
+    index_->GetAllPublicIds(l, ResourceType_Patient);
+    ASSERT_EQ(1u, l.size());
+    ASSERT_EQ("a", l.front());
   }
 
   index_->SetGlobalProperty(GlobalProperty_FlushSleep, "World");
@@ -267,6 +274,38 @@ TEST_P(DatabaseWrapperTest, Simple)
 
 
 
+TEST_P(DatabaseWrapperTest, SharedAttachments)
+{
+  index_->UpgradeToSharedAttachments();
+  ASSERT_EQ("5", index_->GetGlobalProperty(GlobalProperty_DatabaseSchemaVersion));
+
+  int64_t a = index_->CreateResource("a", ResourceType_Instance);
+  int64_t b = index_->CreateResource("b", ResourceType_Instance);
+
+  index_->AddAttachment(a, FileInfo("shared", FileContentType_Dicom, 42, "md5"));
+  index_->AddAttachment(b, FileInfo("shared", FileContentType_Dicom, 42, "md5"));
+  index_->AddAttachment(b, FileInfo("json", FileContentType_DicomAsJson, 10, "md5"));
+  ASSERT_TRUE(index_->IsAttachedFile("shared"));
+  ASSERT_FALSE(index_->IsAttachedFile("nope"));
+
+  // A shared file only counts once
+  ASSERT_EQ(42u + 10u, index_->GetTotalCompressedSize());
+  ASSERT_EQ(42u + 42u + 10u, index_->GetTotalUncompressedSize());
+
+  index_->DeleteResource(a);
+  ASSERT_EQ(0u, listener_->deletedFiles_.size());
+  ASSERT_TRUE(index_->IsAttachedFile("shared"));
+
+  index_->DeleteResource(b);
+  ASSERT_EQ(2u, listener_->deletedFiles_.size());
+  ASSERT_FALSE(std::find(listener_->deletedFiles_.begin(), 
+                         listener_->deletedFiles_.end(),
+                         "shared") == listener_->deletedFiles_.end());
+  ASSERT_FALSE(index_->IsAttachedFile("shared"));
+  ASSERT_EQ(0u, index_->GetTotalCompressedSize());
+}
+
+
 TEST_P(DatabaseWrapperTest, Upward)
 {
   int64_t a[] = {
@@ -571,3 +610,155 @@ TEST(ServerIndex, AttachmentRecycling)
   // Because the DB is in memory, the SQLite index must not have been created
   ASSERT_THROW(Toolbox::GetFileSize(path + "/index"), OrthancException);  
 }
+
+
+TEST(ServerIndex, PinnedFile)
+{
+  const std::string path = "UnitTestsStorage";
+  ServerContext context(path, ":memory:");
+  ServerIndex& index = context.GetIndex();
+
+  DicomMap instance;
+  instance.SetValue(DICOM_TAG_PATIENT_ID, "patient");
+  instance.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "study");
+  instance.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "series");
+  instance.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "instance");
+
+  ServerIndex::Attachments attachments;
+  ASSERT_EQ(StoreStatus_Success, index.Store(instance, attachments, ""));
+  std::string id = DicomInstanceHasher(instance).HashInstance();
+
+  ASSERT_TRUE(context.AddAttachment(id, FileContentType_DicomAsJson, "Hello", 5));
+
+  FileInfo first;
+  ASSERT_TRUE(index.LookupAttachment(first, id, FileContentType_DicomAsJson));
+  std::string file = (path + "/" + first.GetUuid().substr(0, 2) + "/" +
+                      first.GetUuid().substr(2, 2) + "/" + first.GetUuid());
+  ASSERT_EQ(5u, Toolbox::GetFileSize(file));
+
+  // Replacing the attachment of a file that is being read must not
+  // remove the file before it is unpinned
+  index.PinFile(first.GetUuid());
+  ASSERT_TRUE(context.AddAttachment(id, FileContentType_DicomAsJson, "World", 5));
+  ASSERT_EQ(5u, Toolbox::GetFileSize(file));
+
+  index.UnpinFile(first.GetUuid());
+  ASSERT_THROW(Toolbox::GetFileSize(file), OrthancException);
+
+  FileInfo second;
+  ASSERT_TRUE(index.LookupAttachment(second, id, FileContentType_DicomAsJson));
+  ASSERT_NE(first.GetUuid(), second.GetUuid());
+
+  // Without a pin, the file is removed immediately
+  file = (path + "/" + second.GetUuid().substr(0, 2) + "/" +
+          second.GetUuid().substr(2, 2) + "/" + second.GetUuid());
+  ASSERT_EQ(5u, Toolbox::GetFileSize(file));
+
+  Json::Value tmp;
+  ASSERT_TRUE(index.DeleteResource(tmp, id, ResourceType_Instance));
+  ASSERT_THROW(Toolbox::GetFileSize(file), OrthancException);
+}
+
+
+TEST(ServerContext, TagsCache)
+{
+  const std::string path = "UnitTestsStorage";
+  ServerContext context(path, ":memory:");
+  ServerIndex& index = context.GetIndex();
+
+  DicomMap instance;
+  instance.SetValue(DICOM_TAG_PATIENT_ID, "patient");
+  instance.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "study");
+  instance.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "series");
+  instance.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "instance");
+
+  ServerIndex::Attachments attachments;
+  ASSERT_EQ(StoreStatus_Success, index.Store(instance, attachments, ""));
+  std::string id = DicomInstanceHasher(instance).HashInstance();
+
+  Json::Value tags = Json::objectValue;
+  tags["0010,0010"]["Name"] = "PatientName";
+  tags["0010,0010"]["Type"] = "String";
+  tags["0010,0010"]["Value"] = "Hello";
+
+  std::string compact;
+  CompactDicomTags::Serialize(compact, tags);
+  ASSERT_TRUE(context.AddAttachment(id, FileContentType_DicomAsJson, compact.c_str(), compact.size()));
+
+  size_t count;
+  uint64_t hits, misses;
+
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    StringHttpOutput http;
+    RestApiOutput output(http);
+    context.AnswerDicomAsJson(output, id, false);
+    ASSERT_NE(std::string::npos, http.GetContent().find("\"Hello\""));
+  }
+
+  {
+    StringHttpOutput http;
+    RestApiOutput output(http);
+    context.AnswerDicomAsJson(output, id, true);
+    ASSERT_NE(std::string::npos, http.GetContent().find("\"PatientName\" : \"Hello\""));
+  }
+
+  context.GetTagsCacheStatistics(count, hits, misses);
+  ASSERT_EQ(2u, count);
+  ASSERT_EQ(1u, hits);
+  ASSERT_EQ(2u, misses);
+
+  // Modifying the attachment invalidates the cached answers
+  tags["0010,0010"]["Value"] = "World";
+  CompactDicomTags::Serialize(compact, tags);
+  ASSERT_TRUE(context.AddAttachment(id, FileContentType_DicomAsJson, compact.c_str(), compact.size()));
+
+  context.GetTagsCacheStatistics(count, hits, misses);
+  ASSERT_EQ(0u, count);
+
+  {
+    StringHttpOutput http;
+    RestApiOutput output(http);
+    context.AnswerDicomAsJson(output, id, false);
+    ASSERT_EQ(std::string::npos, http.GetContent().find("\"Hello\""));
+    ASSERT_NE(std::string::npos, http.GetContent().find("\"World\""));
+  }
+
+  // Legacy attachment, written as styled JSON by former versions
+  tags["0010,0010"]["Value"] = "Legacy";
+  std::string legacy = tags.toStyledString();
+  ASSERT_TRUE(context.AddAttachment(id, FileContentType_DicomAsJson, legacy.c_str(), legacy.size()));
+
+  {
+    StringHttpOutput http;
+    RestApiOutput output(http);
+    context.AnswerDicomAsJson(output, id, false);
+    ASSERT_NE(std::string::npos, http.GetContent().find("\"Legacy\""));
+  }
+
+  {
+    StringHttpOutput http;
+    RestApiOutput output(http);
+    context.AnswerDicomAsJson(output, id, true);
+    ASSERT_NE(std::string::npos, http.GetContent().find("\"PatientName\" : \"Legacy\""));
+  }
+
+  Json::Value json;
+  context.ReadJson(json, id);
+  ASSERT_EQ(tags, json);
+
+  std::string s, value;
+  context.ReadCompactTags(s, id);
+  ASSERT_TRUE(CompactDicomTags::IsCompact(s));
+  ASSERT_TRUE(CompactDicomTags(s).LookupValue(value, DICOM_TAG_PATIENT_NAME));
+  ASSERT_EQ("Legacy", value);
+
+  context.GetTagsCacheStatistics(count, hits, misses);
+  ASSERT_EQ(2u, count);
+
+  // Deleting the instance invalidates the cached answers
+  Json::Value tmp;
+  ASSERT_TRUE(index.DeleteResource(tmp, id, ResourceType_Instance));
+  context.GetTagsCacheStatistics(count, hits, misses);
+  ASSERT_EQ(0u, count);
+}
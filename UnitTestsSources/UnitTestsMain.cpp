@@ -120,6 +120,45 @@ TEST(Zlib, DISABLED_Corrupted)  // Disabled because it may result in a crash
 }
 
 
+namespace
+{
+  class StringStream : public ZlibCompressor::IStreamOutput
+  {
+  public:
+    std::string content_;
+
+    virtual void Append(const void* data,
+                        size_t size)
+    {
+      content_.append(reinterpret_cast<const char*>(data), size);
+    }
+  };
+}
+
+
+TEST(Zlib, Stream)
+{
+  std::string s;
+  for (unsigned int i = 0; i < 20000; i++)
+  {
+    s += Toolbox::GenerateUuid();
+  }
+
+  ZlibCompressor c;
+  StringStream compressed, source;
+  c.Compress(compressed, s.c_str(), s.size(), &source);
+  ASSERT_EQ(s, source.content_);
+
+  std::string uncompressed;
+  c.Uncompress(uncompressed, compressed.content_);
+  ASSERT_EQ(s, uncompressed);
+
+  StringStream empty;
+  c.Compress(empty, NULL, 0, NULL);
+  ASSERT_EQ(0u, empty.content_.size());
+}
+
+
 TEST(Zlib, Empty)
 {
   std::string s = "";
@@ -293,6 +332,14 @@ TEST(Toolbox, ComputeMD5)
   ASSERT_EQ("8b1a9953c4611296a827abf8c47804d7", s);
   Toolbox::ComputeMD5(s, "");
   ASSERT_EQ("d41d8cd98f00b204e9800998ecf8427e", s);
+
+  Toolbox::MD5Context context;
+  context.Append("He", 2);
+  context.Append("", 0);
+  context.Append("llo", 3);
+  context.Finish(s);
+  ASSERT_EQ("8b1a9953c4611296a827abf8c47804d7", s);
+  ASSERT_THROW(context.Finish(s), OrthancException);
 }
 
 TEST(Toolbox, ComputeSHA1)